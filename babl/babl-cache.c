@@ -26,6 +26,14 @@
 #include "babl-internal.h"
 #include "git-version.h"
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <utime.h>
+#define BABL_LUT_CACHE 1
+#endif
+
 #ifdef _WIN32
 #define FALLBACK_CACHE_PATH  "C:/babl-fishes.txt"
 #else
@@ -217,16 +225,666 @@ cache_header (void)
   return buf;
 }
 
-void
-babl_store_db (void)
+#ifdef BABL_LUT_CACHE
+
+/* The u8 LUTs of fish paths are stored in separate files in a babl-luts
+ * directory next to the fish cache, the file name is a hash of a key
+ * made from the cache header, formats and conversions of the fish. The
+ * LUT data follows a fixed size header at an offset that is a multiple of
+ * the page size, permitting it to be mapped directly - sharing the pages
+ * between all processes using the same LUT.
+ *
+ * Blocks of lazily filled LUTs that are not yet computed are left as holes
+ * in the file.
+ */
+
+#define BABL_LUT_MAGIC       "babl-lut"
+#define BABL_LUT_VERSION     1
+#define BABL_LUT_DATA_OFFSET 65536
+
+typedef struct BablLutFileHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t header_hash;
+  uint32_t source_bpp;
+  uint32_t dest_bpp;
+  uint64_t size;
+  uint32_t filled[8];
+  uint32_t key_length; /* the key string follows the header */
+} BablLutFileHeader;
+
+static uint64_t
+lut_hash (const char *str)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (; *str; str++)
+    {
+      hash ^= (uint8_t) *str;
+      hash *= 0x100000001b3ULL;
+    }
+  return hash;
+}
+
+static char *
+lut_cache_dir (void)
+{
+  char *path = fish_cache_path ();
+  char *sep;
+  char *dir;
+
+  if (!path)
+    return NULL;
+  sep = strrchr (path, '/');
+  if (sep)
+    *sep = '\0';
+  dir = babl_malloc (strlen (path) + strlen ("/babl-luts") + 1);
+  sprintf (dir, "%s/babl-luts", sep ? path : ".");
+  babl_free (path);
+  return dir;
+}
+
+/* the key of the LUT of a fish, NULL when too long to be stored before
+ * the LUT data. The SIMD variant is part of it since blocks of a LUT are
+ * filled lazily, by whichever processes map it.
+ */
+static char *
+lut_cache_key (const Babl *fish)
+{
+  char *key = NULL;
+
+  key = babl_strcat (key, cache_header ());
+  key = babl_strcat (key, "\n");
+  key = babl_strcat (key, _babl_simd_variant ());
+  key = babl_strcat (key, "\n");
+  key = babl_strcat (key, babl_get_name (fish->fish.source));
+  key = babl_strcat (key, "\n");
+  key = babl_strcat (key, babl_get_name (fish->fish.destination));
+  key = babl_strcat (key, "\n");
+  for (int i = 0; i < fish->fish_path.conversion_list->count; i++)
+    {
+      key = babl_strcat (key,
+                         babl_get_name (fish->fish_path.conversion_list->items[i]));
+      key = babl_strcat (key, "\n");
+    }
+
+  if (strlen (key) >= BABL_LUT_DATA_OFFSET - sizeof (BablLutFileHeader))
+    {
+      babl_free (key);
+      return NULL;
+    }
+  return key;
+}
+
+static char *
+lut_cache_file (const char *dir,
+                const char *key)
+{
+  char *path = babl_malloc (strlen (dir) + strlen ("/0123456789abcdef.lut") + 1);
+
+  sprintf (path, "%s/%016llx.lut", dir, (unsigned long long) lut_hash (key));
+  return path;
+}
+
+static int
+lut_read_header (int                fd,
+                 BablLutFileHeader *header,
+                 const char        *key)
+{
+  char stored_key[1024];
+
+  if (pread (fd, header, sizeof (*header), 0) != sizeof (*header) ||
+      memcmp (header->magic, BABL_LUT_MAGIC, 8) ||
+      header->version != BABL_LUT_VERSION ||
+      header->header_hash != (uint32_t) lut_hash (cache_header ()))
+    return 0;
+
+  if (!key)
+    return 1;
+
+  if (header->key_length != strlen (key))
+    return 0;
+
+  /* the stored key is compared a piece at a time */
+  for (uint32_t offset = 0; offset < header->key_length;
+       offset += sizeof (stored_key))
+    {
+      uint32_t length = header->key_length - offset;
+
+      if (length > sizeof (stored_key))
+        length = sizeof (stored_key);
+      if (pread (fd, stored_key, length, sizeof (*header) + offset) != length ||
+          memcmp (stored_key, key + offset, length))
+        return 0;
+    }
+  return 1;
+}
+
+static void
+lut_load (Babl       *fish,
+          const char *dir)
+{
+  BablLutFileHeader header;
+  long              size = _babl_fish_lut_size (fish);
+  int               complete = 1;
+  int               valid;
+  char             *key;
+  char             *path;
+  void             *lut;
+  int               fd;
+
+  if (!size || !(key = lut_cache_key (fish)))
+    return;
+  path = lut_cache_file (dir, key);
+
+  fd = open (path, O_RDONLY);
+  babl_free (path);
+  if (fd < 0)
+    {
+      babl_free (key);
+      return;
+    }
+
+  valid = lut_read_header (fd, &header, key) &&
+          header.source_bpp == fish->fish_path.source_bpp &&
+          header.dest_bpp == fish->fish_path.dest_bpp &&
+          header.size == size;
+  babl_free (key);
+  if (!valid)
+    {
+      close (fd);
+      return;
+    }
+
+  for (int i = 0; i < 8; i++)
+    if (header.filled[i] != 0xffffffff)
+      complete = 0;
+
+  /* complete LUTs are mapped read-only, partial ones copy-on-write
+   * since missing blocks get computed into the mapping.
+   */
+  lut = mmap (NULL, size, complete ? PROT_READ : PROT_READ | PROT_WRITE,
+              MAP_PRIVATE, fd, BABL_LUT_DATA_OFFSET);
+  close (fd);
+  if (lut == MAP_FAILED)
+    return;
+
+  memcpy (fish->fish_path.u8_lut_filled, header.filled, sizeof (header.filled));
+  memcpy (fish->fish_path.u8_lut_claimed, header.filled, sizeof (header.filled));
+  fish->fish_path.u8_lut_mapped = 1;
+  fish->fish_path.u8_lut = lut;
+}
+
+static void
+lut_store (Babl       *fish,
+           const char *dir)
+{
+  BablLutFileHeader  header;
+  BablLutFileHeader  stored;
+  const char        *lut = (void*)fish->fish_path.u8_lut;
+  long               size = _babl_fish_lut_size (fish);
+  int                sparse = _babl_fish_lut_is_sparse (fish);
+  int                complete = 1;
+  char              *key;
+  char              *path;
+  char              *tmp_path;
+  int                fd;
+  int                ok = 1;
+
+  if (!lut || !size || !(key = lut_cache_key (fish)))
+    return;
+  path = lut_cache_file (dir, key);
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, BABL_LUT_MAGIC, 8);
+  header.version     = BABL_LUT_VERSION;
+  header.header_hash = lut_hash (cache_header ());
+  header.source_bpp  = fish->fish_path.source_bpp;
+  header.dest_bpp    = fish->fish_path.dest_bpp;
+  header.size        = size;
+  header.key_length  = strlen (key);
+  for (int i = 0; i < 8; i++)
+    {
+      header.filled[i] = sparse ? fish->fish_path.u8_lut_filled[i] : 0xffffffff;
+      complete = complete && header.filled[i] == 0xffffffff;
+    }
+
+  /* skip LUTs that have not gained any blocks since they were stored, a
+   * complete LUT mapped from its file cannot have; the files of LUTs used
+   * get their modification time updated, for pruning the least recently
+   * used ones.
+   */
+  if (fish->fish_path.u8_lut_mapped && complete)
+    {
+      if (fish->fish_path.last_lut_use)
+        utime (path, NULL);
+      goto done;
+    }
+  fd = open (path, O_RDONLY);
+  if (fd >= 0)
+    {
+      int unchanged = lut_read_header (fd, &stored, key) &&
+                      !memcmp (stored.filled, header.filled, sizeof (header.filled));
+      close (fd);
+      if (unchanged)
+        {
+          if (fish->fish_path.last_lut_use)
+            utime (path, NULL);
+          goto done;
+        }
+    }
+
+  tmp_path = babl_malloc (strlen (path) + 32);
+  sprintf (tmp_path, "%s~%i", path, (int) getpid ());
+  fd = open (tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    {
+      babl_free (tmp_path);
+      goto done;
+    }
+
+  ok = pwrite (fd, &header, sizeof (header), 0) == sizeof (header) &&
+       pwrite (fd, key, header.key_length, sizeof (header)) == header.key_length;
+
+  if (sparse)
+    {
+      long block_size = size / 256;
+      for (int block = 0; ok && block < 256; block++)
+        if (header.filled[block / 32] & (1u << (block % 32)))
+          ok = pwrite (fd, lut + block * block_size, block_size,
+                       BABL_LUT_DATA_OFFSET + block * block_size) == block_size;
+    }
+  else
+    {
+      ok = ok && pwrite (fd, lut, size, BABL_LUT_DATA_OFFSET) == size;
+    }
+  /* extend the file to the full size, leaving a hole for missing blocks */
+  ok = ok && ftruncate (fd, BABL_LUT_DATA_OFFSET + size) == 0;
+  ok = (close (fd) == 0) && ok;
+
+  if (ok)
+    _babl_rename (tmp_path, path);
+  else
+    _babl_remove (tmp_path);
+  babl_free (tmp_path);
+
+done:
+  babl_free (path);
+  babl_free (key);
+}
+
+/* The LUT files together are kept below a size, the least recently used
+ * going first, BABL_LUT_CACHE_SIZE sets the size in MiB.
+ */
+#define BABL_LUT_CACHE_SIZE  256
+
+typedef struct LutCacheFile
+{
+  char   *path;
+  time_t  mtime;
+  long    size;
+} LutCacheFile;
+
+typedef struct LutCacheScan
+{
+  LutCacheFile *files;
+  int           count;
+  int           allocated;
+  long          size;
+} LutCacheScan;
+
+/* removes LUT files stored by other versions of babl, or with different
+ * tolerance settings, and lists the others.
+ */
+static void
+lut_scan (const char *base_path,
+          const char *entry,
+          void       *data)
+{
+  LutCacheScan     *scan = data;
+  BablLutFileHeader header;
+  BablStat          stat_buf;
+  char             *path;
+  int               fd;
+  size_t            length = strlen (entry);
+
+  /* LUT files being written by lut_store are named <name>.lut~<pid> */
+  if (length < 4 || strcmp (entry + length - 4, ".lut") || strchr (entry, '~'))
+    return;
+  path = babl_malloc (strlen (base_path) + strlen (entry) + 2);
+  sprintf (path, "%s/%s", base_path, entry);
+  fd = open (path, O_RDONLY);
+  if (fd < 0)
+    {
+      babl_free (path);
+      return;
+    }
+  if (!lut_read_header (fd, &header, NULL) || fstat (fd, &stat_buf) != 0)
+    {
+      _babl_remove (path);
+      babl_free (path);
+    }
+  else
+    {
+      if (scan->count == scan->allocated)
+        {
+          scan->allocated = scan->allocated ? scan->allocated * 2 : 64;
+          scan->files = babl_realloc (scan->files,
+                                      scan->allocated * sizeof (LutCacheFile));
+        }
+      /* the blocks in use, as LUT files can be sparse */
+      scan->files[scan->count].path  = path;
+      scan->files[scan->count].mtime = stat_buf.st_mtime;
+      scan->files[scan->count].size  = stat_buf.st_blocks * 512;
+      scan->size += scan->files[scan->count].size;
+      scan->count++;
+    }
+  close (fd);
+}
+
+static int
+compare_lut_files_mtime (const void *a,
+                         const void *b)
+{
+  const LutCacheFile *file_a = a;
+  const LutCacheFile *file_b = b;
+
+  return (file_a->mtime > file_b->mtime) - (file_a->mtime < file_b->mtime);
+}
+
+static void
+lut_prune (const char *dir)
+{
+  LutCacheScan scan = { NULL, };
+  long         limit = BABL_LUT_CACHE_SIZE;
+
+  if (getenv ("BABL_LUT_CACHE_SIZE"))
+    limit = atol (getenv ("BABL_LUT_CACHE_SIZE"));
+  limit *= 1024 * 1024;
+
+  _babl_dir_foreach (dir, lut_scan, &scan);
+
+  if (scan.size > limit)
+    qsort (scan.files, scan.count, sizeof (LutCacheFile),
+           compare_lut_files_mtime);
+
+  for (int i = 0; i < scan.count; i++)
+    {
+      if (scan.size > limit)
+        {
+          _babl_remove (scan.files[i].path);
+          scan.size -= scan.files[i].size;
+        }
+      babl_free (scan.files[i].path);
+    }
+  if (scan.files)
+    babl_free (scan.files);
+}
+
+static void
+babl_store_luts (void)
 {
   BablDb *db = babl_fish_db ();
-  char *cache_path = fish_cache_path ();
+  char   *dir = lut_cache_dir ();
+  char   *probe;
+
+  if (!dir)
+    return;
+
+  probe = babl_malloc (strlen (dir) + strlen ("/probe") + 1);
+  sprintf (probe, "%s/probe", dir);
+  mk_ancestry (probe);
+  babl_free (probe);
+
+  for (int i = 0; i < db->babl_list->count; i++)
+  {
+    Babl *fish = db->babl_list->items[i];
+    if (fish->class_type == BABL_FISH_PATH && fish->fish_path.u8_lut)
+      lut_store (fish, dir);
+  }
+
+  lut_prune (dir);
+  babl_free (dir);
+}
+
+#endif
+
+/* The fish cache is stored in a binary form that can be mapped and
+ * validated in a single pass on startup: a header, followed by a table of
+ * string offsets, the fish entries, the conversion steps of fish paths
+ * as indices into the string table, and the NUL terminated strings.
+ * Format and conversion names are interned, so each is resolved once
+ * when loading regardless of how many fishes refer to it.
+ *
+ * The text format is still read when no binary cache exists, and can be
+ * written alongside it by setting BABL_FISH_CACHE_TEXT, for inspection.
+ */
+
+#define BABL_FISH_DB_MAGIC     "babl-fdb"
+#define BABL_FISH_DB_VERSION   1
+#define BABL_FISH_DB_REFERENCE 1
+
+typedef struct BablFishDbHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t header;       /* string index of the cache header */
+  uint32_t n_strings;
+  uint32_t n_fishes;
+  uint32_t n_steps;
+  uint32_t strings_size;
+  uint64_t file_size;
+} BablFishDbHeader;
+
+typedef struct BablFishDbEntry
+{
+  uint32_t source;       /* string index */
+  uint32_t destination;  /* string index */
+  uint32_t first_step;
+  uint16_t n_steps;
+  uint16_t flags;
+  int64_t  pixels;
+  double   cost;
+  double   error;
+} BablFishDbEntry;
+
+static inline size_t
+fish_db_align (size_t offset)
+{
+  return (offset + 7) & ~((size_t) 7);
+}
+
+static char *
+fish_cache_bin_path (void)
+{
+  char   *path = fish_cache_path ();
+  char   *bin_path;
+  size_t  len;
+
+  if (!path)
+    return NULL;
+  len = strlen (path);
+  if (len > 4 && !strcmp (path + len - 4, ".txt"))
+    len -= 4;
+  bin_path = babl_malloc (len + 5);
+  memcpy (bin_path, path, len);
+  strcpy (bin_path + len, ".bin");
+  babl_free (path);
+  return bin_path;
+}
+
+typedef struct FishDbStrings
+{
+  const char **strings;
+  uint32_t    *lengths;
+  int          count;
+  int          capacity;
+  int         *slots;     /* open addressing over strings, -1 when empty */
+  int          n_slots;
+  uint32_t     size;
+} FishDbStrings;
+
+static uint32_t
+fish_db_intern (FishDbStrings *st,
+                const char    *str)
+{
+  uint32_t hash = 2166136261u;
+  int      slot;
+
+  for (const char *p = str; *p; p++)
+    hash = (hash ^ (uint8_t) *p) * 16777619u;
+
+  for (slot = hash & (st->n_slots - 1);
+       st->slots[slot] >= 0;
+       slot = (slot + 1) & (st->n_slots - 1))
+    {
+      if (!strcmp (st->strings[st->slots[slot]], str))
+        return st->slots[slot];
+    }
+
+  st->slots[slot] = st->count;
+  st->strings[st->count] = str;
+  st->lengths[st->count] = strlen (str) + 1;
+  st->size += st->lengths[st->count];
+  return st->count++;
+}
+
+static int
+babl_store_db_binary (BablDb     *db,
+                      const char *path)
+{
+  FishDbStrings     st;
+  BablFishDbHeader  header;
+  BablFishDbEntry  *entries;
+  uint32_t         *steps;
+  uint32_t         *offsets;
+  int               max_strings = 1;
+  int               n_fishes = 0;
+  int               n_steps = 0;
+  size_t            entries_offset, steps_offset, strings_offset;
+  char             *tmpp;
+  FILE             *dbfile;
+  int               ok;
+
+  for (int i = 0; i < db->babl_list->count; i++)
+  {
+    Babl *fish = db->babl_list->items[i];
+    max_strings += 2;
+    if (fish->class_type == BABL_FISH_PATH)
+      max_strings += fish->fish_path.conversion_list->count;
+  }
+
+  memset (&st, 0, sizeof (st));
+  st.n_slots = 16;
+  while (st.n_slots < max_strings * 2)
+    st.n_slots *= 2;
+  st.strings = babl_malloc (sizeof (char*) * max_strings);
+  st.lengths = babl_malloc (sizeof (uint32_t) * max_strings);
+  st.slots   = babl_malloc (sizeof (int) * st.n_slots);
+  memset (st.slots, 0xff, sizeof (int) * st.n_slots);
+  entries    = babl_calloc (db->babl_list->count + 1, sizeof (BablFishDbEntry));
+  steps      = babl_malloc (sizeof (uint32_t) * max_strings);
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, BABL_FISH_DB_MAGIC, 8);
+  header.version = BABL_FISH_DB_VERSION;
+  header.header  = fish_db_intern (&st, cache_header ());
+
+  for (int i = 0; i < db->babl_list->count; i++)
+  {
+    Babl            *fish = db->babl_list->items[i];
+    BablFishDbEntry *entry = &entries[n_fishes];
+
+    if (fish->class_type != BABL_FISH &&
+        fish->class_type != BABL_FISH_PATH)
+      continue;
+
+    entry->source      = fish_db_intern (&st, babl_get_name (fish->fish.source));
+    entry->destination = fish_db_intern (&st, babl_get_name (fish->fish.destination));
+    entry->first_step  = n_steps;
+    entry->pixels      = fish->fish.pixels;
+    entry->error       = fish->fish.error;
+
+    if (fish->class_type == BABL_FISH_PATH)
+    {
+      entry->cost    = (int)fish->fish_path.cost;
+      entry->n_steps = fish->fish_path.conversion_list->count;
+      for (int j = 0; j < entry->n_steps; j++)
+        steps[n_steps++] = fish_db_intern (&st,
+          babl_get_name (fish->fish_path.conversion_list->items[j]));
+    }
+    else
+    {
+      entry->flags = BABL_FISH_DB_REFERENCE;
+    }
+    n_fishes++;
+  }
+
+  header.n_strings    = st.count;
+  header.n_fishes     = n_fishes;
+  header.n_steps      = n_steps;
+  header.strings_size = st.size;
+
+  entries_offset = fish_db_align (sizeof (header) + sizeof (uint32_t) * st.count);
+  steps_offset   = entries_offset + sizeof (BablFishDbEntry) * n_fishes;
+  strings_offset = steps_offset + sizeof (uint32_t) * n_steps;
+  header.file_size = strings_offset + st.size;
+
+  offsets = babl_malloc (sizeof (uint32_t) * (st.count + 1));
+  offsets[0] = 0;
+  for (int i = 1; i < st.count; i++)
+    offsets[i] = offsets[i-1] + st.lengths[i-1];
+
+  tmpp = babl_malloc (strlen (path) + 2);
+  sprintf (tmpp, "%s~", path);
+  dbfile = _babl_fopen (tmpp, "wb");
+  ok = dbfile != NULL;
+  if (ok)
+  {
+    static const char zeros[8] = {0,};
+    size_t            pad = entries_offset - sizeof (header) - sizeof (uint32_t) * st.count;
+
+    ok = fwrite (&header, sizeof (header), 1, dbfile) == 1 &&
+         fwrite (offsets, sizeof (uint32_t), st.count, dbfile) == (size_t) st.count &&
+         fwrite (zeros, 1, pad, dbfile) == pad &&
+         fwrite (entries, sizeof (BablFishDbEntry), n_fishes, dbfile) == (size_t) n_fishes &&
+         fwrite (steps, sizeof (uint32_t), n_steps, dbfile) == (size_t) n_steps;
+    for (int i = 0; ok && i < st.count; i++)
+      ok = fwrite (st.strings[i], 1, st.lengths[i], dbfile) == st.lengths[i];
+    ok = (fclose (dbfile) == 0) && ok;
+  }
+
+  if (ok)
+  {
+#ifdef _WIN32
+    _babl_remove (path);
+#endif
+    _babl_rename (tmpp, path);
+  }
+  else if (dbfile)
+  {
+    _babl_remove (tmpp);
+  }
+
+  babl_free (tmpp);
+  babl_free (offsets);
+  babl_free (steps);
+  babl_free (entries);
+  babl_free (st.slots);
+  babl_free (st.lengths);
+  babl_free (st.strings);
+  return ok;
+}
+
+static void
+babl_store_db_text (BablDb     *db,
+                    const char *cache_path)
+{
   char *tmpp = calloc(8000,1);
   FILE *dbfile = NULL;
   int i;
 
-  if (!cache_path || !tmpp)
+  if (!tmpp)
     goto cleanup;
 
   snprintf (tmpp, 8000, "%s~", cache_path);
@@ -236,12 +894,6 @@ babl_store_db (void)
 
   fprintf (dbfile, "%s\n", cache_header ());
 
-  /* sort the list of fishes by usage, making next run more efficient -
-   * and the data easier to approach as data for targeted optimization
-   */
-  qsort (db->babl_list->items, db->babl_list->count,
-         sizeof (Babl*), compare_fish_pixels);
-
   for (i = 0; i< db->babl_list->count; i++)
   {
     Babl *fish = db->babl_list->items[i];
@@ -262,11 +914,42 @@ cleanup:
   if (dbfile)
     fclose (dbfile);
 
+  if (tmpp)
+    free (tmpp);
+}
+
+void
+babl_store_db (void)
+{
+  BablDb *db = babl_fish_db ();
+  char *cache_path = fish_cache_path ();
+  char *bin_path = fish_cache_bin_path ();
+
+  if (!cache_path || !bin_path)
+    goto cleanup;
+
+  /* sort the list of fishes by usage, making next run more efficient -
+   * and the data easier to approach as data for targeted optimization
+   */
+  qsort (db->babl_list->items, db->babl_list->count,
+         sizeof (Babl*), compare_fish_pixels);
+
+  babl_store_db_binary (db, bin_path);
+
+  if (getenv ("BABL_FISH_CACHE_TEXT"))
+    babl_store_db_text (db, cache_path);
+
+#ifdef BABL_LUT_CACHE
+  if (!getenv ("BABL_INHIBIT_LUT_CACHE"))
+    babl_store_luts ();
+#endif
+
+cleanup:
   if (cache_path)
     babl_free (cache_path);
 
-  if (tmpp)
-    free (tmpp);
+  if (bin_path)
+    babl_free (bin_path);
 }
 
 int
@@ -278,10 +961,235 @@ _babl_fish_create_name (char       *buf,
                         const Babl *destination,
                         int         is_reference);
 
-void 
-babl_init_db (void)
+/* creates a fish for a cache entry, returns NULL if there already is
+ * one registered for the formats.
+ */
+static Babl *
+cache_fish_new (const Babl *from_format,
+                const Babl *to_format,
+                int         is_reference)
+{
+  Babl *babl;
+  char name[4096];
+
+  _babl_fish_create_name (name, from_format, to_format, 1);
+  babl = babl_db_exist_by_name (babl_fish_db (), name);
+  if (babl)
+  {
+    fprintf (stderr, "%s:%i: loading of cache failed\n",
+                    __FUNCTION__, __LINE__);
+    return NULL;
+  }
+
+  if (is_reference)
+  {
+    /* there isn't a suitable path for requested formats,
+     * let's create a dummy BABL_FISH instance and insert
+     * it into the fish database to indicate that such path
+     * does not exist.
+     */
+    const char *name = "X"; /* name does not matter */
+    babl = babl_calloc (1, sizeof (BablFish) + strlen (name) + 1);
+
+    babl->class_type       = BABL_FISH;
+    babl->instance.id      = babl_fish_get_id (from_format,
+                                               to_format);
+    babl->instance.name    = ((char *) babl) + sizeof (BablFish);
+    strcpy (babl->instance.name, name);
+    babl->fish.source      = from_format;
+    babl->fish.destination = to_format;
+    babl->fish.data        = (void*) 1; /* signals babl_fish() to
+                                         * show a "missing fash path"
+                                         * warning upon the first
+                                         * lookup
+                                         */
+  }
+  else
+  {
+    babl = babl_calloc (1, sizeof (BablFishPath) +
+                        strlen (name) + 1);
+    babl_set_destructor (babl, _babl_fish_path_destroy);
+
+    babl->class_type     = BABL_FISH_PATH;
+    babl->instance.id    = babl_fish_get_id (from_format, to_format);
+    babl->instance.name  = ((char *) babl) + sizeof (BablFishPath);
+    strcpy (babl->instance.name, name);
+    babl->fish.source               = from_format;
+    babl->fish.destination          = to_format;
+    babl->fish_path.conversion_list = babl_list_init_with_size (10);
+    _babl_fish_rig_dispatch (babl);
+  }
+  return babl;
+}
+
+static void
+cache_fish_finalize (Babl       *babl,
+                     time_t      tim,
+                     const char *lut_dir)
+{
+  if ((babl->fish.pixels) == (tim % 100))
+  {
+    /* 1% chance of individual cached conversions being dropped -
+     * making sure mis-measured conversions do not
+       stick around for a long time*/
+    babl_free (babl);
+    return;
+  }
+
+  babl_db_insert (babl_fish_db(), babl);
+#ifdef BABL_LUT_CACHE
+  if (lut_dir &&
+      babl->class_type == BABL_FISH_PATH &&
+      babl->fish_path.is_u8_color_conv)
+    lut_load (babl, lut_dir);
+#endif
+}
+
+static int
+babl_init_db_binary (const char *path,
+                     const char *lut_dir)
+{
+  const BablFishDbHeader *header;
+  const uint32_t         *offsets;
+  const BablFishDbEntry  *entries;
+  const uint32_t         *steps;
+  const char             *strings;
+  const Babl            **resolved = NULL;
+  char                   *contents = NULL;
+  long                    length = -1;
+  time_t                  tim = time (NULL);
+  size_t                  entries_offset, steps_offset, strings_offset;
+  int                     valid = 0;
+#ifdef BABL_LUT_CACHE
+  int                     fd = open (path, O_RDONLY);
+
+  if (fd >= 0)
+  {
+    BablStat stat_buf;
+    if (fstat (fd, &stat_buf) == 0 && stat_buf.st_size >= (long) sizeof (*header))
+    {
+      length = stat_buf.st_size;
+      contents = mmap (NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (contents == MAP_FAILED)
+        contents = NULL;
+    }
+    close (fd);
+  }
+#else
+  _babl_file_get_contents (path, &contents, &length, NULL);
+#endif
+  if (!contents)
+    return 0;
+
+  /* validate everything before creating any fishes */
+  header = (void*)contents;
+  if (length < (long) sizeof (*header) ||
+      memcmp (header->magic, BABL_FISH_DB_MAGIC, 8) ||
+      header->version != BABL_FISH_DB_VERSION ||
+      header->file_size != (uint64_t) length ||
+      header->n_strings == 0 ||
+      header->n_strings > length / sizeof (uint32_t) ||
+      header->n_fishes > length / sizeof (BablFishDbEntry) ||
+      header->n_steps > length / sizeof (uint32_t))
+    goto cleanup;
+
+  entries_offset = fish_db_align (sizeof (*header) + sizeof (uint32_t) * header->n_strings);
+  steps_offset   = entries_offset + sizeof (BablFishDbEntry) * header->n_fishes;
+  strings_offset = steps_offset + sizeof (uint32_t) * header->n_steps;
+  if (strings_offset + header->strings_size != (uint64_t) length ||
+      header->strings_size == 0)
+    goto cleanup;
+
+  offsets = (void*)(contents + sizeof (*header));
+  entries = (void*)(contents + entries_offset);
+  steps   = (void*)(contents + steps_offset);
+  strings = contents + strings_offset;
+
+  if (strings[header->strings_size - 1] != '\0' ||
+      header->header >= header->n_strings)
+    goto cleanup;
+  for (uint32_t i = 0; i < header->n_strings; i++)
+    if (offsets[i] >= header->strings_size)
+      goto cleanup;
+  for (uint32_t i = 0; i < header->n_steps; i++)
+    if (steps[i] >= header->n_strings)
+      goto cleanup;
+  for (uint32_t i = 0; i < header->n_fishes; i++)
+    if (entries[i].source >= header->n_strings ||
+        entries[i].destination >= header->n_strings ||
+        (uint64_t) entries[i].first_step + entries[i].n_steps > header->n_steps)
+      goto cleanup;
+
+  valid = 1;
+
+  /* if babl has changed in git .. drop whole cache */
+  if (strcmp (strings + offsets[header->header], cache_header ()))
+    goto cleanup;
+
+  resolved = babl_calloc (header->n_strings, sizeof (Babl*));
+
+#define RESOLVE(index, db) \
+  (resolved[index] ? resolved[index] : \
+     (resolved[index] = babl_db_find (db, strings + offsets[index])))
+
+  for (uint32_t i = 0; i < header->n_fishes; i++)
+  {
+    const BablFishDbEntry *entry = &entries[i];
+    const Babl *from_format = RESOLVE (entry->source, babl_format_db ());
+    const Babl *to_format   = RESOLVE (entry->destination, babl_format_db ());
+    Babl       *babl;
+    int         j;
+
+    if (!from_format || !to_format)
+      continue;
+
+    babl = cache_fish_new (from_format, to_format,
+                           entry->flags & BABL_FISH_DB_REFERENCE);
+    if (!babl)
+      break;
+
+    babl->fish.error  = entry->error;
+    babl->fish.pixels = entry->pixels;
+
+    if (babl->class_type == BABL_FISH_PATH)
+    {
+      babl->fish_path.cost = entry->cost;
+      _babl_fish_prepare_bpp (babl);
+
+      for (j = 0; j < entry->n_steps; j++)
+      {
+        uint32_t    step = steps[entry->first_step + j];
+        const Babl *conv = RESOLVE (step, babl_conversion_db ());
+        if (!conv)
+          break;
+        babl_list_insert_last (babl->fish_path.conversion_list, (void*)conv);
+      }
+      if (j < entry->n_steps)
+      {
+        babl_free (babl);
+        continue;
+      }
+    }
+
+    cache_fish_finalize (babl, tim, lut_dir);
+  }
+#undef RESOLVE
+
+cleanup:
+  if (resolved)
+    babl_free (resolved);
+#ifdef BABL_LUT_CACHE
+  munmap (contents, length);
+#else
+  free (contents);
+#endif
+  return valid;
+}
+
+static void
+babl_init_db_text (const char *path,
+                   const char *lut_dir)
 {
-  char *path = fish_cache_path ();
   long  length = -1;
   char  seps[] = "\n\r";
   Babl *babl   = NULL;
@@ -292,9 +1200,6 @@ babl_init_db (void)
   const Babl  *to_format   = NULL;
   time_t tim = time (NULL);
 
-  if (getenv ("BABL_DEBUG_CONVERSIONS"))
-    goto cleanup;
-
   _babl_file_get_contents (path, &contents, &length, NULL);
   if (!contents)
     goto cleanup;
@@ -306,17 +1211,7 @@ babl_init_db (void)
       {
         case '-': /* finalize */
           if (babl)
-          {
-            if ((babl->fish.pixels) == (tim % 100))
-            {
-              /* 1% chance of individual cached conversions being dropped -
-               * making sure mis-measured conversions do not
-                 stick around for a long time*/
-              babl_free (babl);
-            }
-            else
-              babl_db_insert (babl_fish_db(), babl);
-          }
+            cache_fish_finalize (babl, tim, lut_dir);
           from_format = NULL;
           to_format = NULL;
           babl=NULL;
@@ -334,55 +1229,11 @@ babl_init_db (void)
             char seps2[] = " ";
             char *tokp2;
             char *token2;
-            char name[4096];
 
-            _babl_fish_create_name (name, from_format, to_format, 1);
-            babl = babl_db_exist_by_name (babl_fish_db (), name);
-            if (babl)
-            {
-              fprintf (stderr, "%s:%i: loading of cache failed\n",
-                              __FUNCTION__, __LINE__);
+            babl = cache_fish_new (from_format, to_format,
+                                   strstr (token, "[reference]") != NULL);
+            if (!babl)
               goto cleanup;
-            }
-
-            if (strstr (token, "[reference]"))
-            {
-              /* there isn't a suitable path for requested formats,
-               * let's create a dummy BABL_FISH instance and insert
-               * it into the fish database to indicate that such path
-               * does not exist.
-               */
-              const char *name = "X"; /* name does not matter */
-              babl = babl_calloc (1, sizeof (BablFish) + strlen (name) + 1);
-
-              babl->class_type       = BABL_FISH;
-              babl->instance.id      = babl_fish_get_id (from_format,
-                                                         to_format);
-              babl->instance.name    = ((char *) babl) + sizeof (BablFish);
-              strcpy (babl->instance.name, name);
-              babl->fish.source      = from_format;
-              babl->fish.destination = to_format;
-              babl->fish.data        = (void*) 1; /* signals babl_fish() to
-                                                   * show a "missing fash path"
-                                                   * warning upon the first
-                                                   * lookup
-                                                   */
-            }
-            else
-            {
-              babl = babl_calloc (1, sizeof (BablFishPath) +
-                                  strlen (name) + 1);
-              babl_set_destructor (babl, _babl_fish_path_destroy);
-
-              babl->class_type     = BABL_FISH_PATH;
-              babl->instance.id    = babl_fish_get_id (from_format, to_format);
-              babl->instance.name  = ((char *) babl) + sizeof (BablFishPath);
-              strcpy (babl->instance.name, name);
-              babl->fish.source               = from_format;
-              babl->fish.destination          = to_format;
-              babl->fish_path.conversion_list = babl_list_init_with_size (10);
-              _babl_fish_rig_dispatch (babl);
-            }
 
             token2 = strtok_r (&token[1], seps2, &tokp2);
             while( token2 != NULL )
@@ -435,7 +1286,39 @@ babl_init_db (void)
 cleanup:
   if (contents)
     free (contents);
+}
+
+void 
+babl_init_db (void)
+{
+  char *path;
+  char *bin_path;
+#ifdef BABL_LUT_CACHE
+  char *lut_dir;
+#else
+  char *lut_dir = NULL;
+#endif
+
+  if (getenv ("BABL_DEBUG_CONVERSIONS"))
+    return;
+
+  path = fish_cache_path ();
+  bin_path = fish_cache_bin_path ();
+#ifdef BABL_LUT_CACHE
+  lut_dir = getenv ("BABL_INHIBIT_LUT_CACHE") ? NULL : lut_cache_dir ();
+#endif
+
+  /* the text cache is only read when there is no valid binary cache,
+   * for instance when first running a version of babl writing binary
+   * caches
+   */
+  if (!bin_path || !babl_init_db_binary (bin_path, lut_dir))
+    babl_init_db_text (path, lut_dir);
 
+  if (lut_dir)
+    babl_free (lut_dir);
+  if (bin_path)
+    babl_free (bin_path);
   if (path)
     babl_free (path);
 }
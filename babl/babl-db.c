@@ -43,7 +43,7 @@ _babl_hash_by_str (BablHashTable *htab,
   hash ^= (hash >> 11);
   hash += (hash << 15);
 
-  return (hash & htab->mask);
+  return hash;
 }
 
 int
@@ -58,17 +58,16 @@ static int
 _babl_hash_by_int (BablHashTable *htab,
                    int           id)
 {
-  int   hash = 0;
-  hash +=  id & 0xFF;
-  hash += (hash << 10);
-  hash ^= (hash >> 6);
-  id >>= 8;
-  hash +=  id & 0xFF;
-  hash += (hash << 3);
-  hash ^= (hash >> 11);
-  hash += (hash << 15);
+  /* murmur3 32bit finalizer */
+  unsigned int hash = id;
+
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
 
-  return (hash & htab->mask);
+  return hash;
 }
 
 int
@@ -151,8 +150,8 @@ Babl *
 babl_db_find (BablDb     *db,
               const char *name)
 {
-  return babl_hash_table_find (db->name_hash, _babl_hash_by_str (db->name_hash, name),
-                              NULL, (void *) name);
+  return babl_hash_table_find_name (db->name_hash,
+                                    _babl_hash_by_str (db->name_hash, name), name);
 }
 
 int
@@ -194,9 +193,9 @@ babl_db_exist (BablDb     *db,
 {
   Babl *ret;
   if (id)
-    ret = babl_hash_table_find (db->id_hash, _babl_hash_by_int (db->id_hash, id), NULL, &id);
+    ret = babl_hash_table_find_id (db->id_hash, _babl_hash_by_int (db->id_hash, id), id);
   else
-    ret = babl_hash_table_find (db->name_hash, _babl_hash_by_str (db->name_hash, name), NULL, (void *) name);
+    ret = babl_hash_table_find_name (db->name_hash, _babl_hash_by_str (db->name_hash, name), name);
   return ret;
 }
 
@@ -205,7 +204,7 @@ babl_db_exist_by_id (BablDb *db,
                      int    id)
 {
   Babl *ret;
-  ret = babl_hash_table_find (db->id_hash, _babl_hash_by_int (db->id_hash, id), NULL, &id);
+  ret = babl_hash_table_find_id (db->id_hash, _babl_hash_by_int (db->id_hash, id), id);
   return ret;
 }
 
@@ -214,7 +213,7 @@ babl_db_exist_by_name (BablDb     *db,
                        const char *name)
 {
   Babl *ret;
-  ret = babl_hash_table_find (db->name_hash, _babl_hash_by_str (db->name_hash, name),
-                              NULL, (void *) name);
+  ret = babl_hash_table_find_name (db->name_hash, _babl_hash_by_str (db->name_hash, name),
+                                   name);
   return ret;
 }
@@ -18,8 +18,13 @@
 
 #include "config.h"
 #include <math.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #include "babl-internal.h"
 #include "babl-ref-pixels.h"
+#include "babl-parallel.h"
 
 #define BABL_TOLERANCE             0.0000047
 #define BABL_MAX_COST_VALUE        2000000
@@ -61,9 +66,7 @@ static int gc_fishes (Babl *babl, void *userdata)
       if (context->time - babl->fish_path.last_lut_use >
           1000 * 1000 * 60 * lut_unused_minutes_limit)
       {
-        void *lut =babl->fish_path.u8_lut;
-        BABL(babl)->fish_path.u8_lut = NULL;
-        free (lut);
+        _babl_fish_lut_free (babl);
         BABL(babl)->fish.pixels = 0;
         LUT_LOG("freeing LUT %s to %s unused for >%.1f minutes\n",
                 babl_get_name (babl->conversion.source),
@@ -131,163 +134,6 @@ static float timings[256] = {0,};
 
 #define BPP_4ASSOCIATED   14
 
-static inline int _do_lut (uint32_t *lut,
-                           int   source_bpp,
-                           int   dest_bpp,
-                           const void *__restrict__ source,
-                           void *__restrict__ destination,
-                           long n)
-{
-        if (source_bpp == BPP_4ASSOCIATED  && dest_bpp == 4)
-        {
-          uint32_t *src = (uint32_t*)source;
-          uint32_t *dst = (uint32_t*)destination;
-          while (n--)
-          {
-             uint32_t col = *src++;
-             uint8_t *rgba=(uint8_t*)&col;
-             uint8_t oalpha = rgba[3];
-             if (oalpha==0)
-             {
-               *dst++ = 0;
-             }
-             else
-             {
-               uint32_t col_opaque = col;
-               uint8_t *rgbaB=(uint8_t*)&col_opaque;
-               uint32_t ralpha = 0;
-               ralpha = (256*255)/oalpha;
-               rgbaB[0] = (rgba[0]*ralpha)>>8;
-               rgbaB[1] = (rgba[1]*ralpha)>>8;
-               rgbaB[2] = (rgba[2]*ralpha)>>8;
-               rgbaB[3] = 0;
-               *dst++ = lut[col_opaque] | (oalpha<<24);
-             }
-          }
-        }
-        else if (source_bpp == 4 && dest_bpp == 16)
-        {
-          uint32_t *src = (uint32_t*)source;
-          uint32_t *dst = (uint32_t*)destination;
-          while (n--)
-          {
-             uint32_t col = *src++;
-             uint32_t lut_offset = col & 0xffffff;
-             float alpha = (col>>24)/255.0f;
-
-             *dst++ = lut[lut_offset*4+0];
-             *dst++ = lut[lut_offset*4+1];
-             *dst++ = lut[lut_offset*4+2];
-             ((float*)(dst))[0] = alpha;
-             dst++;
-          }
-        }
-        else if (source_bpp == 4 && dest_bpp == 8)
-        {
-          uint32_t *src = (uint32_t*)source;
-          uint16_t *dst = (uint16_t*)destination;
-          uint16_t *lut16 = (uint16_t*)lut;
-          while (n--)
-          {
-             uint32_t col = *src++;
-             uint32_t lut_offset = col & 0xffffff;
-             uint16_t alpha = (col>>24) << 8; 
-
-             dst[0] = lut16[lut_offset*2+0];
-             dst[1] = lut16[lut_offset*2+1];
-             dst[2] = lut16[lut_offset*2+2];
-             dst[3] = alpha;
-             dst+=4;
-          }
-        }
-        else if (source_bpp == 2 && dest_bpp == 16)
-        {
-          uint16_t *src = (uint16_t*)source;
-          uint32_t *dst = (uint32_t*)destination;
-          while (n--)
-          {
-             uint32_t col = *src++;
-             *dst++ = lut[col*4+0];
-             *dst++ = lut[col*4+1];
-             *dst++ = lut[col*4+2];
-             *dst++ = lut[col*4+3];
-          }
-        }
-        else if (source_bpp == 4 && dest_bpp == 4)
-        {
-          uint32_t *src = (uint32_t*)source;
-          uint32_t *dst = (uint32_t*)destination;
-          while (n--)
-          {
-             uint32_t col = *src++;
-             *dst = (col & 0xff000000) | lut[col & 0xffffff];
-             dst++;
-          }
-        }
-        else if (source_bpp == 2 && dest_bpp == 4)
-        {
-          uint16_t *src = (uint16_t*)source;
-          uint32_t *dst = (uint32_t*)destination;
-          while (n--)
-          {
-            *dst = lut[*src++];
-            dst++;
-          }
-        }
-        else if (source_bpp == 2 && dest_bpp == 2)
-        {
-          uint16_t *src = (uint16_t*)source;
-          uint16_t *dst = (uint16_t*)destination;
-          uint16_t *lut16 = (uint16_t*)lut;
-          while (n--)
-          {
-             *dst = lut16[*src++];
-             dst++;
-          }
-        }
-        else if (source_bpp == 1 && dest_bpp == 4)
-        {
-          uint8_t *src = (uint8_t*)source;
-          uint32_t *dst = (uint32_t*)destination;
-          while (n--)
-          {
-             *dst = lut[*src++];
-             dst++;
-          }
-        }
-        else if (source_bpp == 3 && dest_bpp == 3)
-        {
-          uint8_t *src = (uint8_t*)source;
-          uint8_t *dst = (uint8_t*)destination;
-          while (n--)
-          {
-             uint32_t col = src[0]*256*256+src[1]*256+src[2];
-             uint32_t val = lut[col];
-             dst[2]=(val >> 16) & 0xff;
-             dst[1]=(val >> 8) & 0xff;
-             dst[0]=val & 0xff;
-             dst+=3;
-             src+=3;
-          }
-        }
-        else if (source_bpp == 3 && dest_bpp == 4)
-        {
-          uint8_t *src = (uint8_t*)source;
-          uint32_t *dst = (uint32_t*)destination;
-          while (n--)
-          {
-             *dst = lut[src[0]*256*256+src[1]*256+src[2]];
-             dst++;
-             src+=3;
-          }
-        }
-        else
-        {
-          return 0;
-        }
-        return 1;
-}
-
 void babl_test_lut (uint32_t *lut,
              int   source_bpp,
              int   dest_bpp,
@@ -301,7 +147,7 @@ void babl_test_lut (uint32_t *lut,
              void *__restrict__ dest,
              long count)
 {
-   _do_lut (lut, source_bpp, dest_bpp, source, dest, count);
+   _babl_do_lut (lut, source_bpp, dest_bpp, source, dest, count);
 }
 
 static inline float lut_timing_for (int source_bpp, int dest_bpp)
@@ -357,7 +203,343 @@ process_conversion_path (BablList   *path,
                          int         source_bpp,
                          void       *destination_buffer,
                          int         dest_bpp,
-                         long        n);
+                         long        n,
+                         int         chunk_size,
+                         int         scratch_bpp);
+
+static int
+fish_path_chunk_size (Babl *babl);
+
+/* 24bit LUTs are split in 256 blocks of 64k entries, indexed by the
+ * most significant byte of the LUT offset, a block is computed the first
+ * time a pixel falls within it.
+ */
+#define LUT_BLOCK_SIZE  (256 * 256)
+
+static inline int
+lut_is_sparse (int source_bpp,
+               int dest_bpp)
+{
+  return (source_bpp == 4 && (dest_bpp == 4 || dest_bpp == 8 || dest_bpp == 16)) ||
+         (source_bpp == 3 && (dest_bpp == 3 || dest_bpp == 4));
+}
+
+static void
+lut_build_block (const Babl *babl,
+                 uint32_t   *lut,
+                 int         block)
+{
+  BablList *path       = babl->fish_path.conversion_list;
+  int       source_bpp = babl->fish_path.source_bpp;
+  int       dest_bpp   = babl->fish_path.dest_bpp;
+  long      first      = (long) block * LUT_BLOCK_SIZE;
+  int       chunk_size = fish_path_chunk_size ((Babl*)babl);
+  int       scratch    = babl->fish_path.scratch_bpp;
+
+  if (source_bpp == 4 && dest_bpp == 4)
+  {
+    uint32_t *dst = lut + first;
+    for (int o = 0; o < LUT_BLOCK_SIZE; o++)
+      dst[o] = (first + o) | 0xff000000;
+    process_conversion_path (path, dst, 4, dst, 4, LUT_BLOCK_SIZE,
+                             chunk_size, scratch);
+    for (int o = 0; o < LUT_BLOCK_SIZE; o++)
+      dst[o] = dst[o] & 0x00ffffff;
+  }
+  else if (source_bpp == 4)
+  {
+    uint32_t *temp_lut = malloc (LUT_BLOCK_SIZE * 4);
+    for (int o = 0; o < LUT_BLOCK_SIZE; o++)
+      temp_lut[o] = (first + o) | 0xff000000;
+    process_conversion_path (path, temp_lut, 4,
+                             ((char*)lut) + first * dest_bpp, dest_bpp,
+                             LUT_BLOCK_SIZE, chunk_size, scratch);
+    free (temp_lut);
+  }
+  else if (source_bpp == 3)
+  {
+    uint8_t *temp_lut = malloc (LUT_BLOCK_SIZE * 3);
+    int o = 0;
+    for (int g = 0; g < 256; g++)
+    for (int b = 0; b < 256; b++, o++)
+    {
+      temp_lut[o*3+0]=block;
+      temp_lut[o*3+1]=g;
+      temp_lut[o*3+2]=b;
+    }
+    if (dest_bpp == 4)
+    {
+      process_conversion_path (path, temp_lut, 3,
+                               lut + first, 4,
+                               LUT_BLOCK_SIZE, chunk_size, scratch);
+    }
+    else
+    {
+      uint8_t *temp_lut2 = malloc (LUT_BLOCK_SIZE * 3);
+      process_conversion_path (path, temp_lut, 3,
+                               temp_lut2, 3,
+                               LUT_BLOCK_SIZE, chunk_size, scratch);
+      babl_process (babl_fish (babl_format ("R'G'B' u8"), babl_format ("R'G'B'A u8")),
+                    temp_lut2, lut + first, LUT_BLOCK_SIZE);
+      for (o = 0; o < LUT_BLOCK_SIZE; o++)
+        lut[first + o] = lut[first + o] & 0x00ffffff;
+      free (temp_lut2);
+    }
+    free (temp_lut);
+  }
+}
+
+typedef struct LutBlockJob
+{
+  const Babl *babl;
+  uint32_t   *lut;
+  int         n_blocks;
+  uint8_t     blocks[256];
+} LutBlockJob;
+
+static void
+lut_block_job (int   job,
+               int   n_jobs,
+               void *data)
+{
+  LutBlockJob *block_job = data;
+
+  lut_build_block (block_job->babl, block_job->lut, block_job->blocks[job]);
+}
+
+/* marks the LUT blocks the pixels in source fall within in the
+ * needed bitmap.
+ */
+static void
+lut_needed_blocks (int         source_bpp,
+                   const void *source,
+                   long        n,
+                   uint32_t   *needed)
+{
+  if (source_bpp == BPP_4ASSOCIATED)
+  {
+    const uint8_t *src = source;
+    for (long i = 0; i < n; i++, src += 4)
+    {
+      uint8_t oalpha = src[3];
+      if (oalpha)
+      {
+        uint32_t ralpha = (256*255)/oalpha;
+        uint8_t block = (src[2]*ralpha)>>8;
+        needed[block >> 5] |= 1u << (block & 31);
+      }
+    }
+  }
+  else if (source_bpp == 4)
+  {
+    const uint8_t *src = source;
+    for (long i = 0; i < n; i++, src += 4)
+      needed[src[2] >> 5] |= 1u << (src[2] & 31);
+  }
+  else
+  {
+    const uint8_t *src = source;
+    for (long i = 0; i < n; i++, src += 3)
+      needed[src[0] >> 5] |= 1u << (src[0] & 31);
+  }
+}
+
+/* ensures that the LUT blocks needed for processing source are
+ * computed, missing blocks are computed in parallel. Returns 0 if some
+ * needed blocks are still being computed by another thread, the caller
+ * should then fall back to processing the conversion path.
+ */
+static int
+lut_ensure_blocks (const Babl *babl,
+                   uint32_t   *lut,
+                   int         source_bpp,
+                   const void *source,
+                   long        n)
+{
+  uint32_t    needed[8] = {0,};
+  uint32_t    pending_blocks[8] = {0,};
+  int         pending = 0;
+  LutBlockJob job;
+  int         complete = 1;
+
+  for (int i = 0; i < 8; i++)
+    if (__atomic_load_n (&babl->fish_path.u8_lut_filled[i], __ATOMIC_ACQUIRE) != 0xffffffff)
+      complete = 0;
+  if (complete)
+    return 1;
+
+  lut_needed_blocks (source_bpp, source, n, needed);
+
+  job.babl = babl;
+  job.lut = lut;
+  job.n_blocks = 0;
+
+  for (int i = 0; i < 8; i++)
+  {
+    uint32_t missing = needed[i] &
+      ~__atomic_load_n (&babl->fish_path.u8_lut_filled[i], __ATOMIC_ACQUIRE);
+    uint32_t claimed;
+
+    if (!missing)
+      continue;
+    claimed = __atomic_fetch_or (&BABL(babl)->fish_path.u8_lut_claimed[i],
+                                 missing, __ATOMIC_ACQ_REL);
+    pending_blocks[i] = missing & claimed;
+    pending |= pending_blocks[i] != 0;
+    missing &= ~claimed;
+    for (int bit = 0; bit < 32; bit++)
+      if (missing & (1u << bit))
+        job.blocks[job.n_blocks++] = i * 32 + bit;
+    needed[i] = missing;
+  }
+
+  if (job.n_blocks)
+  {
+    long start = babl_ticks ();
+    babl_parallel_distribute (job.n_blocks, lut_block_job, &job);
+
+    for (int i = 0; i < 8; i++)
+      if (needed[i])
+        __atomic_fetch_or (&BABL(babl)->fish_path.u8_lut_filled[i],
+                           needed[i], __ATOMIC_RELEASE);
+    LUT_INFO("computed %i LUT blocks for %s to %s in %.1fms\n",
+             job.n_blocks,
+             babl_get_name (babl->conversion.source),
+             babl_get_name (babl->conversion.destination),
+             (babl_ticks () - start) / 1000.0);
+  }
+
+  if (pending)
+  {
+    /* blocks claimed by other threads, check whether they are done */
+    for (int i = 0; i < 8; i++)
+    {
+      uint32_t filled = __atomic_load_n (&babl->fish_path.u8_lut_filled[i],
+                                         __ATOMIC_ACQUIRE);
+      if ((pending_blocks[i] & filled) != pending_blocks[i])
+        return 0;
+    }
+  }
+  return 1;
+}
+
+long
+_babl_fish_lut_size (const Babl *babl)
+{
+  int source_bpp = babl->fish_path.source_bpp;
+  int dest_bpp = babl->fish_path.dest_bpp;
+
+  if (lut_is_sparse (source_bpp, dest_bpp))
+    return 256 * 256 * 256 * (dest_bpp == 3 ? 4 : dest_bpp);
+  else if (source_bpp == 2)
+    return 256 * 256 * (dest_bpp == 16 ? 16 : 4);
+  else if (source_bpp == 1)
+    return 256 * 4;
+  return 0;
+}
+
+int
+_babl_fish_lut_is_sparse (const Babl *babl)
+{
+  return lut_is_sparse (babl->fish_path.source_bpp, babl->fish_path.dest_bpp);
+}
+
+void
+_babl_fish_lut_free (Babl *babl)
+{
+  void *lut = __atomic_exchange_n (&babl->fish_path.u8_lut, NULL,
+                                   __ATOMIC_ACQ_REL);
+  if (!lut)
+    return;
+#ifndef _WIN32
+  if (babl->fish_path.u8_lut_mapped)
+    munmap (lut, _babl_fish_lut_size (babl));
+  else
+#endif
+    free (lut);
+  babl->fish_path.u8_lut_mapped = 0;
+}
+
+static uint32_t *
+babl_fish_lut_build (const Babl *babl)
+{
+  int source_bpp = babl->fish_path.source_bpp;
+  int dest_bpp = babl->fish_path.dest_bpp;
+  int chunk_size = fish_path_chunk_size ((Babl*)babl);
+  int scratch = babl->fish_path.scratch_bpp;
+  uint32_t *lut = NULL;
+
+  if (lut_is_sparse (source_bpp, dest_bpp))
+  {
+    /* the table is allocated zeroed and filled in blocks as they get used,
+     * untouched pages of large zeroed allocations are not backed by
+     * memory until written to.
+     */
+    lut = calloc (_babl_fish_lut_size (babl), 1);
+    memset (BABL(babl)->fish_path.u8_lut_claimed, 0,
+            sizeof (babl->fish_path.u8_lut_claimed));
+    memset (BABL(babl)->fish_path.u8_lut_filled, 0,
+            sizeof (babl->fish_path.u8_lut_filled));
+  }
+  else if (source_bpp == 2 && dest_bpp == 2)
+  {
+    uint16_t *temp_lut = malloc (256 * 256 * 2);
+    lut = malloc (256 * 256 * 4);
+    for (int o = 0; o < 256*256; o++)
+    {
+      temp_lut[o]=o;
+    }
+    process_conversion_path (babl->fish_path.conversion_list,
+                             temp_lut, 2,
+                             lut, 2,
+                             256*256, chunk_size, scratch);
+    free (temp_lut);
+  }
+  else if (source_bpp == 2 && dest_bpp == 4)
+  {
+    uint16_t *temp_lut = malloc (256 * 256 * 2);
+    lut = malloc (256 * 256 * 4);
+    for (int o = 0; o < 256*256; o++)
+    {
+      temp_lut[o]=o;
+    }
+    process_conversion_path (babl->fish_path.conversion_list,
+                             temp_lut, 2,
+                             lut, 4,
+                             256*256, chunk_size, scratch);
+    free (temp_lut);
+  }
+  else if (source_bpp == 2 && dest_bpp == 16)
+  {
+    uint16_t *temp_lut = malloc (256 * 256 * 2);
+    lut = malloc (256 * 256 * 16);
+    for (int o = 0; o < 256*256; o++)
+    {
+      temp_lut[o]=o;
+    }
+    process_conversion_path (babl->fish_path.conversion_list,
+                             temp_lut, 2,
+                             lut, 16,
+                             256*256, chunk_size, scratch);
+    free (temp_lut);
+  }
+  else if (source_bpp == 1 && dest_bpp == 4)
+  {
+    uint8_t *temp_lut = malloc (256);
+    lut = malloc (256 * 4);
+    for (int o = 0; o < 256; o++)
+    {
+      temp_lut[o]=o;
+    }
+    process_conversion_path (babl->fish_path.conversion_list,
+                             temp_lut, 1,
+                             lut, 4,
+                             256, chunk_size, scratch);
+    free (temp_lut);
+  }
+
+  return lut;
+}
 
 static inline int babl_fish_lut_process_maybe (const Babl *babl,
                                                const char *source,
@@ -367,167 +549,27 @@ static inline int babl_fish_lut_process_maybe (const Babl *babl,
 {
      int source_bpp = babl->fish_path.source_bpp;
      int dest_bpp = babl->fish_path.dest_bpp;
-     uint32_t *lut = (uint32_t*)babl->fish_path.u8_lut;
- 
+     uint32_t *lut = __atomic_load_n (&babl->fish_path.u8_lut, __ATOMIC_ACQUIRE);
 
      if (BABL_UNLIKELY(!lut && babl->fish.pixels >= 128 * 256))
      {
+       int building = 0;
+
+       /* only one thread builds the LUT, others keep using the conversion
+        * path until it has been published.
+        */
+       if (!__atomic_compare_exchange_n (&BABL(babl)->fish_path.u8_lut_building,
+                                         &building, 1, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+         return 0;
+
        LUT_LOG("generating LUT for %s to %s\n",
                babl_get_name (babl->conversion.source),
                babl_get_name (babl->conversion.destination));
-       if (source_bpp ==4 && dest_bpp == 4)
-       {
-         lut = malloc (256 * 256 * 256 * 4);
-         for (int o = 0; o < 256 * 256 * 256; o++)
-           lut[o] = o | 0xff000000;
-         process_conversion_path (babl->fish_path.conversion_list,
-                                  lut, 4,
-                                  lut, 4,
-                                  256*256*256);
-         for (int o = 0; o < 256 * 256 * 256; o++)
-           lut[o] = lut[o] & 0x00ffffff;
-
-       }
-       else if (source_bpp == 4 && dest_bpp == 16)
-       {
-         uint32_t *temp_lut = malloc (256 * 256 * 256 * 4);
-         lut = malloc (256 * 256 * 256 * 16);
-         for (int o = 0; o < 256 * 256 * 256; o++)
-           temp_lut[o] = o | 0xff000000;
-         process_conversion_path (babl->fish_path.conversion_list,
-                                  temp_lut, 4,
-                                  lut, 16,
-                                  256*256*256);
-         free (temp_lut);
-       }
-       else if (source_bpp == 4 && dest_bpp == 8)
-       {
-         uint32_t *temp_lut = malloc (256 * 256 * 256 * 4);
-         lut = malloc (256 * 256 * 256 * 8);
-         for (int o = 0; o < 256 * 256 * 256; o++)
-           temp_lut[o] = o | 0xff000000;
-         process_conversion_path (babl->fish_path.conversion_list,
-                                  temp_lut, 4,
-                                  lut, 8,
-                                  256*256*256);
-         free (temp_lut);
-       }
-       else if (source_bpp == 3 && dest_bpp == 3)
-       {
-         uint8_t *temp_lut = malloc (256 * 256 * 256 * 3);
-         uint8_t *temp_lut2 = malloc (256 * 256 * 256 * 3);
-         int o = 0;
-         lut = malloc (256 * 256 * 256 * 4);
-         for (int r = 0; r < 256; r++)
-         for (int g = 0; g < 256; g++)
-         for (int b = 0; b < 256; b++, o++)
-         {
-           temp_lut[o*3+0]=r;
-           temp_lut[o*3+1]=g;
-           temp_lut[o*3+2]=b;
-         }
-         process_conversion_path (babl->fish_path.conversion_list,
-                                  temp_lut, 3,
-                                  temp_lut2, 3,
-                                  256*256*256);
-         babl_process (babl_fish (babl_format ("R'G'B' u8"), babl_format ("R'G'B'A u8")),
-                       temp_lut2, lut, 256*256*256);
-         for (int o = 0; o < 256 * 256 * 256; o++)
-           lut[o] = lut[o] & 0x00ffffff;
-         free (temp_lut);
-         free (temp_lut2);
-       }
-       else if (source_bpp == 3 && dest_bpp == 4)
-       {
-         uint8_t *temp_lut = malloc (256 * 256 * 256 * 3);
-         int o = 0;
-         lut = malloc (256 * 256 * 256 * 4);
-         for (int r = 0; r < 256; r++)
-         for (int g = 0; g < 256; g++)
-         for (int b = 0; b < 256; b++, o++)
-         {
-           temp_lut[o*3+0]=r;
-           temp_lut[o*3+1]=g;
-           temp_lut[o*3+2]=b;
-         }
-         process_conversion_path (babl->fish_path.conversion_list,
-                                  temp_lut, 3,
-                                  lut, 4,
-                                  256*256*256);
-         free (temp_lut);
-       }
-       else if (source_bpp == 2 && dest_bpp == 2)
-       {
-         uint16_t *temp_lut = malloc (256 * 256 * 2);
-         lut = malloc (256 * 256 * 4);
-         for (int o = 0; o < 256*256; o++)
-         {
-           temp_lut[o]=o;
-         }
-         process_conversion_path (babl->fish_path.conversion_list,
-                                  temp_lut, 2,
-                                  lut, 2,
-                                  256*256);
-         free (temp_lut);
-       }
-       else if (source_bpp == 2 && dest_bpp == 4)
-       {
-         uint16_t *temp_lut = malloc (256 * 256 * 2);
-         lut = malloc (256 * 256 * 4);
-         for (int o = 0; o < 256*256; o++)
-         {
-           temp_lut[o]=o;
-         }
-         process_conversion_path (babl->fish_path.conversion_list,
-                                  temp_lut, 2,
-                                  lut, 4,
-                                  256*256);
-         free (temp_lut);
-       }
-       else if (source_bpp == 2 && dest_bpp == 16)
-       {
-         uint16_t *temp_lut = malloc (256 * 256 * 2);
-         lut = malloc (256 * 256 * 16);
-         for (int o = 0; o < 256*256; o++)
-         {
-           temp_lut[o]=o;
-         }
-         process_conversion_path (babl->fish_path.conversion_list,
-                                  temp_lut, 2,
-                                  lut, 16,
-                                  256*256);
-         free (temp_lut);
-       }
-       else if (source_bpp == 1 && dest_bpp == 4)
-       {
-         uint8_t *temp_lut = malloc (256);
-         lut = malloc (256 * 4);
-         for (int o = 0; o < 256; o++)
-         {
-           temp_lut[o]=o;
-         }
-         process_conversion_path (babl->fish_path.conversion_list,
-                                  temp_lut, 1,
-                                  lut, 4,
-                                  256);
-         free (temp_lut);
-       }
+       lut = babl_fish_lut_build (babl);
 
-       if (babl->fish_path.u8_lut == NULL)
-       {
-         (BABL(babl)->fish_path.u8_lut) = lut;
-         // XXX need memory barrier?
-         if ((BABL(babl)->fish_path.u8_lut) != lut)
-         {
-           free (lut);
-           lut = babl->fish_path.u8_lut;
-         }
-       }
-       else
-       {
-         free (lut);
-         lut = babl->fish_path.u8_lut;
-       }
+       __atomic_store_n (&BABL(babl)->fish_path.u8_lut, lut, __ATOMIC_RELEASE);
+       __atomic_store_n (&BABL(babl)->fish_path.u8_lut_building, 0, __ATOMIC_RELEASE);
      }
 
      if (lut)
@@ -537,7 +579,11 @@ static inline int babl_fish_lut_process_maybe (const Babl *babl,
            BABL_MODEL_FLAG_ASSOCIATED)!=0))
          source_bpp = BPP_4ASSOCIATED;
 
-       if (_do_lut (lut, source_bpp, dest_bpp, source, destination, n))
+       if (lut_is_sparse (babl->fish_path.source_bpp, dest_bpp) &&
+           !lut_ensure_blocks (babl, lut, source_bpp, source, n))
+         return 0;
+
+       if (_babl_do_lut (lut, source_bpp, dest_bpp, source, destination, n))
        {
          BABL(babl)->fish_path.last_lut_use = babl_ticks ();
          return 1;
@@ -548,7 +594,196 @@ static inline int babl_fish_lut_process_maybe (const Babl *babl,
 
 
 
-#define MAX_BUFFER_SIZE            512
+/* Multi-step paths are processed in chunks, with the intermediate results
+ * in two scratch buffers sized by the widest intermediate format. The chunk
+ * length is chosen per path so that the scratch buffers and the chunk of
+ * source and destination data fit in half of the L1 data cache - or of L2,
+ * for paths with intermediates so wide that L1 sized chunks would be very
+ * short. Chunks are a multiple of CHUNK_ALIGN pixels, keeping the
+ * alignment of the source and destination data of each chunk.
+ *
+ * BABL_CHUNK_SIZE overrides the chunk length for all paths. With
+ * BABL_CHUNK_BENCHMARK=1 a range of chunk lengths is timed for each path
+ * the first time it is used and the best one reported on stderr, with
+ * BABL_CHUNK_BENCHMARK=2 the best measured chunk length is used as well.
+ */
+#define CHUNK_ALIGN        64
+#define MIN_CHUNK_SIZE     128
+#define MAX_CHUNK_SIZE     8192
+#define MAX_SCRATCH_SIZE   (20 * 1024) /* per buffer, both are on the stack
+                                          of possibly small thread stacks */
+#define SCRATCH_SLACK      64          /* for SIMD conversions writing whole
+                                          vectors past the last pixel */
+
+static int l1_cache_size       = 0;
+static int l2_cache_size       = 0;
+static int chunk_size_override = 0;
+static int chunk_benchmark     = 0;
+
+static void
+chunk_init (void)
+{
+  long l1 = 0;
+  long l2 = 0;
+
+  if (l1_cache_size)
+    return;
+
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+  l1 = sysconf (_SC_LEVEL1_DCACHE_SIZE);
+  l2 = sysconf (_SC_LEVEL2_CACHE_SIZE);
+#endif
+  if (l1 <= 0)
+    l1 = 32 * 1024;
+  if (l2 < l1)
+    l2 = 256 * 1024;
+
+  if (getenv ("BABL_CHUNK_SIZE"))
+    chunk_size_override = atoi (getenv ("BABL_CHUNK_SIZE"));
+  if (getenv ("BABL_CHUNK_BENCHMARK"))
+    chunk_benchmark = atoi (getenv ("BABL_CHUNK_BENCHMARK"));
+
+  l2_cache_size = l2;
+  l1_cache_size = l1;
+}
+
+static int
+path_scratch_bpp (BablList *path)
+{
+  int bpp = 0;
+
+  for (int i = 0; i < babl_list_size (path) - 1; i++)
+    {
+      const Babl *format = BABL (path->items[i])->conversion.destination;
+
+      if (format->class_type != BABL_FORMAT)
+        return sizeof (double) * 5;
+      if (format->format.bytes_per_pixel > bpp)
+        bpp = format->format.bytes_per_pixel;
+    }
+  return bpp;
+}
+
+static int
+path_chunk_size (int scratch_bpp,
+                 int source_bpp,
+                 int dest_bpp)
+{
+  int per_pixel = scratch_bpp * 2 + source_bpp + dest_bpp;
+  int chunk;
+
+  chunk_init ();
+
+  if (chunk_size_override > 0)
+    {
+      chunk = chunk_size_override;
+    }
+  else
+    {
+      chunk = l1_cache_size / 2 / per_pixel;
+      if (chunk < MIN_CHUNK_SIZE)
+        chunk = l2_cache_size / 2 / per_pixel;
+    }
+
+  if (scratch_bpp && chunk > MAX_SCRATCH_SIZE / scratch_bpp)
+    chunk = MAX_SCRATCH_SIZE / scratch_bpp;
+  if (chunk > MAX_CHUNK_SIZE)
+    chunk = MAX_CHUNK_SIZE;
+  chunk = chunk / CHUNK_ALIGN * CHUNK_ALIGN;
+  if (chunk < CHUNK_ALIGN)
+    chunk = CHUNK_ALIGN;
+  return chunk;
+}
+
+static int
+chunk_benchmark_path (Babl *babl,
+                      int   estimate)
+{
+  const Babl *source      = babl->fish.source;
+  int         source_bpp  = babl->fish_path.source_bpp;
+  int         dest_bpp    = babl->fish_path.dest_bpp;
+  int         scratch_bpp = babl->fish_path.scratch_bpp;
+  int         n_test      = babl_get_num_path_test_pixels ();
+  long        n           = 64 * 1024;
+  char       *src;
+  char       *dst;
+  int         best        = estimate;
+  long        best_ticks  = 0;
+  long        estimate_ticks = 0;
+
+  if (source->class_type != BABL_FORMAT || n_test <= 0)
+    return estimate;
+
+  src = babl_malloc (n * source_bpp);
+  dst = babl_malloc (n * dest_bpp);
+
+  /* tile the path test pixels over the benchmark buffer */
+  babl_process (babl_fish (babl_format ("RGBA double"), source),
+                babl_get_path_test_pixels (), src, n_test);
+  for (long i = n_test; i < n; i += n_test)
+    memcpy (src + i * source_bpp, src,
+            MIN (n_test, n - i) * source_bpp);
+
+  for (int chunk = CHUNK_ALIGN; chunk <= MAX_CHUNK_SIZE * 2; chunk *= 2)
+    {
+      int  c = chunk > MAX_CHUNK_SIZE ? estimate : chunk;
+      long ticks = 0;
+
+      if (scratch_bpp && c > MAX_SCRATCH_SIZE / scratch_bpp)
+        continue;
+
+      for (int iter = 0; iter < 3; iter++)
+        {
+          long start = babl_ticks ();
+          process_conversion_path (babl->fish_path.conversion_list,
+                                   src, source_bpp, dst, dest_bpp, n,
+                                   c, scratch_bpp);
+          start = babl_ticks () - start;
+          if (iter == 0 || start < ticks)
+            ticks = start;
+        }
+
+      if (c == estimate)
+        estimate_ticks = ticks;
+      if (best_ticks == 0 || ticks < best_ticks)
+        {
+          best = c;
+          best_ticks = ticks;
+        }
+    }
+
+  fprintf (stderr, "babl: chunk size for %s to %s (%i steps): "
+           "%i pixels %.2fns/pixel, estimated %i pixels %.2fns/pixel\n",
+           babl_get_name (babl->fish.source),
+           babl_get_name (babl->fish.destination),
+           babl_list_size (babl->fish_path.conversion_list),
+           best, best_ticks * 1000.0 / n,
+           estimate, estimate_ticks * 1000.0 / n);
+
+  babl_free (src);
+  babl_free (dst);
+  return chunk_benchmark > 1 ? best : estimate;
+}
+
+static int
+fish_path_chunk_size (Babl *babl)
+{
+  int chunk = __atomic_load_n (&babl->fish_path.chunk_size, __ATOMIC_ACQUIRE);
+
+  if (BABL_UNLIKELY (chunk == 0))
+    {
+      BablList *path = babl->fish_path.conversion_list;
+
+      babl->fish_path.scratch_bpp = path_scratch_bpp (path);
+      chunk = path_chunk_size (babl->fish_path.scratch_bpp,
+                               babl->fish_path.source_bpp,
+                               babl->fish_path.dest_bpp);
+      if (chunk_benchmark && babl_list_size (path) > 1)
+        chunk = chunk_benchmark_path (babl, chunk);
+      __atomic_store_n (&babl->fish_path.chunk_size, chunk, __ATOMIC_RELEASE);
+    }
+  return chunk;
+}
 
 int   babl_in_fish_path = 0;
 
@@ -566,12 +801,15 @@ typedef struct _FishPathInstrumentation
   const Babl   *fish_destination_to_rgba;
   double  reference_cost;
   int     init_instrumentation_done;
+  Babl   *fmt_source;
+  Babl   *fmt_destination;
 } FishPathInstrumentation;
 
 typedef struct PathContext {
   Babl     *fish_path;
   Babl     *to_format;
   BablList *current_path;
+  FishPathInstrumentation *fpi; /* shared by all candidate paths */
 } PathContext;
 
 static void
@@ -596,7 +834,9 @@ process_conversion_path (BablList   *path,
                          int         source_bpp,
                          void       *destination_buffer,
                          int         dest_bpp,
-                         long        n);
+                         long        n,
+                         int         chunk_size,
+                         int         scratch_bpp);
 
 static void
 get_conversion_path (PathContext *pc,
@@ -759,13 +999,7 @@ get_conversion_path (PathContext *pc,
                    discarding of bad fast paths  */
 #endif
         {
-          FishPathInstrumentation fpi;
-          memset (&fpi, 0, sizeof (fpi));
-
-          fpi.source = (Babl*) babl_list_get_first (pc->current_path)->conversion.source;
-          fpi.destination = pc->to_format;
-
-          get_path_instrumentation (&fpi, pc->current_path, &path_cost, &ref_cost, &path_error);
+          get_path_instrumentation (pc->fpi, pc->current_path, &path_cost, &ref_cost, &path_error);
           if(debug_conversions && current_length == 1)
             fprintf (stderr, "%s  error:%f cost:%f  \n",
                  babl_get_name (pc->current_path->items[0]), path_error, path_cost);
@@ -782,8 +1016,6 @@ get_conversion_path (PathContext *pc,
               babl_list_copy (pc->current_path,
                               pc->fish_path->fish_path.conversion_list);
             }
-
-          destroy_path_instrumentation (&fpi);
         }
     }
   else
@@ -839,9 +1071,7 @@ int
 _babl_fish_path_destroy (void *data)
 {
   Babl *babl=data;
-  if (babl->fish_path.u8_lut)
-    free (babl->fish_path.u8_lut);
-  babl->fish_path.u8_lut = NULL;
+  _babl_fish_lut_free (babl);
   if (babl->fish_path.conversion_list)
     babl_free (babl->fish_path.conversion_list);
   babl->fish_path.conversion_list = NULL;
@@ -1011,9 +1241,17 @@ _babl_fish_prepare_bpp (Babl *babl)
           BABL_MODEL_FLAG_ASSOCIATED)==0);
   int dest_not_associated = ((babl->conversion.destination->format.model->flags &
           BABL_MODEL_FLAG_ASSOCIATED)==0);
+  /* the LUTs index on the first 24 bits of 4 byte pixels and carry the
+   * last byte over as alpha, which 4 byte CMYK pixels use for K instead
+   */
+  int alpha_carried = source_bpp != 4 ||
+                      (babl_format_has_alpha (babl_source) &&
+                       babl_format_has_alpha (babl_dest));
   if (
       (babl->conversion.source->format.type[0]->bits < 32)       
 
+      && alpha_carried
+
       && (  (   source_bpp == 2
              && dest_bpp   == 16)
 
@@ -1114,6 +1352,393 @@ _babl_fish_missing_fast_path_warning (const Babl *source,
 }
 
 
+/* Fish paths are also kept in an open addressing table keyed by their
+ * source and destination formats, which is read without locking - a hit
+ * needs neither babl_format_mutex nor the fish name. Entries are only ever
+ * added, with babl_format_mutex held, and a slot is published by storing
+ * its fish after its keys. When half full the table is replaced by a copy
+ * twice the size; readers still probing an older copy can at worst miss
+ * recent entries and fall back to the locked lookup by name, older copies
+ * are only freed by babl_exit.
+ */
+#define FISH_PATH_TABLE_MIN_SIZE 1024
+
+typedef struct FishPathSlot
+{
+  const Babl *source;
+  const Babl *destination;
+  Babl       *fish;
+} FishPathSlot;
+
+typedef struct FishPathTable
+{
+  struct FishPathTable *old;
+  unsigned int          mask;
+  unsigned int          count;
+  FishPathSlot          slots[];
+} FishPathTable;
+
+static FishPathTable *fish_path_table = NULL;
+
+static inline unsigned int
+fish_path_hash (const Babl *source,
+                const Babl *destination)
+{
+  uint64_t hash = ((uintptr_t) source >> 4) * 0x9e3779b97f4a7c15ull;
+
+  hash ^= ((uintptr_t) destination >> 4) * 0xc2b2ae3d27d4eb4full;
+  return hash ^ (hash >> 29);
+}
+
+static Babl *
+fish_path_table_lookup (const Babl *source,
+                        const Babl *destination)
+{
+  FishPathTable *table = __atomic_load_n (&fish_path_table, __ATOMIC_ACQUIRE);
+
+  if (!table)
+    return NULL;
+
+  for (unsigned int i = fish_path_hash (source, destination) & table->mask;;
+       i = (i + 1) & table->mask)
+    {
+      FishPathSlot *slot = &table->slots[i];
+      Babl         *fish = __atomic_load_n (&slot->fish, __ATOMIC_ACQUIRE);
+
+      if (!fish)
+        return NULL;
+      if (slot->source == source && slot->destination == destination)
+        return fish;
+    }
+}
+
+static void
+fish_path_table_add (FishPathTable *table,
+                     const Babl    *source,
+                     const Babl    *destination,
+                     Babl          *fish)
+{
+  unsigned int i = fish_path_hash (source, destination) & table->mask;
+
+  while (table->slots[i].fish)
+    i = (i + 1) & table->mask;
+
+  table->slots[i].source      = source;
+  table->slots[i].destination = destination;
+  __atomic_store_n (&table->slots[i].fish, fish, __ATOMIC_RELEASE);
+  table->count++;
+}
+
+/* called with babl_format_mutex held */
+static void
+fish_path_table_insert (Babl *fish)
+{
+  FishPathTable *table = fish_path_table;
+
+  if (!table || (table->count + 1) * 2 > table->mask + 1)
+    {
+      unsigned int   size = table ? (table->mask + 1) * 2 :
+                                    FISH_PATH_TABLE_MIN_SIZE;
+      FishPathTable *new_table;
+
+      new_table = babl_calloc (1, sizeof (FishPathTable) +
+                                  size * sizeof (FishPathSlot));
+      new_table->mask = size - 1;
+      new_table->old  = table;
+      if (table)
+        for (unsigned int i = 0; i <= table->mask; i++)
+          if (table->slots[i].fish)
+            fish_path_table_add (new_table,
+                                 table->slots[i].source,
+                                 table->slots[i].destination,
+                                 table->slots[i].fish);
+
+      __atomic_store_n (&fish_path_table, new_table, __ATOMIC_RELEASE);
+      table = new_table;
+    }
+
+  fish_path_table_add (table, fish->fish.source, fish->fish.destination,
+                       fish);
+}
+
+Babl *
+_babl_fish_path_lookup (const Babl *source,
+                        const Babl *destination)
+{
+  return fish_path_table_lookup (source, destination);
+}
+
+static void path_memo_destroy (void);
+
+void
+_babl_fish_path_table_destroy (void)
+{
+  FishPathTable *table = fish_path_table;
+
+  fish_path_table = NULL;
+  while (table)
+    {
+      FishPathTable *old = table->old;
+      babl_free (table);
+      table = old;
+    }
+  path_memo_destroy ();
+}
+
+/* Found conversion paths are memoized independent of the spaces of the
+ * formats involved; a path is recorded as the encodings of the formats
+ * along it, with each format's space noted as being the space of the
+ * source, the space of the destination, or a specific other space. When a
+ * fish path is needed between the same encodings in other spaces with the
+ * same shape - kind of space and TRCs - the memoized path is mapped to the
+ * new spaces and validated with a single instrumentation run instead of
+ * instrumenting every candidate path of a full search.
+ */
+#define PATH_MEMO_BUCKETS 256
+
+typedef enum
+{
+  PATH_SPACE_SOURCE,
+  PATH_SPACE_DESTINATION,
+  PATH_SPACE_OTHER
+} PathSpaceRole;
+
+typedef struct PathMemoFormat
+{
+  const char    *encoding;
+  PathSpaceRole  role;
+  const Babl    *space; /* for PATH_SPACE_OTHER */
+} PathMemoFormat;
+
+typedef struct PathMemo
+{
+  struct PathMemo *next;
+  const char      *source_encoding;
+  const char      *destination_encoding;
+  int              source_shape;
+  int              destination_shape;
+  int              same_space;
+  double           tolerance;
+  int              length;
+  /* the formats along the path, length + 1 of them */
+  PathMemoFormat   formats[BABL_HARD_MAX_PATH_LENGTH + 1];
+} PathMemo;
+
+static PathMemo *path_memo[PATH_MEMO_BUCKETS];
+
+static int
+path_space_shape (const Babl *space)
+{
+  int shape = space->space.icc_type;
+
+  if (space == babl_space ("sRGB"))
+    shape |= 1 << 3;
+  for (int c = 0; c < 3; c++)
+    if (space->space.trc[c])
+      shape |= (space->space.trc[c]->trc.type + 1) << (4 + c * 4);
+  if (space->space.trc[0] == space->space.trc[1] &&
+      space->space.trc[1] == space->space.trc[2])
+    shape |= 1 << 16;
+  return shape;
+}
+
+static PathMemo **
+path_memo_find (const Babl *source,
+                const Babl *destination,
+                double      tolerance,
+                PathMemo   *key)
+{
+  const Babl *source_space      = source->format.space;
+  const Babl *destination_space = destination->format.space;
+  PathMemo  **memo;
+  unsigned int hash;
+
+  key->source_encoding      = babl_format_get_encoding (source);
+  key->destination_encoding = babl_format_get_encoding (destination);
+  key->source_shape         = path_space_shape (source_space);
+  key->destination_shape    = path_space_shape (destination_space);
+  key->same_space           = source_space == destination_space;
+  key->tolerance            = tolerance;
+
+  hash = fish_path_hash ((void*) key->source_encoding,
+                         (void*) key->destination_encoding);
+  hash ^= key->source_shape * 31 + key->destination_shape;
+
+  for (memo = &path_memo[hash % PATH_MEMO_BUCKETS]; *memo;
+       memo = &(*memo)->next)
+    {
+      if ((*memo)->source_encoding      == key->source_encoding &&
+          (*memo)->destination_encoding == key->destination_encoding &&
+          (*memo)->source_shape         == key->source_shape &&
+          (*memo)->destination_shape    == key->destination_shape &&
+          (*memo)->same_space           == key->same_space &&
+          (*memo)->tolerance            == key->tolerance)
+        break;
+    }
+  return memo;
+}
+
+/* called with babl_format_mutex held, after a full search, replaces the
+ * memoized path - which did not hold up if there was one - with the path
+ * found, or drops it when none was found.
+ */
+static void
+path_memo_store (const Babl *source,
+                 const Babl *destination,
+                 double      tolerance,
+                 BablList   *path)
+{
+  PathMemo    key;
+  PathMemo  **memo = path_memo_find (source, destination, tolerance, &key);
+  int         length = babl_list_size (path);
+
+  if (length == 0 || length > BABL_HARD_MAX_PATH_LENGTH)
+    {
+      if (*memo)
+        {
+          PathMemo *stale = *memo;
+          *memo = stale->next;
+          babl_free (stale);
+        }
+      return;
+    }
+
+  if (*memo)
+    key.next = (*memo)->next;
+  else
+    {
+      *memo = babl_calloc (1, sizeof (PathMemo));
+      key.next = NULL;
+    }
+  **memo = key;
+  (*memo)->length = length;
+
+  for (int i = 0; i <= length; i++)
+    {
+      const Babl     *format = i < length ?
+                         path->items[i]->conversion.source :
+                         path->items[length - 1]->conversion.destination;
+      PathMemoFormat *entry  = &(*memo)->formats[i];
+
+      entry->encoding = babl_format_get_encoding (format);
+      entry->space    = format->format.space;
+      if (format->format.space == source->format.space)
+        entry->role = PATH_SPACE_SOURCE;
+      else if (format->format.space == destination->format.space)
+        entry->role = PATH_SPACE_DESTINATION;
+      else
+        entry->role = PATH_SPACE_OTHER;
+    }
+}
+
+static void
+path_memo_destroy (void)
+{
+  for (int i = 0; i < PATH_MEMO_BUCKETS; i++)
+    while (path_memo[i])
+      {
+        PathMemo *next = path_memo[i]->next;
+        babl_free (path_memo[i]);
+        path_memo[i] = next;
+      }
+}
+
+static Babl *
+path_memo_format (const PathMemoFormat *entry,
+                  const Babl           *source,
+                  const Babl           *destination)
+{
+  switch (entry->role)
+    {
+      case PATH_SPACE_SOURCE:
+        return (Babl*) babl_format_with_space (entry->encoding,
+                                               source->format.space);
+      case PATH_SPACE_DESTINATION:
+        return (Babl*) babl_format_with_space (entry->encoding,
+                                               destination->format.space);
+      default:
+        return (Babl*) babl_format_with_space (entry->encoding, entry->space);
+    }
+}
+
+static void
+path_clear (BablList *path)
+{
+  while (babl_list_size (path))
+    babl_list_remove_last (path);
+}
+
+/* called with babl_format_mutex held, sets up the conversion list of the
+ * fish in the path context from a memoized path, returns 0 when there is
+ * none or it does not hold up for these formats.
+ */
+static int
+path_memo_apply (PathContext *pc,
+                 const Babl  *source,
+                 const Babl  *destination,
+                 double       tolerance)
+{
+  PathMemo  key;
+  PathMemo *memo = *path_memo_find (source, destination, tolerance, &key);
+  Babl     *format;
+  double    path_cost  = 0.0;
+  double    ref_cost   = 0.0;
+  double    path_error = 1.0;
+
+  if (!memo)
+    return 0;
+
+  format = path_memo_format (&memo->formats[0], source, destination);
+  if (format != source)
+    return 0;
+
+  for (int i = 0; i < memo->length; i++)
+    {
+      Babl     *next = path_memo_format (&memo->formats[i + 1],
+                                         source, destination);
+      BablList *list = format->format.from_list;
+      Babl     *conversion = NULL;
+
+      for (int j = 0; list && j < babl_list_size (list); j++)
+        if (list->items[j]->conversion.destination == next)
+          {
+            conversion = list->items[j];
+            break;
+          }
+      if (!conversion)
+        {
+          path_clear (pc->current_path);
+          return 0;
+        }
+
+      babl_list_insert_last (pc->current_path, conversion);
+      path_error *= (1.0 + babl_conversion_error ((void*) conversion));
+      format = next;
+    }
+
+  if (format == destination && path_error - 1.0 <= tolerance)
+    {
+      get_path_instrumentation (pc->fpi, pc->current_path,
+                                &path_cost, &ref_cost, &path_error);
+      if (debug_conversions)
+        fprintf (stderr, "babl: memoized %i step path for %s to %s  "
+                 "error:%f cost:%f\n", memo->length,
+                 babl_get_name (source), babl_get_name (destination),
+                 path_error, path_cost);
+
+      if (path_cost < ref_cost && path_error <= tolerance)
+        {
+          pc->fish_path->fish_path.cost = path_cost;
+          pc->fish_path->fish.error     = path_error;
+          babl_list_copy (pc->current_path,
+                          pc->fish_path->fish_path.conversion_list);
+        }
+    }
+
+  path_clear (pc->current_path);
+  return babl_list_size (pc->fish_path->fish_path.conversion_list) > 0;
+}
+
 static Babl *
 babl_fish_path2 (const Babl *source,
                  const Babl *destination,
@@ -1133,10 +1758,6 @@ babl_fish_path2 (const Babl *source,
        debug_missing = 0;
   }
 
-  _babl_fish_create_name (name, source, destination, 1);
-  babl_mutex_lock (babl_format_mutex);
-  babl = babl_db_exist_by_name (babl_fish_db (), name);
-
   if (tolerance <= 0.0)
   {
     is_fast = 0;
@@ -1145,13 +1766,28 @@ babl_fish_path2 (const Babl *source,
   else
     is_fast = 1;
 
+  if (!is_fast)
+  {
+    babl = fish_path_table_lookup (source, destination);
+    if (babl)
+      return babl;
+  }
+
+  _babl_fish_create_name (name, source, destination, 1);
+  babl_mutex_lock (babl_format_mutex);
+  babl = babl_db_exist_by_name (babl_fish_db (), name);
+
   if (!is_fast)
   {
   if (babl)
     {
       /* There is an instance already registered by the required name,
-       * returning the preexistent one instead.
+       * returning the preexistent one instead - loaded from the cache, or
+       * made by another thread since the lookup above.
        */
+      if (babl->class_type == BABL_FISH_PATH &&
+          !fish_path_table_lookup (source, destination))
+        fish_path_table_insert (babl);
       babl_mutex_unlock (babl_format_mutex);
       return babl;
     }
@@ -1178,7 +1814,10 @@ babl_fish_path2 (const Babl *source,
       run_once[i++] = source->format.space;
       babl_conversion_class_for_each (alias_conversion, (void*)source->format.space);
 
-      _babl_space_add_universal_rgb (source->format.space);
+      if (babl_space_is_cmyk (source->format.space))
+        _babl_space_add_cmyk (source->format.space);
+      else
+        _babl_space_add_universal_rgb (source->format.space);
     }
 
     /* destination space not in initialization array */
@@ -1187,7 +1826,10 @@ babl_fish_path2 (const Babl *source,
       run_once[i++] = destination->format.space;
       babl_conversion_class_for_each (alias_conversion, (void*)destination->format.space);
 
-      _babl_space_add_universal_rgb (destination->format.space);
+      if (babl_space_is_cmyk (destination->format.space))
+        _babl_space_add_cmyk (destination->format.space);
+      else
+        _babl_space_add_universal_rgb (destination->format.space);
     }
 
     if (!done && 0)
@@ -1215,13 +1857,19 @@ babl_fish_path2 (const Babl *source,
 
   {
     PathContext pc;
+    FishPathInstrumentation fpi;
     int start_depth = max_path_length ();
     int end_depth = start_depth + 1 + ((destination->format.space != sRGB)?1:0);
     end_depth = MIN(end_depth, BABL_HARD_MAX_PATH_LENGTH);
 
+    memset (&fpi, 0, sizeof (fpi));
+    fpi.fmt_source      = (Babl *) source;
+    fpi.fmt_destination = (Babl *) destination;
+
     pc.current_path = babl_list_init_with_size (BABL_HARD_MAX_PATH_LENGTH);
     pc.fish_path = babl;
     pc.to_format = (Babl *) destination;
+    pc.fpi = &fpi;
 
     /* we hold a global lock whilerunning get_conversion_path since
      * it depends on keeping the various format.visited members in
@@ -1230,11 +1878,17 @@ babl_fish_path2 (const Babl *source,
      */
     babl_in_fish_path++;
 
-    for (int max_depth = start_depth;
-         babl->fish_path.conversion_list->count == 0 && max_depth <= end_depth;
-         max_depth++)
+    if (!path_memo_apply (&pc, source, destination, tolerance))
     {
-      get_conversion_path (&pc, (Babl *) source, 0, max_depth, tolerance);
+      for (int max_depth = start_depth;
+           babl->fish_path.conversion_list->count == 0 && max_depth <= end_depth;
+           max_depth++)
+      {
+        get_conversion_path (&pc, (Babl *) source, 0, max_depth, tolerance);
+      }
+
+      path_memo_store (source, destination, tolerance,
+                       babl->fish_path.conversion_list);
     }
 
     if (debug_missing)
@@ -1253,6 +1907,7 @@ babl_fish_path2 (const Babl *source,
 
     babl_in_fish_path--;
     babl_free (pc.current_path);
+    destroy_path_instrumentation (&fpi);
   }
 
   if (babl_list_size (babl->fish_path.conversion_list) == 0)
@@ -1272,6 +1927,7 @@ babl_fish_path2 (const Babl *source,
   if (!is_fast)
   {
     babl_db_insert (babl_fish_db (), babl);
+    fish_path_table_insert (babl);
   }
   babl_mutex_unlock (babl_format_mutex);
   return babl;
@@ -1317,6 +1973,8 @@ babl_fish_path_process (const Babl *babl,
                         long        n,
                         void       *data)
 {
+  int chunk_size;
+
   BABL(babl)->fish.pixels += n;
   if (babl->fish_path.is_u8_color_conv)
   {
@@ -1329,12 +1987,16 @@ babl_fish_path_process (const Babl *babl,
   {
     babl_conv_counter+=n;
   }
+  /* computes scratch_bpp as well on first use */
+  chunk_size = fish_path_chunk_size ((Babl*)babl);
   process_conversion_path (babl->fish_path.conversion_list,
                            source,
                            babl->fish_path.source_bpp,
                            destination,
                            babl->fish_path.dest_bpp,
-                           n);
+                           n,
+                           chunk_size,
+                           babl->fish_path.scratch_bpp);
 }
 
 static void
@@ -1456,6 +2118,341 @@ babl_process_rows (const Babl *fish,
   return n * rows;
 }
 
+/* don't hand out less work than this to a thread, below it the cost of
+ * waking up workers outweighs the gain
+ */
+#define PARALLEL_MIN_PIXELS  (64 * 1024)
+
+typedef struct ProcessRowsJob
+{
+  Babl          *babl;
+  const uint8_t *src;
+  int            source_stride;
+  uint8_t       *dst;
+  int            dest_stride;
+  long           n;
+  int            rows;
+  int            spans;       /* jobs per row when rows are split */
+  int            align;       /* pixel alignment of span starts */
+  int            source_bpp;
+  int            dest_bpp;
+} ProcessRowsJob;
+
+static void
+process_rows_job (int   job,
+                  int   n_jobs,
+                  void *user_data)
+{
+  ProcessRowsJob *data = user_data;
+  Babl           *babl = data->babl;
+
+  if (data->spans > 1)
+    {
+      /* one job for a span of pixels within a single row, spans start at
+       * multiples of the pixels given by row_span_align, keeping the
+       * result identical to converting whole rows
+       */
+      int            row   = job / data->spans;
+      int            span  = job % data->spans;
+      long           start = data->n * span / data->spans /
+                             data->align * data->align;
+      long           end   = span == data->spans - 1 ? data->n :
+                             data->n * (span + 1) / data->spans /
+                             data->align * data->align;
+      const uint8_t *src   = data->src + (long) row * data->source_stride;
+      uint8_t       *dst   = data->dst + (long) row * data->dest_stride;
+
+      if (end > start)
+        babl->fish.dispatch (babl,
+                             (void*)(src + start * data->source_bpp),
+                             (void*)(dst + start * data->dest_bpp),
+                             end - start, *babl->fish.data);
+    }
+  else
+    {
+      /* one job for a band of rows */
+      int            row     = (long) data->rows * job / n_jobs;
+      int            end_row = (long) data->rows * (job + 1) / n_jobs;
+      const uint8_t *src     = data->src + (long) row * data->source_stride;
+      uint8_t       *dst     = data->dst + (long) row * data->dest_stride;
+
+      for (; row < end_row; row++)
+        {
+          babl->fish.dispatch (babl, (void*)src, (void*)dst,
+                               data->n, *babl->fish.data);
+          src += data->source_stride;
+          dst += data->dest_stride;
+        }
+    }
+}
+
+static inline int
+fish_format_bpp (const Babl *format)
+{
+  if (format->class_type != BABL_FORMAT ||
+      format->format.planar)
+    return 0;
+  return format->format.bytes_per_pixel;
+}
+
+/* the pixel multiple spans of rows can start at, such that they convert
+ * exactly like whole rows do, or 0 when rows can not be split. Multi-step
+ * paths convert rows a chunk at a time, so their chunks are converted the
+ * same either way. Other fishes convert a row in a single call, where the
+ * SIMD loops of conversions start at aligned addresses, spans of those
+ * only match when the rows are 64 byte aligned and the spans start at
+ * multiples of 64 pixels.
+ */
+static int
+row_span_align (Babl       *babl,
+                const void *source,
+                int         source_stride,
+                const void *dest,
+                int         dest_stride)
+{
+  if (babl->class_type == BABL_FISH_PATH &&
+      babl->fish.dispatch == babl_fish_path_process &&
+      babl_list_size (babl->fish_path.conversion_list) > 1)
+    return fish_path_chunk_size (babl);
+
+  if (((uintptr_t) source | (uintptr_t) dest |
+       (uintptr_t) source_stride | (uintptr_t) dest_stride) % 64 == 0)
+    return CHUNK_ALIGN;
+
+  return 0;
+}
+
+long
+babl_process_rows_parallel (const Babl *fish,
+                            const void *source,
+                            int         source_stride,
+                            void       *dest,
+                            int         dest_stride,
+                            long        n,
+                            int         rows)
+{
+  Babl           *babl = (Babl*)fish;
+  ProcessRowsJob  data;
+  long            max_jobs;
+  int             n_threads;
+  int             n_jobs;
+
+  babl_assert (babl && BABL_IS_BABL (babl) && source && dest);
+
+  if (n <= 0 || rows <= 0)
+    return 0;
+
+  n_threads = babl_parallel_get_n_threads ();
+  max_jobs  = (n * rows) / PARALLEL_MIN_PIXELS;
+  if (max_jobs > n_threads)
+    max_jobs = n_threads;
+  if (max_jobs <= 1)
+    return babl_process_rows (fish, source, source_stride,
+                              dest, dest_stride, n, rows);
+
+  data.babl          = babl;
+  data.src           = source;
+  data.source_stride = source_stride;
+  data.dst           = dest;
+  data.dest_stride   = dest_stride;
+  data.n             = n;
+  data.rows          = rows;
+  data.spans         = 1;
+  data.align         = 0;
+  data.source_bpp    = fish_format_bpp (babl->fish.source);
+  data.dest_bpp      = fish_format_bpp (babl->fish.destination);
+
+  n_jobs = max_jobs;
+  if (rows < max_jobs)
+    {
+      /* too few rows to keep all threads busy, split the rows themselves
+       * when the pixel data can be addressed by offset and there are
+       * pixels the spans can start at without changing the result
+       */
+      if (data.source_bpp && data.dest_bpp)
+        data.align = row_span_align (babl, source, source_stride,
+                                     dest, dest_stride);
+      else
+        data.align = 0;
+
+      if (data.align)
+        {
+          data.spans = (max_jobs + rows - 1) / rows;
+          n_jobs = rows * data.spans;
+        }
+      else
+        {
+          n_jobs = rows;
+        }
+    }
+
+  babl_parallel_distribute (n_jobs, process_rows_job, &data);
+  return n * rows;
+}
+
+/* pixels gathered from the planes and converted at a time */
+#define PLANES_CHUNK  4096
+
+typedef struct ProcessPlanesJob
+{
+  Babl           *babl;
+  const Babl     *format;
+  const uint8_t **planes;
+  const int      *plane_strides;
+  uint8_t        *dst;
+  int             dest_stride;
+  long            n;
+  int             rows;
+  int             source_bpp;
+  int             dest_bpp;
+} ProcessPlanesJob;
+
+#define GATHER_COMPONENT(ctype)                                  \
+  {                                                              \
+    const ctype *s = (const ctype *) src;                        \
+                                                                 \
+    if (horizontal == 1)                                         \
+      for (long x = 0; x < n; x++)                               \
+        memcpy (d + x * bpp, s + start + x, sizeof (ctype));     \
+    else                                                         \
+      for (long x = 0; x < n; x++)                               \
+        memcpy (d + x * bpp, s + (start + x) / horizontal,       \
+                sizeof (ctype));                                 \
+  }
+
+/* interleaves n pixels of row of a format from its planes, repeating the
+ * samples of subsampled components over the pixels they cover
+ */
+static void
+gather_planes (const Babl     *format,
+               const uint8_t **planes,
+               const int      *plane_strides,
+               int             row,
+               long            start,
+               long            n,
+               uint8_t        *dst,
+               int             bpp)
+{
+  int offset = 0;
+
+  for (int c = 0; c < format->format.components; c++)
+    {
+      const BablSampling *sampling   = format->format.sampling[c];
+      int                 horizontal = sampling->horizontal;
+      int                 size       = format->format.type[c]->bits / 8;
+      const uint8_t      *src        = planes[c] +
+                                       (long) (row / sampling->vertical) *
+                                       plane_strides[c];
+      uint8_t            *d          = dst + offset;
+
+      switch (size)
+        {
+          case 1:
+            GATHER_COMPONENT (uint8_t);
+            break;
+          case 2:
+            GATHER_COMPONENT (uint16_t);
+            break;
+          case 4:
+            GATHER_COMPONENT (uint32_t);
+            break;
+          case 8:
+            GATHER_COMPONENT (uint64_t);
+            break;
+          default:
+            for (long x = 0; x < n; x++)
+              memcpy (d + x * bpp, src + (start + x) / horizontal * size, size);
+            break;
+        }
+      offset += size;
+    }
+}
+
+#undef GATHER_COMPONENT
+
+static void
+process_planes_job (int   job,
+                    int   n_jobs,
+                    void *user_data)
+{
+  ProcessPlanesJob *data    = user_data;
+  Babl             *babl    = data->babl;
+  int               row     = (long) data->rows * job / n_jobs;
+  int               end_row = (long) data->rows * (job + 1) / n_jobs;
+  long              chunk   = MIN (data->n, PLANES_CHUNK);
+  uint8_t          *buffer  = babl_malloc (chunk * data->source_bpp);
+
+  for (; row < end_row; row++)
+    {
+      uint8_t *dst = data->dst + (long) row * data->dest_stride;
+
+      for (long start = 0; start < data->n; start += chunk)
+        {
+          long count = MIN (chunk, data->n - start);
+
+          gather_planes (data->format, data->planes, data->plane_strides,
+                         row, start, count, buffer, data->source_bpp);
+          babl->fish.dispatch (babl, (void*)buffer,
+                               (void*)(dst + start * data->dest_bpp),
+                               count, *babl->fish.data);
+        }
+    }
+
+  babl_free (buffer);
+}
+
+long
+babl_process_planes (const Babl  *fish,
+                     const void **planes,
+                     const int   *plane_strides,
+                     void        *dest,
+                     int          dest_stride,
+                     long         n,
+                     int          rows)
+{
+  Babl             *babl = (Babl*)fish;
+  ProcessPlanesJob  data;
+  long              max_jobs;
+  int               n_threads;
+
+  babl_assert (babl && BABL_IS_BABL (babl) && planes && plane_strides && dest);
+  babl_assert (babl->fish.source->class_type == BABL_FORMAT);
+
+  if (n <= 0 || rows <= 0)
+    return 0;
+
+  data.babl          = babl;
+  data.format        = babl->fish.source;
+  data.planes        = (const uint8_t **) planes;
+  data.plane_strides = plane_strides;
+  data.dst           = dest;
+  data.dest_stride   = dest_stride;
+  data.n             = n;
+  data.rows          = rows;
+  data.source_bpp    = data.format->format.bytes_per_pixel;
+  data.dest_bpp      = fish_format_bpp (babl->fish.destination);
+
+  if (!data.dest_bpp)
+    {
+      babl_log ("the destination of %s is not a packed format",
+                babl_get_name (babl));
+      return 0;
+    }
+
+  n_threads = babl_parallel_get_n_threads ();
+  max_jobs  = (n * rows) / PARALLEL_MIN_PIXELS;
+  if (max_jobs > n_threads)
+    max_jobs = n_threads;
+  if (max_jobs > rows)
+    max_jobs = rows;
+
+  if (max_jobs <= 1)
+    process_planes_job (0, 1, &data);
+  else
+    babl_parallel_distribute (max_jobs, process_planes_job, &data);
+  return n * rows;
+}
+
 #include <stdint.h>
 
 #define BABL_ALIGN 16
@@ -1472,7 +2469,9 @@ process_conversion_path (BablList   *path,
                          int         source_bpp,
                          void       *destination_buffer,
                          int         dest_bpp,
-                         long        n)
+                         long        n,
+                         int         chunk_size,
+                         int         scratch_bpp)
 {
   int conversions = babl_list_size (path);
 
@@ -1487,20 +2486,20 @@ process_conversion_path (BablList   *path,
     {
       long j;
 
-      void *temp_buffer = align_16 (alloca (MIN(n, MAX_BUFFER_SIZE) *
-                                    sizeof (double) * 5 + 16));
+      void *temp_buffer = align_16 (alloca (MIN(n, chunk_size) *
+                                    scratch_bpp + SCRATCH_SLACK + 16));
       void *temp_buffer2 = NULL;
 
       if (conversions > 2)
         {
           /* We'll need one more auxiliary buffer */
-          temp_buffer2 = align_16 (alloca (MIN(n, MAX_BUFFER_SIZE) *
-                                   sizeof (double) * 5 + 16));
+          temp_buffer2 = align_16 (alloca (MIN(n, chunk_size) *
+                                   scratch_bpp + SCRATCH_SLACK + 16));
         }
 
-      for (j = 0; j < n; j+= MAX_BUFFER_SIZE)
+      for (j = 0; j < n; j+= chunk_size)
         {
-          long c = MIN (n - j, MAX_BUFFER_SIZE);
+          long c = MIN (n - j, chunk_size);
           int i;
 
           void *aux1_buffer = temp_buffer;
@@ -1630,9 +2629,10 @@ get_path_instrumentation (FishPathInstrumentation *fpi,
 {
   long   ticks_start = 0;
   long   ticks_end   = 0;
+  int    scratch_bpp = path_scratch_bpp (path);
 
-  Babl *babl_source = fpi->source;
-  Babl *babl_destination = fpi->destination;
+  Babl *babl_source = fpi->fmt_source;
+  Babl *babl_destination = fpi->fmt_destination;
 
   int source_bpp = 0;
   int dest_bpp = 0;
@@ -1675,7 +2675,9 @@ get_path_instrumentation (FishPathInstrumentation *fpi,
   ticks_start = babl_ticks ();
   for (int i = 0; i < BABL_TEST_ITER; i ++)
   process_conversion_path (path, fpi->source, source_bpp, fpi->destination,
-                           dest_bpp, fpi->num_test_pixels);
+                           dest_bpp, fpi->num_test_pixels,
+                           path_chunk_size (scratch_bpp, source_bpp, dest_bpp),
+                           scratch_bpp);
   ticks_end = babl_ticks ();
   *path_cost = (ticks_end - ticks_start);
 
@@ -102,6 +102,247 @@ create_name (const Babl *source,
 
 #endif
 
+#ifdef HAVE_LCMS
+
+/* these are not defined by lcms2.h we hope that following the existing pattern of pixel-format definitions work */
+#ifndef TYPE_CMYKA_DBL
+#define TYPE_CMYKA_DBL      (FLOAT_SH(1)|COLORSPACE_SH(PT_CMYK)|EXTRA_SH(1)|CHANNELS_SH(4)|BYTES_SH(0))
+#endif
+
+/* Transforms between pairs of CMYK spaces are made on first use and kept
+ * in a cache keyed by the pair, bounded both in number of transforms and
+ * in accounted memory - when over either bound the least recently used
+ * transforms not in use are dropped. The memory of a transform is
+ * accounted as the size of the two profiles it was made from, which the
+ * lcms pipelines are roughly proportional to.
+ *
+ * The bookkeeping is done with babl_reference_mutex held, every entry has
+ * a mutex of its own held while its transform is made, this makes each
+ * transform once without blocking the threads using other transforms.
+ * Entries in use are counted with refs, an entry dropped from the cache
+ * while in use is freed by the last thread releasing it.
+ */
+
+#define CMYK_TRANSFORM_BUCKETS     256
+#define CMYK_TRANSFORM_MAX_COUNT   256
+#define CMYK_TRANSFORM_MAX_MEMORY  (64 * 1024 * 1024)
+
+typedef struct CmykTransform
+{
+  const Babl           *source_space;
+  const Babl           *destination_space;
+  cmsHTRANSFORM         transform;
+  BablMutex            *mutex;
+  size_t                size;
+  int                   refs;
+  int                   dropped;
+  struct CmykTransform *bucket_next;
+  struct CmykTransform *lru_prev;   /* towards more recently used */
+  struct CmykTransform *lru_next;   /* towards less recently used */
+} CmykTransform;
+
+static struct
+{
+  CmykTransform *buckets[CMYK_TRANSFORM_BUCKETS];
+  CmykTransform *lru_first;
+  CmykTransform *lru_last;
+  int            count;
+  size_t         memory;
+  int            max_count;
+  size_t         max_memory;
+} cmyk_transforms;
+
+static void
+cmyk_transform_limits (void)
+{
+  const char *env;
+
+  if (cmyk_transforms.max_count)
+    return;
+
+  cmyk_transforms.max_count  = CMYK_TRANSFORM_MAX_COUNT;
+  cmyk_transforms.max_memory = CMYK_TRANSFORM_MAX_MEMORY;
+
+  /* maximum number of cached CMYK to CMYK transforms */
+  env = getenv ("BABL_CMYK_TRANSFORM_CACHE_SIZE");
+  if (env && atoi (env) > 0)
+    cmyk_transforms.max_count = atoi (env);
+
+  /* maximum accounted memory of cached transforms, in megabytes */
+  env = getenv ("BABL_CMYK_TRANSFORM_CACHE_MEMORY");
+  if (env && atoi (env) > 0)
+    cmyk_transforms.max_memory = (size_t) atoi (env) * 1024 * 1024;
+}
+
+static inline int
+cmyk_transform_bucket (const Babl *source_space,
+                       const Babl *destination_space)
+{
+  size_t hash = ((size_t) source_space >> 4) * 31 +
+                ((size_t) destination_space >> 4);
+
+  return (hash ^ (hash >> 8) ^ (hash >> 16)) % CMYK_TRANSFORM_BUCKETS;
+}
+
+static void
+cmyk_transform_free (CmykTransform *entry)
+{
+  if (entry->transform)
+    cmsDeleteTransform (entry->transform);
+  babl_mutex_destroy (entry->mutex);
+  babl_free (entry);
+}
+
+static void
+cmyk_transform_lru_unlink (CmykTransform *entry)
+{
+  if (entry->lru_prev)
+    entry->lru_prev->lru_next = entry->lru_next;
+  else
+    cmyk_transforms.lru_first = entry->lru_next;
+  if (entry->lru_next)
+    entry->lru_next->lru_prev = entry->lru_prev;
+  else
+    cmyk_transforms.lru_last = entry->lru_prev;
+  entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void
+cmyk_transform_lru_push (CmykTransform *entry)
+{
+  entry->lru_next = cmyk_transforms.lru_first;
+  if (cmyk_transforms.lru_first)
+    cmyk_transforms.lru_first->lru_prev = entry;
+  else
+    cmyk_transforms.lru_last = entry;
+  cmyk_transforms.lru_first = entry;
+}
+
+/* removes an entry from the cache, freeing it unless in use */
+static void
+cmyk_transform_drop (CmykTransform *entry)
+{
+  CmykTransform **link = &cmyk_transforms.buckets[
+     cmyk_transform_bucket (entry->source_space, entry->destination_space)];
+
+  while (*link != entry)
+    link = &(*link)->bucket_next;
+  *link = entry->bucket_next;
+
+  cmyk_transform_lru_unlink (entry);
+  cmyk_transforms.count--;
+  cmyk_transforms.memory -= entry->size;
+
+  entry->dropped = 1;
+  if (entry->refs == 0)
+    cmyk_transform_free (entry);
+}
+
+static void
+cmyk_transform_evict (void)
+{
+  CmykTransform *entry = cmyk_transforms.lru_last;
+
+  while (entry &&
+         (cmyk_transforms.count > cmyk_transforms.max_count ||
+          cmyk_transforms.memory > cmyk_transforms.max_memory))
+    {
+      CmykTransform *prev = entry->lru_prev;
+
+      if (entry->refs == 0)
+        cmyk_transform_drop (entry);
+      entry = prev;
+    }
+}
+
+/* returns the transform entry for a pair of spaces, with a reference held
+ * and its transform made. Takes babl_reference_mutex for the bookkeeping,
+ * the transform is made without it.
+ */
+static CmykTransform *
+cmyk_transform_acquire (const Babl *source_space,
+                        const Babl *destination_space)
+{
+  int            bucket = cmyk_transform_bucket (source_space,
+                                                 destination_space);
+  CmykTransform *entry;
+
+  babl_mutex_lock (babl_reference_mutex);
+  cmyk_transform_limits ();
+
+  for (entry = cmyk_transforms.buckets[bucket]; entry;
+       entry = entry->bucket_next)
+    if (entry->source_space == source_space &&
+        entry->destination_space == destination_space)
+      break;
+
+  if (entry)
+    {
+      cmyk_transform_lru_unlink (entry);
+    }
+  else
+    {
+      entry = babl_calloc (1, sizeof (CmykTransform));
+      entry->source_space      = source_space;
+      entry->destination_space = destination_space;
+      entry->mutex             = babl_mutex_new ();
+      entry->size              = sizeof (CmykTransform) +
+                                 source_space->space.icc_length +
+                                 destination_space->space.icc_length;
+
+      entry->bucket_next = cmyk_transforms.buckets[bucket];
+      cmyk_transforms.buckets[bucket] = entry;
+      cmyk_transforms.count++;
+      cmyk_transforms.memory += entry->size;
+    }
+  cmyk_transform_lru_push (entry);
+  entry->refs++;
+
+  cmyk_transform_evict ();
+
+  /* make the transform outside the cache bookkeeping, threads wanting the
+   * same transform wait for it on the mutex of the entry
+   */
+  babl_mutex_unlock (babl_reference_mutex);
+  babl_mutex_lock (entry->mutex);
+  if (!entry->transform)
+    {
+      cmsHPROFILE src_profile = cmsOpenProfileFromMem (
+                                  source_space->space.icc_profile,
+                                  source_space->space.icc_length);
+      cmsHPROFILE dst_profile = cmsOpenProfileFromMem (
+                                  destination_space->space.icc_profile,
+                                  destination_space->space.icc_length);
+
+      entry->transform = cmsCreateTransform (src_profile, TYPE_CMYKA_DBL,
+                                             dst_profile, TYPE_CMYKA_DBL,
+                                             INTENT_RELATIVE_COLORIMETRIC,
+                                             cmsFLAGS_BLACKPOINTCOMPENSATION);
+      cmsCloseProfile (src_profile);
+      cmsCloseProfile (dst_profile);
+    }
+  babl_mutex_unlock (entry->mutex);
+
+  return entry;
+}
+
+static void
+cmyk_transform_release (CmykTransform *entry)
+{
+  babl_mutex_lock (babl_reference_mutex);
+  entry->refs--;
+  if (entry->refs == 0)
+    {
+      if (entry->dropped)
+        cmyk_transform_free (entry);
+      else
+        cmyk_transform_evict ();
+    }
+  babl_mutex_unlock (babl_reference_mutex);
+}
+
+#endif
+
 /* need an internal version that only ever does double,
  * for use in path evaluation? and perhaps even self evaluation of float code path?
  */
@@ -159,6 +400,194 @@ babl_fish_reference (const Babl *source,
 }
 
 
+/* single component images on the stack, used for converting the
+ * components of pixels one at a time.
+ */
+typedef struct
+{
+  BablImage      image;
+  BablComponent *component;
+  BablSampling  *sampling;
+  BablType      *type;
+  char          *data;
+  int            pitch;
+  int            stride;
+} GrayImage;
+
+/* looked up once by babl_init, before any conversion runs, as the
+ * conversions use them without holding babl_reference_mutex
+ */
+static BablComponent *gray_linear = NULL;
+static BablSampling  *gray_sampling = NULL;
+
+void
+_babl_fish_reference_init (void)
+{
+  gray_sampling = (BablSampling *) babl_sampling (1, 1);
+  gray_linear   = (BablComponent *) babl_component_from_id (BABL_GRAY_LINEAR);
+}
+
+static BablImage *
+gray_image (GrayImage *gray)
+{
+  memset (gray, 0, sizeof (GrayImage));
+  gray->image.instance.class_type = BABL_IMAGE;
+  gray->image.instance.name       = "slartibartfast";
+  gray->image.components          = 1;
+  gray->image.component           = &gray->component;
+  gray->image.sampling            = &gray->sampling;
+  gray->image.type                = &gray->type;
+  gray->image.data                = &gray->data;
+  gray->image.pitch               = &gray->pitch;
+  gray->image.stride              = &gray->stride;
+  gray->component                 = gray_linear;
+  gray->sampling                  = gray_sampling;
+  gray->type                      = (BablType *) babl_type_from_id (BABL_DOUBLE);
+
+  return &gray->image;
+}
+
+/* scratch buffers for the intermediate pixels of the reference fishes are
+ * kept in a small per-thread pool, processing is chunked (see
+ * REFERENCE_CHUNK) which bounds the size these buffers grow to.
+ */
+#define SCRATCH_SLOTS 8
+
+#ifndef _WIN32
+typedef struct
+{
+  void *buf[SCRATCH_SLOTS];
+} ScratchPool;
+
+static pthread_key_t  scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+static void
+scratch_pool_free (void *data)
+{
+  ScratchPool *pool = data;
+
+  for (int i = 0; i < SCRATCH_SLOTS; i++)
+    if (pool->buf[i])
+      babl_free (pool->buf[i]);
+  free (pool);
+}
+
+static void
+scratch_key_init (void)
+{
+  pthread_key_create (&scratch_key, scratch_pool_free);
+}
+
+static ScratchPool *
+scratch_pool (void)
+{
+  ScratchPool *pool;
+
+  pthread_once (&scratch_once, scratch_key_init);
+  pool = pthread_getspecific (scratch_key);
+  if (!pool)
+    {
+      pool = calloc (1, sizeof (ScratchPool));
+      if (pool)
+        pthread_setspecific (scratch_key, pool);
+    }
+  return pool;
+}
+#endif
+
+/* returns a buffer of at least size bytes, the smallest pooled buffer
+ * that is large enough if any.
+ */
+static void *
+scratch_get (size_t size)
+{
+#ifndef _WIN32
+  ScratchPool *pool = scratch_pool ();
+  int          best = -1;
+
+  if (pool)
+    {
+      for (int i = 0; i < SCRATCH_SLOTS; i++)
+        if (pool->buf[i] && babl_sizeof (pool->buf[i]) >= size &&
+            (best < 0 || babl_sizeof (pool->buf[i]) < babl_sizeof (pool->buf[best])))
+          best = i;
+      if (best >= 0)
+        {
+          void *ret = pool->buf[best];
+          pool->buf[best] = NULL;
+          return ret;
+        }
+    }
+#endif
+  return babl_malloc (size);
+}
+
+/* hands a buffer from scratch_get back to the pool of the thread, when
+ * the pool is full the smallest buffer gets freed.
+ */
+static void
+scratch_put (void *buf)
+{
+#ifndef _WIN32
+  ScratchPool *pool;
+  int          smallest = 0;
+
+  if (!buf)
+    return;
+  pool = scratch_pool ();
+  if (pool)
+    {
+      for (int i = 0; i < SCRATCH_SLOTS; i++)
+        {
+          if (!pool->buf[i])
+            {
+              pool->buf[i] = buf;
+              return;
+            }
+          if (babl_sizeof (pool->buf[i]) < babl_sizeof (pool->buf[smallest]))
+            smallest = i;
+        }
+      if (babl_sizeof (pool->buf[smallest]) < babl_sizeof (buf))
+        {
+          void *tmp = pool->buf[smallest];
+          pool->buf[smallest] = buf;
+          buf = tmp;
+        }
+    }
+#else
+  if (!buf)
+    return;
+#endif
+  babl_free (buf);
+}
+
+void
+_babl_fish_reference_cache_destroy (void)
+{
+#ifndef _WIN32
+  ScratchPool *pool;
+#endif
+
+#ifdef HAVE_LCMS
+  babl_mutex_lock (babl_reference_mutex);
+  while (cmyk_transforms.lru_first)
+    cmyk_transform_drop (cmyk_transforms.lru_first);
+  babl_mutex_unlock (babl_reference_mutex);
+#endif
+
+#ifndef _WIN32
+  /* the key destructor does not run for the main thread */
+  pthread_once (&scratch_once, scratch_key_init);
+  pool = pthread_getspecific (scratch_key);
+  if (pool)
+    {
+      pthread_setspecific (scratch_key, NULL);
+      scratch_pool_free (pool);
+    }
+#endif
+}
+
 static void
 convert_to_double (BablFormat      *source_fmt,
                    const char      *source_buf,
@@ -167,13 +596,13 @@ convert_to_double (BablFormat      *source_fmt,
 {
   int        i;
 
+  GrayImage  src_storage;
+  GrayImage  dst_storage;
   BablImage *src_img;
   BablImage *dst_img;
 
-  src_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
-  dst_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
+  src_img = gray_image (&src_storage);
+  dst_img = gray_image (&dst_storage);
 
   dst_img->type[0]  = (BablType *) babl_type_from_id (BABL_DOUBLE);
   dst_img->pitch[0] =
@@ -230,8 +659,6 @@ convert_to_double (BablFormat      *source_fmt,
         }
     }
   }
-  babl_free (src_img);
-  babl_free (dst_img);
 }
 
 
@@ -244,13 +671,13 @@ convert_from_double (BablFormat *source_fmt,
 {
   int        i;
 
+  GrayImage  src_storage;
+  GrayImage  dst_storage;
   BablImage *src_img;
   BablImage *dst_img;
 
-  src_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
-  dst_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
+  src_img = gray_image (&src_storage);
+  dst_img = gray_image (&dst_storage);
 
   src_img->type[0]   = (BablType *) babl_type_from_id (BABL_DOUBLE);
   src_img->pitch[0]  = (src_img->type[0]->bits / 8) * destination_fmt->model->components;
@@ -301,8 +728,6 @@ convert_from_double (BablFormat *source_fmt,
 
       dst_img->data[0] += dst_img->type[0]->bits / 8;
     }
-  babl_free (src_img);
-  babl_free (dst_img);
 }
 
 
@@ -312,13 +737,13 @@ ncomponent_convert_to_double (BablFormat       *source_fmt,
                               char             *source_double_buf,
                               int               n)
 {
+  GrayImage  src_storage;
+  GrayImage  dst_storage;
   BablImage *src_img;
   BablImage *dst_img;
 
-  src_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
-  dst_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
+  src_img = gray_image (&src_storage);
+  dst_img = gray_image (&dst_storage);
 
   dst_img->type[0]  = (BablType *) babl_type_from_id (BABL_DOUBLE);
   dst_img->pitch[0] = (dst_img->type[0]->bits / 8);
@@ -335,8 +760,6 @@ ncomponent_convert_to_double (BablFormat       *source_fmt,
     assert_conversion_find (src_img->type[0], dst_img->type[0]),
     (void*)src_img, (void*)dst_img,
     n * source_fmt->components);
-  babl_free (src_img);
-  babl_free (dst_img);
 }
 
 static void
@@ -345,13 +768,13 @@ ncomponent_convert_from_double (BablFormat *destination_fmt,
                                 char       *destination_buf,
                                 int         n)
 {
+  GrayImage  src_storage;
+  GrayImage  dst_storage;
   BablImage *src_img;
   BablImage *dst_img;
 
-  src_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
-  dst_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
+  src_img = gray_image (&src_storage);
+  dst_img = gray_image (&dst_storage);
 
   src_img->type[0]   = (BablType *) babl_type_from_id (BABL_DOUBLE);
   src_img->pitch[0]  = (src_img->type[0]->bits / 8);
@@ -370,8 +793,6 @@ ncomponent_convert_from_double (BablFormat *destination_fmt,
     n * destination_fmt->components);
 
   dst_img->data[0] += dst_img->type[0]->bits / 8;
-  babl_free (src_img);
-  babl_free (dst_img);
 }
 
 
@@ -390,7 +811,7 @@ process_to_n_component (const Babl  *babl,
   components = MAX(components, BABL (babl->fish.destination)->format.components);
   components = MAX(components, BABL (babl->fish.destination)->model.components);
 
-  double_buf = babl_malloc (sizeof (double) * n * components);
+  double_buf = scratch_get (sizeof (double) * n * components);
       memset (double_buf, 0,sizeof (double) * n * components);
 
  /* a single precision path could be added here*/
@@ -410,7 +831,7 @@ process_to_n_component (const Babl  *babl,
       );
     }
 
-  babl_free (double_buf);
+  scratch_put (double_buf);
   return 0;
 }
 
@@ -432,13 +853,18 @@ ncomponent_convert_to_float (BablFormat       *source_fmt,
                              char             *source_float_buf,
                              int               n)
 {
+  GrayImage  src_storage;
+  GrayImage  dst_storage;
   BablImage *src_img;
   BablImage *dst_img;
 
-  src_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
-  dst_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
+  if (_babl_reference_to_float (source_fmt->type[0]->instance.id,
+                                source_buf, (float *) source_float_buf,
+                                n * source_fmt->components))
+    return;
+
+  src_img = gray_image (&src_storage);
+  dst_img = gray_image (&dst_storage);
 
   dst_img->type[0]  = (BablType *) babl_type_from_id (BABL_FLOAT);
   dst_img->pitch[0] = (dst_img->type[0]->bits / 8);
@@ -455,8 +881,6 @@ ncomponent_convert_to_float (BablFormat       *source_fmt,
     assert_conversion_find (src_img->type[0], dst_img->type[0]),
     (void*)src_img, (void*)dst_img,
     n * source_fmt->components);
-  babl_free (src_img);
-  babl_free (dst_img);
 }
 
 static void
@@ -466,13 +890,19 @@ ncomponent_convert_from_float (BablFormat *source_fmt,
                                char       *destination_buf,
                                int         n)
 {
+  GrayImage  src_storage;
+  GrayImage  dst_storage;
   BablImage *src_img;
   BablImage *dst_img;
 
-  src_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
-  dst_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
+  if (_babl_reference_from_float (destination_fmt->type[0]->instance.id,
+                                  (float *) destination_float_buf,
+                                  destination_buf,
+                                  n * destination_fmt->components))
+    return;
+
+  src_img = gray_image (&src_storage);
+  dst_img = gray_image (&dst_storage);
 
   src_img->type[0]   = (BablType *) babl_type_from_id (BABL_FLOAT);
   src_img->pitch[0]  = (src_img->type[0]->bits / 8);
@@ -491,8 +921,23 @@ ncomponent_convert_from_float (BablFormat *source_fmt,
     n * destination_fmt->components);
 
   dst_img->data[0] += dst_img->type[0]->bits / 8;
-  babl_free (src_img);
-  babl_free (dst_img);
+}
+
+/* formats with a single type and the components of their model in order
+ * are converted to and from float for all components at once
+ */
+static int
+laid_out_like_model (const BablFormat *fmt)
+{
+  int i;
+
+  if (fmt->components != fmt->model->components)
+    return 0;
+  for (i = 0; i < fmt->components; i++)
+    if (fmt->type[i] != fmt->type[0] ||
+        fmt->component[i] != fmt->model->component[i])
+      return 0;
+  return 1;
 }
 
 static void
@@ -503,13 +948,19 @@ convert_to_float (BablFormat *source_fmt,
 {
   int        i;
 
+  GrayImage  src_storage;
+  GrayImage  dst_storage;
   BablImage *src_img;
   BablImage *dst_img;
 
-  src_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
-  dst_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
+  if (laid_out_like_model (source_fmt) &&
+      _babl_reference_to_float (source_fmt->type[0]->instance.id,
+                                source_buf, (float *) float_buf,
+                                n * source_fmt->components))
+    return;
+
+  src_img = gray_image (&src_storage);
+  dst_img = gray_image (&dst_storage);
 
   dst_img->type[0]  = (BablType *) babl_type_from_id (BABL_FLOAT);
   dst_img->pitch[0] =
@@ -566,8 +1017,6 @@ convert_to_float (BablFormat *source_fmt,
         }
     }
   }
-  babl_free (src_img);
-  babl_free (dst_img);
 }
 
 
@@ -580,13 +1029,24 @@ convert_from_float (BablFormat *source_fmt,
 {
   int        i;
 
+  GrayImage  src_storage;
+  GrayImage  dst_storage;
   BablImage *src_img;
   BablImage *dst_img;
 
-  src_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
-  dst_img = (BablImage *) babl_image_new (
-    babl_component_from_id (BABL_GRAY_LINEAR), NULL, 1, 0, NULL);
+  /* with the same model only the components present in the source are
+   * written, leave that to the per component conversions */
+  if (laid_out_like_model (destination_fmt) &&
+      (source_fmt->model != destination_fmt->model ||
+       source_fmt->components == source_fmt->model->components) &&
+      _babl_reference_from_float (destination_fmt->type[0]->instance.id,
+                                  (float *) destination_float_buf,
+                                  destination_buf,
+                                  n * destination_fmt->components))
+    return;
+
+  src_img = gray_image (&src_storage);
+  dst_img = gray_image (&dst_storage);
 
   src_img->type[0]   = (BablType *) babl_type_from_id (BABL_FLOAT);
   src_img->pitch[0]  = (src_img->type[0]->bits / 8) * destination_fmt->model->components;
@@ -634,8 +1094,6 @@ convert_from_float (BablFormat *source_fmt,
 
       dst_img->data[0] += dst_img->type[0]->bits / 8;
     }
-  babl_free (src_img);
-  babl_free (dst_img);
 }
 
 
@@ -654,7 +1112,7 @@ process_same_model (const Babl  *babl,
       (babl->fish.destination->format.type[0]->bits < 32 ||
        babl->fish.destination->format.type[0] == type_float))
   {
-     void *float_buf = babl_malloc (sizeof (float) * n *
+     void *float_buf = scratch_get (sizeof (float) * n *
                             MAX (BABL (babl->fish.source)->format.model->components,
                                  BABL (babl->fish.source)->format.components));
     if (compatible_components ((void*)babl->fish.source,
@@ -687,11 +1145,11 @@ process_same_model (const Babl  *babl,
           (char *) destination,
           n);
     }
-    babl_free (float_buf);
+    scratch_put (float_buf);
   }
   else
   {
-     void *double_buf = babl_malloc (sizeof (double) * n *
+     void *double_buf = scratch_get (sizeof (double) * n *
                             MAX (BABL (babl->fish.source)->format.model->components,
                                  BABL (babl->fish.source)->format.components));
 #undef MAX
@@ -724,7 +1182,7 @@ process_same_model (const Babl  *babl,
           (char *) destination,
           n);
     }
-    babl_free (double_buf);
+    scratch_put (double_buf);
   }
 }
 
@@ -785,7 +1243,7 @@ babl_fish_reference_process_double (const Babl *babl,
   else
   {
     source_double_buf =
-    source_double_buf_alloc = babl_malloc (sizeof (double) * n *
+    source_double_buf_alloc = scratch_get (sizeof (double) * n *
                                 BABL (babl->fish.source)->format.model->components);
 
     source_image = babl_image_from_linear (
@@ -809,7 +1267,7 @@ babl_fish_reference_process_double (const Babl *babl,
                          source_space));
 
        rgba_double_buf       =
-       rgba_double_buf_alloc = babl_malloc (sizeof (double) * n * 4);
+       rgba_double_buf_alloc = scratch_get (sizeof (double) * n * 4);
 
        rgba_image = babl_image_from_linear (
           rgba_double_buf, babl_remodel_with_space (babl_model_from_id (BABL_RGBA), source_space));
@@ -841,7 +1299,7 @@ babl_fish_reference_process_double (const Babl *babl,
                          source_space));
 
         cmyka_double_buf       =
-        cmyka_double_buf_alloc = babl_malloc (sizeof (double) * n * 5);
+        cmyka_double_buf_alloc = scratch_get (sizeof (double) * n * 5);
 
         cmyka_image = babl_image_from_linear (
           cmyka_double_buf, babl_remodel_with_space (babl_model ("cmykA"),
@@ -880,7 +1338,7 @@ babl_fish_reference_process_double (const Babl *babl,
            destination_kind == KIND_CMYK)
   {
     cmyka_double_buf        =
-    cmyka_double_buf_alloc  = babl_malloc (sizeof (double) * n * 5);
+    cmyka_double_buf_alloc  = scratch_get (sizeof (double) * n * 5);
     cmyka_image = babl_image_from_linear (
         cmyka_double_buf, babl_remodel_with_space (babl_model ("cmykA"),
         destination_space));
@@ -945,7 +1403,7 @@ babl_fish_reference_process_double (const Babl *babl,
           destination_kind == KIND_RGB)
  {
     /* */
-    rgba_double_buf_alloc  = babl_malloc (sizeof (double) * n * 4);
+    rgba_double_buf_alloc  = scratch_get (sizeof (double) * n * 4);
     rgba_double_buf        = rgba_double_buf_alloc;
     rgba_image = babl_image_from_linear (
         rgba_double_buf, babl_remodel_with_space (babl_model_from_id (BABL_RGBA),
@@ -1024,41 +1482,17 @@ babl_fish_reference_process_double (const Babl *babl,
     {
 #if HAVE_LCMS
 
-#define MAX_CMYK_CMYK  64
-     static int cmyk_cmyk_count = 0;
-     static const Babl *cmyk_cmyk_source[MAX_CMYK_CMYK];
-     static const Babl *cmyk_cmyk_destination[MAX_CMYK_CMYK];
-     static cmsHTRANSFORM cmyk_cmyk_transform[MAX_CMYK_CMYK];
+     CmykTransform *entry;
+     double        *cmyka = cmyka_double_buf;
 
-     int cmyk_cmyk_no;
-      double *cmyka = cmyka_double_buf;
-     for (cmyk_cmyk_no = 0; cmyk_cmyk_no < cmyk_cmyk_count; cmyk_cmyk_no++)
-     {
-       if (cmyk_cmyk_source[cmyk_cmyk_no] == source_space &&
-           cmyk_cmyk_destination[cmyk_cmyk_no] == destination_space)
-         break;
-     }
+     /* only the pixels of this call are touched by the transform, other
+      * threads can use the reference fishes meanwhile - the lock this
+      * function took above is released, the transform cache takes it for
+      * its bookkeeping
+      */
+     babl_mutex_unlock (babl_reference_mutex);
+     entry = cmyk_transform_acquire (source_space, destination_space);
 
-/* these are not defined by lcms2.h we hope that following the existing pattern of pixel-format definitions work */
-#ifndef TYPE_CMYKA_DBL
-#define TYPE_CMYKA_DBL      (FLOAT_SH(1)|COLORSPACE_SH(PT_CMYK)|EXTRA_SH(1)|CHANNELS_SH(4)|BYTES_SH(0))
-#endif
-
-     if (cmyk_cmyk_no >= cmyk_cmyk_count)
-     {
-       cmsHPROFILE src_profile = cmsOpenProfileFromMem(source_space->space.icc_profile, source_space->space.icc_length);
-       cmsHPROFILE dst_profile = cmsOpenProfileFromMem(destination_space->space.icc_profile, source_space->space.icc_length);
-
-       cmyk_cmyk_source[cmyk_cmyk_no] = source_space;
-       cmyk_cmyk_destination[cmyk_cmyk_no] = destination_space;
-       cmyk_cmyk_transform[cmyk_cmyk_no] = cmsCreateTransform(src_profile, TYPE_CMYKA_DBL,
-  dst_profile, TYPE_CMYKA_DBL,
-  INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_BLACKPOINTCOMPENSATION);
-       cmsCloseProfile (src_profile);
-       cmsCloseProfile (dst_profile);
-
-       cmyk_cmyk_count ++;
-     }
       for (int i = 0; i < n; i++)
       {
         cmyka[i * 5 + 0] = (1.0-cmyka[i * 5 + 0])*100.0;
@@ -1067,8 +1501,11 @@ babl_fish_reference_process_double (const Babl *babl,
         cmyka[i * 5 + 3] = (1.0-cmyka[i * 5 + 3])*100.0;
       }
 
-     cmsDoTransform (cmyk_cmyk_transform[cmyk_cmyk_no],
-                     cmyka_double_buf, cmyka_double_buf, n);
+     if (entry->transform)
+       cmsDoTransform (entry->transform,
+                       cmyka_double_buf, cmyka_double_buf, n);
+     cmyk_transform_release (entry);
+     babl_mutex_lock (babl_reference_mutex);
 
       for (int i = 0; i < n; i++)
       {
@@ -1099,7 +1536,7 @@ babl_fish_reference_process_double (const Babl *babl,
             assert_conversion_find (destination_cmyka_format,
                              BABL (babl->fish.destination)->format.model);
           destination_double_buf =
-          destination_double_buf_alloc = babl_malloc (sizeof (double) * n *
+          destination_double_buf_alloc = scratch_get (sizeof (double) * n *
                                           BABL (babl->fish.destination)->format.model->components);
           if (conv->class_type == BABL_CONVERSION_PLANAR)
           {
@@ -1135,7 +1572,7 @@ babl_fish_reference_process_double (const Babl *babl,
         Babl *conv =
           assert_conversion_find (destination_rgba_format,
              BABL (babl->fish.destination)->format.model);
-           destination_double_buf_alloc = babl_malloc (sizeof (double) * n *
+           destination_double_buf_alloc = scratch_get (sizeof (double) * n *
                                             BABL (babl->fish.destination)->format.model->components);
            destination_double_buf = destination_double_buf_alloc;
 
@@ -1174,14 +1611,10 @@ babl_fish_reference_process_double (const Babl *babl,
     n
   );
 
-  if (destination_double_buf_alloc)
-    babl_free (destination_double_buf_alloc);
-  if (rgba_double_buf_alloc)
-    babl_free (rgba_double_buf_alloc);
-  if (cmyka_double_buf_alloc)
-    babl_free (cmyka_double_buf_alloc);
-  if (source_double_buf_alloc)
-    babl_free (source_double_buf_alloc);
+  scratch_put (destination_double_buf_alloc);
+  scratch_put (rgba_double_buf_alloc);
+  scratch_put (cmyka_double_buf_alloc);
+  scratch_put (source_double_buf_alloc);
   if (source_image)
     babl_free (source_image);
   if (rgba_image)
@@ -1212,37 +1645,44 @@ babl_fish_reference_process_float (const Babl *babl,
     const Babl *destination_float_format;
     Babl *conv_to_rgba;
     Babl *conv_from_rgba;
-    char dst_name[256];
-
+    BablFishReference *reference = (BablFishReference *) babl;
 
+    if (!__atomic_load_n (&reference->float_state, __ATOMIC_ACQUIRE))
     {
-    char src_name[256];
-    sprintf (src_name, "%s float", babl_get_name((void*)babl->fish.source->format.model));
-    conv_to_rgba =
+      char name[256];
+
+      sprintf (name, "%s float", babl_get_name((void*)babl->fish.source->format.model));
+      reference->float_to_rgba =
         babl_conversion_find (
-        babl_format_with_space (src_name,
+        babl_format_with_space (name,
                    BABL (BABL ((babl->fish.source))->format.space)),
         babl_format_with_space ("RGBA float",
                    BABL (BABL ((babl->fish.source))->format.space)));
-    }
-    {
-      sprintf (dst_name, "%s float", babl_get_name((void*)babl->fish.destination->format.model));
-      destination_float_format =
-        babl_format_with_space (dst_name,
+
+      sprintf (name, "%s float", babl_get_name((void*)babl->fish.destination->format.model));
+      reference->float_destination =
+        babl_format_with_space (name,
                    BABL (BABL ((babl->fish.destination))->format.space));
-      conv_from_rgba  =
+      reference->float_from_rgba  =
         babl_conversion_find (
         babl_format_with_space ("RGBA float",
                    BABL (BABL ((babl->fish.destination))->format.space)),
-                   destination_float_format);
+                   reference->float_destination);
+
+      __atomic_store_n (&reference->float_state,
+                        reference->float_to_rgba && reference->float_from_rgba ?
+                        1 : -1, __ATOMIC_RELEASE);
     }
 
-    if (!conv_to_rgba || !conv_from_rgba)
+    if (reference->float_state < 0)
     {
       /* needed float conversions not found, using double code path instead */
       babl_fish_reference_process_double (babl, source, destination, n, data);
       return;
     }
+    conv_to_rgba             = (Babl *) reference->float_to_rgba;
+    conv_from_rgba           = (Babl *) reference->float_from_rgba;
+    destination_float_format = reference->float_destination;
 
     babl_mutex_lock (babl_reference_mutex);
     if (babl->fish.source->format.type[0] == type_float &&
@@ -1258,7 +1698,7 @@ babl_fish_reference_process_float (const Babl *babl,
     else
     {
       /* the +1 is to mask a valgrind 'invalid read of size 16' false positive  */
-      source_float_buf_alloc = babl_malloc (sizeof (float) * (n+1) *
+      source_float_buf_alloc = scratch_get (sizeof (float) * (n+1) *
                                   (BABL (babl->fish.source)->format.model->components));
 
       source_float_buf = source_float_buf_alloc;
@@ -1283,7 +1723,7 @@ babl_fish_reference_process_float (const Babl *babl,
     }
     else
     {
-      rgba_float_buf_alloc  = babl_malloc (sizeof (float) * n * 4);
+      rgba_float_buf_alloc  = scratch_get (sizeof (float) * n * 4);
       rgba_float_buf        = rgba_float_buf_alloc;
 
       rgba_image = babl_image_from_linear (
@@ -1319,20 +1759,19 @@ babl_fish_reference_process_float (const Babl *babl,
         (babl->fish.source)->format.space->space.RGBtoXYZf,
         matrix);
 
-      babl_matrix_mul_vectorff_buf4 (matrix, rgba, rgba, n);
+      _babl_reference_matrix_buf4 (matrix, rgba, n);
     }
 
     {
       if(babl_format_with_space ("RGBA float",
                    BABL (BABL ((babl->fish.destination))->format.space)) ==
-         babl_format_with_space (dst_name,
-                   BABL (BABL ((babl->fish.destination))->format.space)))
+         destination_float_format)
       {
         destination_float_buf = rgba_float_buf;
       }
       else
       {
-        destination_float_buf_alloc = babl_malloc (sizeof (float) * n *
+        destination_float_buf_alloc = scratch_get (sizeof (float) * n *
                                         BABL (babl->fish.destination)->format.model->components);
         destination_float_buf = destination_float_buf_alloc;
 
@@ -1361,12 +1800,9 @@ babl_fish_reference_process_float (const Babl *babl,
       n
     );
 
-    if (destination_float_buf_alloc)
-      babl_free (destination_float_buf_alloc);
-    if (rgba_float_buf_alloc)
-      babl_free (rgba_float_buf_alloc);
-    if (source_float_buf_alloc)
-      babl_free (source_float_buf_alloc);
+    scratch_put (destination_float_buf_alloc);
+    scratch_put (rgba_float_buf_alloc);
+    scratch_put (source_float_buf_alloc);
     if (source_image)
       babl_free (source_image);
     if (rgba_image)
@@ -1375,6 +1811,10 @@ babl_fish_reference_process_float (const Babl *babl,
       babl_free (destination_image);
 }
 
+/* number of pixels processed at a time, with 5 doubles for the CMYKA
+ * intermediate this keeps each scratch buffer at 160kb */
+#define REFERENCE_CHUNK 4096
+
 void
 babl_fish_reference_process (const Babl *babl,
                              const char *source,
@@ -1397,6 +1837,24 @@ babl_fish_reference_process (const Babl *babl,
     return;
   }
 
+  /* larger spans are processed in chunks, keeping the intermediate buffers
+   * in cache and bounded in size */
+  if (n > REFERENCE_CHUNK)
+  {
+    int  source_bpp      = babl->fish.source->format.bytes_per_pixel;
+    int  destination_bpp = babl->fish.destination->format.bytes_per_pixel;
+    long done;
+
+    for (done = 0; done < n; done += REFERENCE_CHUNK)
+      babl_fish_reference_process (babl,
+                                   source + done * source_bpp,
+                                   destination + done * destination_bpp,
+                                   n - done < REFERENCE_CHUNK ?
+                                   n - done : REFERENCE_CHUNK,
+                                   data);
+    return;
+  }
+
   /* same model and space, only convert type */
   if ((BABL (babl->fish.source)->format.model ==
        BABL (babl->fish.destination)->format.model) &&
@@ -21,6 +21,7 @@
 #include "babl-internal.h"
 #include "babl-db.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdarg.h>
 
@@ -182,13 +183,20 @@ int
 babl_fish_get_id (const Babl *source,
                   const Babl *destination)
 {
-  /* value of 'id' will be used as argument for hash function,
-   * substraction serves as simple combination of
-   * source/destination values. */
-  int id = (((size_t)source * 93)) ^ ((size_t)destination);
-  /* instances with id 0 won't be inserted into database */
-  id *= ((((size_t)  (destination))) % 37);
+  /* the pointers are combined and mixed with the murmur3 finalizer, all
+   * bits of both end up affecting the id, which is used as a hash */
+  uint64_t hash = (uint64_t) (uintptr_t) source * 0x9e3779b97f4a7c15ull;
+  int      id;
+
+  hash ^= (uint64_t) (uintptr_t) destination;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ull;
+  hash ^= hash >> 33;
 
+  /* instances with id 0 won't be inserted into database */
+  id = (int) hash;
   if (id == 0)
     id = 1;
   return id;
@@ -270,6 +278,11 @@ babl_fish (const void *source,
          * insert it into the fish database to indicate non-existent fish
          * path.
          */
+        Babl *found = _babl_fish_path_lookup (source_format,
+                                              destination_format);
+        if (found)
+          return found;
+
         babl_hash_table_find (id_htable, hashval, find_fish_path, (void *) &ffish);
         if (ffish.fish_path)
           {
@@ -294,41 +307,34 @@ babl_fish (const void *source,
 
         if (!ffish.fish_fish)
           {
-            const Babl *src_space = (void*)source_format->format.space;
-            const Babl *dst_space = (void*)destination_format->format.space;
             /* we haven't tried to search for suitable path yet */
+            Babl *fish_path = babl_fish_path (source_format, destination_format);
 
-            if (!babl_space_is_cmyk (src_space) &&
-                !babl_space_is_cmyk (dst_space))
+            if (fish_path)
               {
-                Babl *fish_path = babl_fish_path (source_format, destination_format);
-
-                if (fish_path)
-                  {
-                    babl_mutex_unlock (babl_fish_mutex);
-                    return fish_path;
-                  }
+                babl_mutex_unlock (babl_fish_mutex);
+                return fish_path;
+              }
 #if 1
-                else
-                  {
-                    /* there isn't a suitable path for requested formats,
-                     * let's create a dummy BABL_FISH instance and insert
-                     * it into the fish database to indicate that such path
-                     * does not exist.
-                     */
-                    char *name = "X"; /* name does not matter */
-                    Babl *fish = babl_calloc (1, sizeof (BablFish) + strlen (name) + 1);
-
-                    fish->class_type                = BABL_FISH;
-                    fish->instance.id               = babl_fish_get_id (source_format, destination_format);
-                    fish->instance.name             = ((char *) fish) + sizeof (BablFish);
-                    strcpy (fish->instance.name, name);
-                    fish->fish.source               = source_format;
-                    fish->fish.destination          = destination_format;
-                    babl_db_insert (babl_fish_db (), fish);
-                  }
+            else
+              {
+                /* there isn't a suitable path for requested formats,
+                 * let's create a dummy BABL_FISH instance and insert
+                 * it into the fish database to indicate that such path
+                 * does not exist.
+                 */
+                char *name = "X"; /* name does not matter */
+                Babl *fish = babl_calloc (1, sizeof (BablFish) + strlen (name) + 1);
+
+                fish->class_type                = BABL_FISH;
+                fish->instance.id               = babl_fish_get_id (source_format, destination_format);
+                fish->instance.name             = ((char *) fish) + sizeof (BablFish);
+                strcpy (fish->instance.name, name);
+                fish->fish.source               = source_format;
+                fish->fish.destination          = destination_format;
+                babl_db_insert (babl_fish_db (), fish);
+              }
 #endif
-                }
           }
         else if (ffish.fish_fish->fish.data)
           {
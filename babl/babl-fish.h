@@ -69,8 +69,17 @@ typedef struct
   double     cost;   /* number of  ticks *10 + chain_length */
   int        source_bpp;
   int        dest_bpp;
+  int        chunk_size;  /* pixels per chunk of multi-step processing,
+                             0 until first computed */
+  int        scratch_bpp; /* widest intermediate format of the path */
   unsigned int is_u8_color_conv:1; // keep track of count, and make 
+  unsigned int u8_lut_mapped:1;    // u8_lut is a mapping of a cached LUT file
+  int        u8_lut_building; /* set while one thread is filling the LUT */
   uint32_t  *u8_lut;
+  /* 24bit LUTs are filled lazily in blocks of 64k entries, a bit per block
+   * is claimed by the thread computing it and set in filled when done */
+  uint32_t   u8_lut_claimed[8];
+  uint32_t   u8_lut_filled[8];
   long       last_lut_use;
   BablList  *conversion_list;
 } BablFishPath;
@@ -91,6 +100,13 @@ typedef struct
 typedef struct
 {
   BablFish         fish;
+  /* the conversions through "RGBA float" used by the single precision
+   * reference, looked up on first use; float_state is 1 once found and
+   * -1 when they do not exist */
+  const Babl      *float_to_rgba;
+  const Babl      *float_from_rgba;
+  const Babl      *float_destination;
+  int              float_state;
 } BablFishReference;
 
 #endif
@@ -134,18 +134,58 @@ format_new (const char      *name,
   return babl;
 }
 
+/* Formats looked up by name, or by encoding and space, are kept in small
+ * direct mapped caches, keyed by the address of the name or of the pair of
+ * babls - callers tend to pass the same string constants or babls again
+ * and again, for instance when making fishes per tile. Entries are
+ * verified before use, a hit costs a string compare instead of hashing
+ * the name and walking the format database.
+ */
+#define FORMAT_CACHE_SIZE 256
+
+static const Babl *format_name_cache[FORMAT_CACHE_SIZE];
+static const Babl *format_space_cache[FORMAT_CACHE_SIZE];
+
+static inline int
+format_cache_slot (const void *a,
+                   const void *b)
+{
+  uintptr_t key = (uintptr_t) a ^ ((uintptr_t) b >> 4);
+
+  return (key ^ (key >> 8) ^ (key >> 16)) & (FORMAT_CACHE_SIZE - 1);
+}
+
+void
+_babl_format_cache_clear (void)
+{
+  memset (format_name_cache, 0, sizeof (format_name_cache));
+  memset (format_space_cache, 0, sizeof (format_space_cache));
+}
+
 Babl *
 format_new_from_format_with_space (const Babl *format, 
                                    const Babl *space)
 {
+  int         slot = format_cache_slot (format, space);
+  const Babl *cached = __atomic_load_n (&format_space_cache[slot],
+                                        __ATOMIC_ACQUIRE);
   Babl *ret;
   char new_name[256];
+
+  if (cached &&
+      cached->format.space == space &&
+      cached->format.encoding == babl_get_name (format))
+    return (Babl *) cached;
+
   snprintf (new_name, sizeof (new_name)-1, "%s-%s", babl_get_name ((void*)format),
                                                   babl_get_name ((void*)space));
   new_name[255]=0;
   ret = babl_db_find (babl_format_db(), new_name);
   if (ret)
-    return ret;
+    {
+      __atomic_store_n (&format_space_cache[slot], ret, __ATOMIC_RELEASE);
+      return ret;
+    }
 
   ret = format_new (new_name,
                     0,
@@ -156,6 +196,7 @@ format_new_from_format_with_space (const Babl *format,
 
   ret->format.encoding = babl_get_name(format);
   babl_db_insert (db, (void*)ret);
+  __atomic_store_n (&format_space_cache[slot], ret, __ATOMIC_RELEASE);
   return ret;
 }
 
@@ -725,7 +766,50 @@ const Babl * babl_format_get_space      (const Babl *format)
   return NULL;
 }
 
-BABL_CLASS_IMPLEMENT (format)
+/* babl_format looks names up through a cache, so it and
+ * babl_format_from_id are defined here rather than by BABL_CLASS_IMPLEMENT
+ */
+BABL_CLASS_MINIMAL_IMPLEMENT (format)
+
+const Babl *
+babl_format (const char *name)
+{
+  int         slot = format_cache_slot (name, NULL);
+  const Babl *babl = __atomic_load_n (&format_name_cache[slot],
+                                      __ATOMIC_ACQUIRE);
+
+  if (babl_hmpf_on_name_lookups)
+    {
+      babl_log ("%s(\"%s\"): looking up", G_STRFUNC, name);
+    }
+  if (babl && !strcmp (babl->instance.name, name))
+    return babl;
+
+  if (!db)
+    {
+      babl_fatal ("%s(\"%s\"): you must call babl_init first", G_STRFUNC, name);
+    }
+  babl = babl_db_exist_by_name (db, name);
+
+  if (!babl)
+    {
+      babl_fatal ("%s(\"%s\"): not found", G_STRFUNC, name);
+    }
+  __atomic_store_n (&format_name_cache[slot], babl, __ATOMIC_RELEASE);
+  return babl;
+}
+
+const Babl *
+babl_format_from_id (int id)
+{
+  Babl *babl;
+  babl = babl_db_exist_by_id (db, id);
+  if (!babl)
+    {
+      babl_fatal ("%s(%i): not found", G_STRFUNC, id);
+    }
+  return babl;
+}
 
 const char *
 babl_format_get_encoding (const Babl *babl)
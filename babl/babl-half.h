@@ -0,0 +1,89 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BABL_HALF_H
+#define _BABL_HALF_H
+
+#include <stdint.h>
+
+/* Conversions of single halfs and floats, shared by the half type of the
+ * base and the half extension.
+ *
+ * They are branch-free so that the compiler can vectorize loops of them.
+ * Denormals are converted with single precision arithmetic, which is exact
+ * for them, and the cases are merged with masks rather than branches. They
+ * give the same results as the F16C and NEON conversions: ties round to
+ * even and NaNs are quieted keeping their sign and the top of their
+ * payload.
+ */
+
+static inline float
+_babl_half_to_float_value (uint16_t h)
+{
+  uint32_t sign          = (uint32_t) (h & 0x8000u) << 16;
+  uint32_t em            = h & 0x7fffu;
+  uint32_t normal        = (em << 13) + ((127 - 15) << 23);
+  uint32_t denormal_mask = 0u - (em < 0x0400u);
+  uint32_t inf_nan_mask  = 0u - (em >= 0x7c00u);
+  uint32_t nan_mask      = 0u - (em > 0x7c00u);
+  union { float f; uint32_t u; } denormal, result;
+
+  denormal.f = (int32_t) em * 5.9604644775390625e-08f; /* 2^-24 */
+
+  result.u = (denormal.u & denormal_mask) |
+             (normal & ~(denormal_mask | inf_nan_mask)) |
+             (0x7f800000u & inf_nan_mask);
+  result.u = (result.u & ~nan_mask) | ((0x7fc00000u | (em << 13)) & nan_mask);
+  result.u |= sign;
+  return result.f;
+}
+
+static inline uint16_t
+_babl_float_to_half_value (float f)
+{
+  union { float f; uint32_t u; } x = { f }, magnitude;
+  uint32_t sign          = (x.u >> 16) & 0x8000u;
+  uint32_t ax            = x.u & 0x7fffffffu;
+  uint32_t normal        = (ax >> 13) - ((127 - 15) << 10) +
+                           (((ax >> 12) & 1u) & ((ax & 0x2fffu) != 0));
+  uint32_t denormal_mask = 0u - (ax < 0x38800000u);  /* below 2^-14 */
+  uint32_t overflow_mask = 0u - (ax >= 0x47800000u); /* 2^16 and up */
+  uint32_t nan_mask      = 0u - (ax > 0x7f800000u);
+  float    scaled;
+  float    fraction;
+  int32_t  truncated;
+  uint32_t denormal;
+  uint32_t bits;
+
+  /* the mantissa of a half denormal is the value in units of 2^-24, the
+   * scaling is exact and so is the fraction rounded to even
+   */
+  magnitude.u = ax;
+  scaled      = magnitude.f < 6.103515625e-05f ? magnitude.f * 16777216.0f : 0.0f;
+  truncated   = (int32_t) scaled;
+  fraction    = scaled - truncated;
+  denormal    = truncated + ((fraction > 0.5f) | ((fraction == 0.5f) & truncated));
+
+  bits = (denormal & denormal_mask) |
+         (normal & ~(denormal_mask | overflow_mask)) |
+         (0x7c00u & overflow_mask);
+  bits = (bits & ~nan_mask) | ((0x7e00u | ((ax >> 13) & 0x3ffu)) & nan_mask);
+  return bits | sign;
+}
+
+#endif
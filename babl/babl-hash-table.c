@@ -16,99 +16,181 @@
  * <https://www.gnu.org/licenses/>.
  */
 
-/* Implementation of hash table data structure based on coalesced hashing.
- * Copyright (C) 2008, Jan Heller
+/* Implementation of hash table data structure based on open addressing,
+ * the item lookups of the babl databases.
+ *
+ * Lookups do not take locks, insertions are serialized by the caller - the
+ * mutex of the database. When growing, new slots are published atomically
+ * and the replaced ones are kept until the table is destroyed.
  */
 
 #include "config.h"
 #include "babl-internal.h"
 
-#define BABL_HASH_TABLE_INITIAL_MASK   0x1FF  /* 511 */
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-/* static functions declarations */
-static inline int
-hash_insert (BablHashTable *htab,
-             Babl          *item);
+#define BABL_HASH_TABLE_INITIAL_SIZE   512
+#define BABL_HASH_TABLE_GROUP          4
 
-static void
-hash_rehash (BablHashTable *htab);
+static inline unsigned int
+hash_fingerprint (int hash)
+{
+  return hash ? (unsigned int) hash : 1;
+}
+
+/* returns a bit per slot of the group starting at fingerprint, set for
+ * the slots holding value
+ */
+static inline unsigned int
+group_match (const unsigned int *fingerprint,
+             unsigned int        value)
+{
+#ifdef __SSE2__
+  __m128i group = _mm_loadu_si128 ((const __m128i *) fingerprint);
+
+  return _mm_movemask_ps (_mm_castsi128_ps (
+           _mm_cmpeq_epi32 (group, _mm_set1_epi32 (value))));
+#else
+  unsigned int match = 0;
+  int          i;
+
+  for (i = 0; i < BABL_HASH_TABLE_GROUP; i++)
+    if (__atomic_load_n (&fingerprint[i], __ATOMIC_ACQUIRE) == value)
+      match |= 1 << i;
+  return match;
+#endif
+}
 
-static inline int
-hash_insert (BablHashTable *htab,
-             Babl          *item)
+typedef enum
+{
+  HASH_FIND_FUNC,
+  HASH_FIND_NAME,
+  HASH_FIND_ID
+} HashFind;
+
+/* with kind a constant the compare gets inlined in the callers */
+static inline Babl *
+hash_probe (BablHashTable        *htab,
+            int                   hash,
+            HashFind              kind,
+            BablHashFindFunction  find_func,
+            const void           *data,
+            int                   id)
 {
-  int hash = htab->hash_func(htab, item);
+  BablHashSlots *slots = __atomic_load_n (&htab->slots, __ATOMIC_ACQUIRE);
+  unsigned int   want  = hash_fingerprint (hash);
+  unsigned int   group = want & slots->mask & ~(BABL_HASH_TABLE_GROUP - 1);
 
-  if (htab->data_table[hash] == NULL)
+  for (;;)
     {
-      /* create new chain */
-      htab->data_table[hash] = item;
+      unsigned int match = group_match (slots->fingerprint + group, want);
+      unsigned int empty = group_match (slots->fingerprint + group, 0);
+
+      while (match)
+        {
+          Babl *item = __atomic_load_n (&slots->item[group + __builtin_ctz (match)],
+                                        __ATOMIC_ACQUIRE);
+          match &= match - 1;
+
+          if (!item)
+            continue;
+          switch (kind)
+            {
+              case HASH_FIND_NAME:
+                if (!strcmp (item->instance.name, data))
+                  return item;
+                break;
+              case HASH_FIND_ID:
+                if (item->instance.id == id)
+                  return item;
+                break;
+              case HASH_FIND_FUNC:
+                if (find_func (item, (void *) data))
+                  return item;
+                break;
+            }
+        }
+      if (empty)
+        return NULL;
+      group = (group + BABL_HASH_TABLE_GROUP) & slots->mask;
     }
-  else
-    {
-      int it, oit, cursor = 0;
+}
 
-      while ((cursor < (htab->mask + 1)) && (htab->data_table[cursor] != NULL))
-        ++cursor;
+static void
+slots_add (BablHashSlots *slots,
+           unsigned int   fingerprint,
+           Babl          *item)
+{
+  unsigned int i = fingerprint & slots->mask & ~(BABL_HASH_TABLE_GROUP - 1);
 
-      htab->data_table[cursor] = item;
+  while (slots->fingerprint[i])
+    i = (i + 1) & slots->mask;
 
-      for (oit = hash, it = htab->chain_table[oit]; it != -1; oit = it, it = htab->chain_table[oit])
-        ;
-      htab->chain_table[oit] = cursor;
-    }
+  __atomic_store_n (&slots->item[i], item, __ATOMIC_RELAXED);
+  __atomic_store_n (&slots->fingerprint[i], fingerprint, __ATOMIC_RELEASE);
+}
 
-  htab->count++;
-  return 0;
+static BablHashSlots *
+slots_new (unsigned int size)
+{
+  BablHashSlots *slots = babl_calloc (sizeof (BablHashSlots), 1);
+
+  slots->mask        = size - 1;
+  slots->fingerprint = babl_calloc (sizeof (unsigned int), size);
+  slots->item        = babl_calloc (sizeof (Babl *), size);
+  return slots;
 }
 
 static void
-hash_rehash (BablHashTable *htab)
+hash_grow (BablHashTable *htab)
 {
-  Babl *item;
-  int  i;
-  BablHashTable *nhtab = babl_calloc (sizeof (BablHashTable), 1);
-
-  nhtab->data_table = NULL;
-  nhtab->chain_table = NULL;
-  nhtab->mask = (htab->mask << 1) + 1;
-  nhtab->count = 0;
-  nhtab->hash_func = htab->hash_func;
-  nhtab->find_func = htab->find_func;
-  if (nhtab->mask)
+  BablHashSlots *slots     = htab->slots;
+  BablHashSlots *new_slots = slots_new ((slots->mask + 1) * 2);
+  unsigned int   start     = 0;
+  unsigned int   i;
+
+  /* starting at an empty slot, items of a probe sequence are moved in
+   * order, keeping the first inserted of equal items found first
+   */
+  while (slots->fingerprint[start])
+    start++;
+
+  for (i = 0; i <= slots->mask; i++)
     {
-      nhtab->data_table = babl_calloc (sizeof (BablInstance *), babl_hash_table_size(nhtab));
-      nhtab->chain_table = babl_malloc (sizeof (int) * babl_hash_table_size(nhtab));
-      memset (nhtab->chain_table, -1, sizeof (int) * babl_hash_table_size(nhtab));
-    }
+      unsigned int j = (start + i) & slots->mask;
 
-  for (i = 0; i < babl_hash_table_size (htab); i++)
-    {
-      item = htab->data_table[i];
-      babl_hash_table_insert (nhtab, item);
+      if (slots->fingerprint[j])
+        slots_add (new_slots, slots->fingerprint[j], slots->item[j]);
     }
 
-  htab->mask = nhtab->mask;
-  babl_free (htab->data_table);
-  babl_free (htab->chain_table);
-  htab->data_table = nhtab->data_table;
-  htab->chain_table = nhtab->chain_table;
-  babl_free (nhtab);
+  new_slots->old = slots;
+  __atomic_store_n (&htab->slots, new_slots, __ATOMIC_RELEASE);
 }
 
 int
 babl_hash_table_size (BablHashTable *htab)
 {
-    return htab->mask + 1;
+    return htab->slots->mask + 1;
 }
 
 
 static int
 babl_hash_table_destroy (void *data)
 {
-  BablHashTable *htab = data;
-  babl_free (htab->data_table);
-  babl_free (htab->chain_table);
+  BablHashTable *htab  = data;
+  BablHashSlots *slots = htab->slots;
+
+  while (slots)
+    {
+      BablHashSlots *old = slots->old;
+
+      babl_free (slots->fingerprint);
+      babl_free (slots->item);
+      babl_free (slots);
+      slots = old;
+    }
   return 0;
 }
 
@@ -125,18 +207,10 @@ babl_hash_table_init (BablHashValFunction  hfunc,
   htab = babl_calloc (sizeof (BablHashTable), 1);
   babl_set_destructor (htab, babl_hash_table_destroy);
 
-  htab->data_table = NULL;
-  htab->chain_table = NULL;
-  htab->mask = BABL_HASH_TABLE_INITIAL_MASK;
+  htab->slots = slots_new (BABL_HASH_TABLE_INITIAL_SIZE);
   htab->count = 0;
   htab->hash_func = hfunc;
   htab->find_func = ffunc;
-  if (htab->mask)
-  {
-      htab->data_table = babl_calloc (sizeof (BablInstance *), babl_hash_table_size(htab));
-      htab->chain_table = babl_malloc (sizeof (int) * babl_hash_table_size(htab));
-      memset (htab->chain_table, -1, sizeof (int) * babl_hash_table_size(htab));
-  }
 
   return htab;
 }
@@ -148,9 +222,12 @@ babl_hash_table_insert (BablHashTable *htab,
   babl_assert (htab);
   babl_assert (BABL_IS_BABL(item));
 
-  if (babl_hash_table_size (htab) < htab->count + 1)
-    hash_rehash (htab);
-  return hash_insert (htab, item);
+  /* keeping at most half of the slots filled keeps probe sequences short */
+  if ((htab->count + 1) * 2 > babl_hash_table_size (htab))
+    hash_grow (htab);
+  slots_add (htab->slots, hash_fingerprint (htab->hash_func (htab, item)), item);
+  htab->count++;
+  return 0;
 }
 
 Babl *
@@ -159,32 +236,65 @@ babl_hash_table_find (BablHashTable       *htab,
                       BablHashFindFunction find_func,
                       void                *data)
 {
-  int  it;
-  Babl *item;
-
   babl_assert (htab);
 
-  it = hash;
-  item = htab->data_table[it];
+  return hash_probe (htab, hash, HASH_FIND_FUNC,
+                     find_func ? find_func : htab->find_func, data, 0);
+}
 
-  if (!item)
-    return NULL;
+Babl *
+babl_hash_table_find_name (BablHashTable *htab,
+                           int            hash,
+                           const char    *name)
+{
+  return hash_probe (htab, hash, HASH_FIND_NAME, NULL, name, 0);
+}
 
-  for (;;)
+Babl *
+babl_hash_table_find_id (BablHashTable *htab,
+                         int            hash,
+                         int            id)
+{
+  return hash_probe (htab, hash, HASH_FIND_ID, NULL, NULL, id);
+}
+
+/* prints the distribution of probe lengths, the distances in slots of the
+ * items from the start of their first probed group, to stderr
+ */
+void
+babl_hash_table_report (BablHashTable *htab,
+                        const char    *name)
+{
+  BablHashSlots *slots     = __atomic_load_n (&htab->slots, __ATOMIC_ACQUIRE);
+  int            bins[7]   = {0,};
+  const char    *labels[7] = {"0", "1-3", "4-7", "8-15", "16-31", "32-63", "64+"};
+  unsigned int   longest   = 0;
+  unsigned int   total     = 0;
+  unsigned int   i;
+  int            bin;
+
+  for (i = 0; i <= slots->mask; i++)
     {
-      if (find_func)
-        {
-          if (find_func (item, data))
-            return item;
-        }
-      else if (htab->find_func (item, data))
-        return item;
-      it = htab->chain_table[it];
-      if (it == -1)
-        break;
-      item = htab->data_table[it];
+      unsigned int fingerprint = slots->fingerprint[i];
+      unsigned int distance;
+
+      if (!fingerprint)
+        continue;
+      distance = (i - (fingerprint & slots->mask & ~(BABL_HASH_TABLE_GROUP - 1))) &
+                 slots->mask;
+      bin = distance ? 1 : 0;
+      while (bin && bin < 6 && distance >= 4u << (bin - 1))
+        bin++;
+      bins[bin]++;
+      total += distance;
+      if (distance > longest)
+        longest = distance;
     }
 
-  return NULL;
+  fprintf (stderr, "%s: %i items in %i slots, mean probe length %.2f, longest %u\n",
+           name, htab->count, slots->mask + 1,
+           htab->count ? (double) total / htab->count : 0.0, longest);
+  for (bin = 0; bin < 7; bin++)
+    if (bins[bin])
+      fprintf (stderr, "  %6s: %i\n", labels[bin], bins[bin]);
 }
-
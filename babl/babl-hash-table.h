@@ -29,11 +29,25 @@ typedef struct _BablHashTable BablHashTable;
 typedef int  (*BablHashValFunction) (BablHashTable *htab, Babl *item);
 typedef int  (*BablHashFindFunction) (Babl *item, void *data);
 
+/* The slots of an open addressing table, probed linearly in groups of
+ * BABL_HASH_TABLE_GROUP. Each slot stores a fingerprint of the full hash
+ * of its item - never 0, which marks an empty slot - making probing a
+ * compare of 32bit integers, done for a whole group at a time where SIMD
+ * is available, before items are looked at.
+ */
+typedef struct _BablHashSlots BablHashSlots;
+
+typedef struct _BablHashSlots
+{
+  unsigned int    mask;
+  unsigned int   *fingerprint;
+  Babl          **item;
+  BablHashSlots  *old;       /* replaced slots, kept for concurrent readers */
+} _BablHashSlots;
+
 typedef struct _BablHashTable
 {
-  Babl                 **data_table;
-  int                  *chain_table;
-  int                  mask;
+  BablHashSlots       *slots;
   int                  count;
   BablHashValFunction  hash_func;
   BablHashFindFunction find_func;
@@ -44,6 +58,7 @@ BablHashTable *
 babl_hash_table_init (BablHashValFunction  hfunc,
                       BablHashFindFunction ffunc);
 
+/* the hash functions return full, unmasked, hashes */
 int
 babl_hash_by_str (BablHashTable *htab,
                   const char    *str);
@@ -59,10 +74,29 @@ int
 babl_hash_table_insert (BablHashTable *htab,
                         Babl          *item);
 
+/* calls find_func, or the find function of the table when NULL, for the
+ * items with a matching hash until it returns non 0.
+ */
 Babl *
 babl_hash_table_find (BablHashTable       *htab,
                       int                  hash,
                       BablHashFindFunction find_func,
                       void                *data);
 
+/* lookups of the first item with a given name or id, comparing inline */
+Babl *
+babl_hash_table_find_name (BablHashTable *htab,
+                           int            hash,
+                           const char    *name);
+
+Babl *
+babl_hash_table_find_id   (BablHashTable *htab,
+                           int            hash,
+                           int            id);
+
+/* diagnostic output of the probe lengths of the table */
+void
+babl_hash_table_report    (BablHashTable *htab,
+                           const char    *name);
+
 #endif
@@ -949,8 +949,46 @@ decode_string (ICC        *state,
 
 #ifdef HAVE_LCMS
 static cmsHPROFILE sRGBProfile = 0;
+
+static void
+delete_transform (cmsHTRANSFORM *transform)
+{
+  if (*transform)
+    cmsDeleteTransform (*transform);
+  *transform = NULL;
+}
+
+static int
+lcms_destroy_each (Babl *babl,
+                   void *user_data)
+{
+  if (babl->space.icc_type == BablICCTypeCMYK)
+    {
+      delete_transform (&babl->space.cmyk.lcms_to_rgba);
+      delete_transform (&babl->space.cmyk.lcms_from_rgba);
+      delete_transform (&babl->space.cmyk.lcms_to_rgba_float);
+      delete_transform (&babl->space.cmyk.lcms_from_rgba_float);
+      delete_transform (&babl->space.cmyk.lcms_to_rgba_u16);
+      delete_transform (&babl->space.cmyk.lcms_from_rgba_u16);
+    }
+  return 0;
+}
 #endif
 
+/* releases the lcms transforms of the CMYK spaces, called from babl_exit
+ * once no conversion using them can run anymore.
+ */
+void
+_babl_icc_lcms_destroy (void)
+{
+#ifdef HAVE_LCMS
+  babl_space_class_for_each (lcms_destroy_each, NULL);
+  if (sRGBProfile)
+    cmsCloseProfile (sRGBProfile);
+  sRGBProfile = 0;
+#endif
+}
+
 const Babl *
 babl_space_from_icc (const char   *icc_data,
                      int           icc_length,
@@ -1022,6 +1060,15 @@ babl_space_from_icc (const char   *icc_data,
 #endif
 #ifndef TYPE_RGBA_DBL
 #define TYPE_RGBA_DBL      (FLOAT_SH(1)|COLORSPACE_SH(PT_RGB)|EXTRA_SH(1)|CHANNELS_SH(3)|BYTES_SH(0))
+#endif
+#ifndef TYPE_CMYKA_FLT
+#define TYPE_CMYKA_FLT     (FLOAT_SH(1)|COLORSPACE_SH(PT_CMYK)|EXTRA_SH(1)|CHANNELS_SH(4)|BYTES_SH(4))
+#endif
+#ifndef TYPE_CMYKA_16
+#define TYPE_CMYKA_16      (COLORSPACE_SH(PT_CMYK)|EXTRA_SH(1)|CHANNELS_SH(4)|BYTES_SH(2))
+#endif
+#ifndef TYPE_RGBA_FLT
+#define TYPE_RGBA_FLT      (FLOAT_SH(1)|COLORSPACE_SH(PT_RGB)|EXTRA_SH(1)|CHANNELS_SH(3)|BYTES_SH(4))
 #endif
 
        ret->space.cmyk.lcms_to_rgba = cmsCreateTransform(ret->space.cmyk.lcms_profile, TYPE_CMYKA_DBL,
@@ -1032,6 +1079,21 @@ babl_space_from_icc (const char   *icc_data,
                                                       ret->space.cmyk.lcms_profile, TYPE_CMYKA_DBL,
                                                     INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_BLACKPOINTCOMPENSATION);
                                                     //  INTENT_PERCEPTUAL,0);//intent & 7, 0);
+
+       /* float and 16bit variants, used by the CMYK conversions of the
+        * space without staging pixels through doubles */
+       ret->space.cmyk.lcms_to_rgba_float = cmsCreateTransform(ret->space.cmyk.lcms_profile, TYPE_CMYKA_FLT,
+                                                    sRGBProfile, TYPE_RGBA_FLT,
+                                                    INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_BLACKPOINTCOMPENSATION);
+       ret->space.cmyk.lcms_from_rgba_float = cmsCreateTransform(sRGBProfile, TYPE_RGBA_FLT,
+                                                    ret->space.cmyk.lcms_profile, TYPE_CMYKA_FLT,
+                                                    INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_BLACKPOINTCOMPENSATION);
+       ret->space.cmyk.lcms_to_rgba_u16 = cmsCreateTransform(ret->space.cmyk.lcms_profile, TYPE_CMYKA_16,
+                                                    sRGBProfile, TYPE_RGBA_FLT,
+                                                    INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_BLACKPOINTCOMPENSATION);
+       ret->space.cmyk.lcms_from_rgba_u16 = cmsCreateTransform(sRGBProfile, TYPE_RGBA_FLT,
+                                                    ret->space.cmyk.lcms_profile, TYPE_CMYKA_16,
+                                                    INTENT_RELATIVE_COLORIMETRIC, cmsFLAGS_BLACKPOINTCOMPENSATION);
        cmsCloseProfile (ret->space.cmyk.lcms_profile); // XXX keep it open in case of CMYK to CMYK transforms needed?
 #endif
        ret->space.icc_type = BablICCTypeCMYK;
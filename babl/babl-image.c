@@ -26,11 +26,23 @@ static int
 babl_image_destruct (void *babl)
 {
   BablFormat *format = BABL (babl)->image.format;
+  BablModel  *model  = BABL (babl)->image.model;
   if (format && format->image_template == NULL)
     {
       format->image_template = babl;
       return -1; /* this should avoid freeing images created for formats,. */
     }
+  /* images of doubles for models, as made by babl_image_from_linear, are
+   * kept for reuse the same way */
+  if (!format && model)
+    {
+      Babl *expected = NULL;
+
+      if (__atomic_compare_exchange_n (&model->image_template, &expected,
+                                       babl, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return -1;
+    }
   return 0;
 }
 
@@ -155,6 +167,18 @@ babl_image_from_linear (char       *buffer,
       case BABL_MODEL:
         model      = (BablModel *) format;
         components = format->format.components;
+
+        babl = __atomic_exchange_n (&model->image_template, NULL,
+                                    __ATOMIC_ACQ_REL);
+        if (babl)
+          {
+            for (i = 0; i < components; i++)
+              {
+                babl->image.data[i] = buffer + offset;
+                offset   += (64 / 8);
+              }
+            return babl;
+          }
         for (i = 0; i < components; i++)
           {
             calc_pitch += (64 / 8);   /*< known to be double when we create from model */
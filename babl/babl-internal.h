@@ -382,6 +382,7 @@ const Babl *babl_trc_lut_find (float *lut, int lut_size);
 const Babl *babl_trc_lut      (const char *name, int n, float *entries);
 
 Babl * format_new_from_format_with_space (const Babl *format, const Babl *space);
+void   _babl_format_cache_clear (void);
 
 int babl_list_destroy (void *data);
 
@@ -390,6 +391,40 @@ babl_conversion_create_name (Babl *source, Babl *destination, int type,
                              int allow_collision);
 
 extern void (*_babl_space_add_universal_rgb) (const Babl *space);
+extern void (*_babl_space_add_cmyk) (const Babl *space);
+extern int (*_babl_do_lut) (uint32_t   *lut,
+                            int         source_bpp,
+                            int         dest_bpp,
+                            const void *__restrict__ source,
+                            void       *__restrict__ destination,
+                            long        n);
+extern int (*_babl_reference_to_float) (int         type_id,
+                                        const void *src,
+                                        float      *dst,
+                                        long        n);
+extern int (*_babl_reference_from_float) (int          type_id,
+                                          const float *src,
+                                          void        *dst,
+                                          long         n);
+extern void (*_babl_reference_matrix_buf4) (const float *matrix,
+                                            float       *rgba,
+                                            long         n);
+extern void (*_babl_palette_match_u8) (const uint8_t *palette,
+                                       int            count,
+                                       const uint8_t *rgba,
+                                       uint8_t       *idx,
+                                       long           n);
+extern void (*_babl_half_to_float_buf) (const uint16_t *src,
+                                        float          *dst,
+                                        long            n);
+extern void (*_babl_float_to_half_buf) (const float *src,
+                                        uint16_t    *dst,
+                                        long         n);
+
+/* the name of the SIMD variant of the base and extensions chosen for the
+ * CPU at init, "generic" when there is none
+ */
+const char *_babl_simd_variant (void);
 const Babl *
 babl_trc_formula_srgb (double gamma, double a, double b, double c, double d, double e, double f);
 const Babl *
@@ -447,6 +482,34 @@ void _babl_fish_missing_fast_path_warning (const Babl *source,
 void _babl_fish_rig_dispatch (Babl *babl);
 void _babl_fish_prepare_bpp (Babl *babl);
 
+/* lock-free lookup of the fish path for a pair of formats, NULL if there
+ * is none yet or it has not been looked up through babl_fish_path before.
+ */
+Babl *_babl_fish_path_lookup        (const Babl *source,
+                                     const Babl *destination);
+void  _babl_fish_path_table_destroy (void);
+
+/* looks up the component and sampling of the single component images the
+ * reference fishes convert through, once the base extension is loaded
+ */
+void  _babl_fish_reference_init (void);
+
+/* frees the CMYK to CMYK transforms cached by the reference fishes, and
+ * the scratch buffers of the calling thread
+ */
+void  _babl_fish_reference_cache_destroy (void);
+
+/* frees the lookup caches and inverse color map of the default palette */
+void  _babl_palette_default_destroy (void);
+
+/* size in bytes of the u8_lut of a fish path, whether it is filled
+ * lazily in 256 blocks - and releasing it, regardless of whether it
+ * was allocated or mapped from the LUT cache.
+ */
+long _babl_fish_lut_size      (const Babl *babl);
+int  _babl_fish_lut_is_sparse (const Babl *babl);
+void _babl_fish_lut_free      (Babl *babl);
+
 
 /* babl_space_to_icc:
  *
@@ -469,6 +532,9 @@ char *babl_space_to_icc (const Babl  *space,
 Babl *
 _babl_space_for_lcms (const char *icc_data, int icc_length); // XXX pass profile for dedup?
 
+void
+_babl_icc_lcms_destroy (void);
+
 void
 babl_trc_class_init (void);
 
@@ -31,6 +31,13 @@ static int
 babl_model_destroy (void *data)
 {
   Babl *babl = data;
+  if (babl->model.image_template != NULL)
+    {
+      babl_set_destructor (babl->model.image_template, NULL);
+      /* with no destructor set, the circular reference is no problem */
+      babl_free (babl->model.image_template);
+      babl->model.image_template = NULL;
+    }
   if (babl->model.from_list)
     babl_free (babl->model.from_list);
   return 0;
@@ -77,6 +84,7 @@ model_new (const char     *name,
   babl->model.data       = NULL;
   babl->model.model      = NULL;
   babl->model.flags      = flags;
+  babl->model.image_template = NULL;
   strcpy (babl->instance.name, name);
   memcpy (babl->model.component, component, sizeof (BablComponent *) * components);
 
@@ -481,6 +489,7 @@ babl_remodel_with_space (const Babl *model,
   memcpy (ret, model, sizeof (BablModel));
   ret->model.space = space;
   ret->model.model = (void*)model; /* use the data as a backpointer to original model */
+  ret->model.image_template = NULL;
   babl_remodels[babl_n_remodels++] = ret;
   babl_mutex_unlock (babl_remodel_mutex);
   return (Babl*)ret;
@@ -33,6 +33,8 @@ typedef struct
   const Babl       *space;
   void             *model;   /* back pointer to model with sRGB space */
   BablModelFlag     flags;
+  void             *image_template; /* image template for use with
+                                       linear (non-planer) images */
 } BablModel;
 
 #endif
@@ -26,22 +26,55 @@
 #include "babl-internal.h"
 #include "babl.h"
 #include "babl-memory.h"
+#include "babl-parallel.h"
 
-#ifdef HAVE_STDATOMIC_H
-#include <stdatomic.h>
-#define BABL_ATOMIC _Atomic
-#else
-#define BABL_ATOMIC
-#endif
-
-#define HASH_TABLE_SIZE 1111
-
+/* found colors are cached in sets of HASH_WAYS entries, each entry holds
+ * the palette index in its top 8 bits and the pixel it was found for in
+ * the lower 24 bits, so that entries are valid on their own also when
+ * threads converting to the palette update a set concurrently.
+ *
+ * Each palette has up to CACHE_SHARDS caches, made as threads first use
+ * them, with threads spread over them - so that threads converting to the
+ * same palette do not keep invalidating each other's entries and cache
+ * lines.
+ */
+#define HASH_SETS    1021
+#define HASH_WAYS    4
+#define CACHE_SHARDS 16
 
-typedef struct BablPaletteRadius
+/* pixels are matched in batches of this many, with the cache misses of a
+ * batch searched for together
+ */
+#define PALETTE_BATCH 256
+
+/* Palettes with more than GRID_MIN_COLORS colors get an inverse color map,
+ * made the first time a pixel is looked up: the RGB cube is divided into
+ * GRID_SIZE^3 cells, each listing the colors that can be the closest one
+ * for some pixel in the cell - those that come at least as near to the
+ * cell as the color whose furthest point of the cell is nearest - so
+ * that a cache miss is matched against a handful of colors instead of
+ * all of them.
+ */
+#define GRID_MIN_COLORS 32
+#define GRID_BITS       5
+#define GRID_SIZE       (1 << GRID_BITS)
+#define GRID_CELLS      (GRID_SIZE * GRID_SIZE * GRID_SIZE)
+#define GRID_SHIFT      (8 - GRID_BITS)
+#define GRID_JOB_CELLS  1024
+
+typedef struct BablPaletteGrid
+{
+  unsigned int   offset[GRID_CELLS + 1]; /* the colors of cell i are
+                                          * index[offset[i]] up to
+                                          * index[offset[i + 1]]
+                                          */
+  unsigned char *index;
+} BablPaletteGrid;
+
+typedef struct BablPaletteCache
 {
-  unsigned char  idx;
-  unsigned short diff;
-} BablPaletteRadius;
+  volatile unsigned int  hash[HASH_SETS][HASH_WAYS];
+} BablPaletteCache;
 
 typedef struct BablPalette
 {
@@ -52,13 +85,11 @@ typedef struct BablPalette
                                   */
   double                *data_double;
   unsigned char         *data_u8;
-  BablPaletteRadius     *BABL_ATOMIC radii;
-  volatile unsigned int  hash[HASH_TABLE_SIZE];
+  BablPaletteGrid       *grid;   /* made on first use, for large palettes */
+  BablPaletteCache      *caches[CACHE_SHARDS];
 } BablPalette;
 
 
-static unsigned short ceil_sqrt_u8[3 * 255 * 255 + 1];
-
 /* A default palette, containing standard ANSI / EGA colors
  *
  */
@@ -82,21 +113,8 @@ static unsigned char defpal_data[4*16] =
 255,255,255,255,
 };
 static double defpal_double[4*16];
-static BablPaletteRadius defpal_radii[15 * 16];
 
 
-static void
-init_ceil_sqrt_u8 (void)
-{
-  int i;
-
-  if (! ceil_sqrt_u8[1])
-    {
-      for (i = 0; i <= 3 * 255 * 255; i++)
-        ceil_sqrt_u8[i] = ceil (sqrt (i));
-    }
-}
-
 static inline int
 diff2_u8 (const unsigned char *p1,
           const unsigned char *p2)
@@ -106,191 +124,399 @@ diff2_u8 (const unsigned char *p1,
          ((int) p1[2] - (int) p2[2]) * ((int) p1[2] - (int) p2[2]);
 }
 
-static int
-babl_palette_radius_compare (const void *r1,
-                             const void *r2)
+/* the squared distances of a color to the nearest and the furthest point
+ * of a cell
+ */
+static inline void
+babl_palette_cell_range (const unsigned char *color,
+                         const int           *lo,
+                         int                 *near2,
+                         int                 *far2)
 {
-  const BablPaletteRadius *radius1 = r1;
-  const BablPaletteRadius *radius2 = r2;
+  int c;
 
-  return (int) radius1->diff - (int) radius2->diff;
+  *near2 = *far2 = 0;
+  for (c = 0; c < 3; c++)
+    {
+      int hi   = lo[c] + (1 << GRID_SHIFT) - 1;
+      int near = color[c] < lo[c] ? lo[c] - color[c] :
+                 color[c] > hi    ? color[c] - hi    : 0;
+      int far  = color[c] - lo[c] > hi - color[c] ? color[c] - lo[c] :
+                                                    hi - color[c];
+
+      *near2 += near * near;
+      *far2  += far * far;
+    }
 }
 
-static void
-babl_palette_init_radii (BablPalette       *pal,
-                         BablPaletteRadius *radii)
+/* lists the candidates of a cell in index, returning their number, with
+ * index NULL they are only counted
+ */
+static int
+babl_palette_cell_candidates (const BablPalette *pal,
+                              int                cell,
+                              unsigned char     *index)
 {
-  int i, j;
-
-  /* calculate the distance between each pair of colors in the palette, and, for
-   * each color, construct a list of all other colors and their distances from
-   * it, sorted by distance.  we use these lists in babl_palette_lookup() to
-   * speed up the search, as described in the function.
-   */
-
-  for (i = 0; i < pal->count; i++)
+  int lo[3] = { (cell & (GRID_SIZE - 1)) << GRID_SHIFT,
+                ((cell >> GRID_BITS) & (GRID_SIZE - 1)) << GRID_SHIFT,
+                (cell >> (GRID_BITS * 2)) << GRID_SHIFT };
+  int near2[256];
+  int bound = INT_MAX;
+  int n = 0;
+  int j;
+
+  for (j = 0; j < pal->count; j++)
     {
-      BablPaletteRadius   *radii1 = radii + (pal->count - 1) * i;
-      const unsigned char *p1     = pal->data_u8 + 4 * i;
+      int far2;
 
-      for (j = i + 1; j < pal->count; j++)
-        {
-          BablPaletteRadius   *radii2 = radii + (pal->count - 1) * j;
-          const unsigned char *p2     = pal->data_u8 + 4 * j;
-          unsigned short       diff;
+      babl_palette_cell_range (pal->data_u8 + 4 * j, lo, &near2[j], &far2);
+      if (far2 < bound)
+        bound = far2;
+    }
 
-          diff = floor (sqrt (diff2_u8 (p1, p2)));
+  for (j = 0; j < pal->count; j++)
+    if (near2[j] <= bound)
+      {
+        if (index)
+          index[n] = j;
+        n++;
+      }
+  return n;
+}
 
-          radii1[j - 1].idx  = j;
-          radii1[j - 1].diff = diff;
+typedef struct
+{
+  const BablPalette *pal;
+  BablPaletteGrid   *grid;
+} GridJob;
 
-          radii2[i].idx      = i;
-          radii2[i].diff     = diff;
-        }
+static void
+babl_palette_grid_count_job (int   job,
+                             int   n_jobs,
+                             void *user_data)
+{
+  GridJob *data = user_data;
+  int      cell;
 
-      qsort (radii1, pal->count - 1, sizeof (BablPaletteRadius),
-             babl_palette_radius_compare);
-    }
+  for (cell = job * GRID_JOB_CELLS; cell < (job + 1) * GRID_JOB_CELLS; cell++)
+    data->grid->offset[cell + 1] =
+      babl_palette_cell_candidates (data->pal, cell, NULL);
 }
 
-static BablPaletteRadius *
-babl_palette_create_radii (BablPalette *pal)
+static void
+babl_palette_grid_fill_job (int   job,
+                            int   n_jobs,
+                            void *user_data)
 {
-  BablPaletteRadius *radii;
+  GridJob *data = user_data;
+  int      cell;
 
-  radii = babl_malloc (sizeof (BablPaletteRadius) *
-                       (pal->count - 1)           *
-                       pal->count);
+  for (cell = job * GRID_JOB_CELLS; cell < (job + 1) * GRID_JOB_CELLS; cell++)
+    babl_palette_cell_candidates (data->pal, cell,
+                                  data->grid->index + data->grid->offset[cell]);
+}
 
-  babl_palette_init_radii (pal, radii);
+static BablPaletteGrid *
+babl_palette_create_grid (const BablPalette *pal)
+{
+  BablPaletteGrid *grid = babl_malloc (sizeof (BablPaletteGrid));
+  GridJob          data = { pal, grid };
+  int              cell;
+
+  /* the cells are counted, then filled in once their offsets are known */
+  grid->offset[0] = 0;
+  babl_parallel_distribute (GRID_CELLS / GRID_JOB_CELLS,
+                            babl_palette_grid_count_job, &data);
+  for (cell = 0; cell < GRID_CELLS; cell++)
+    grid->offset[cell + 1] += grid->offset[cell];
+
+  grid->index = babl_malloc (grid->offset[GRID_CELLS]);
+  babl_parallel_distribute (GRID_CELLS / GRID_JOB_CELLS,
+                            babl_palette_grid_fill_job, &data);
+  return grid;
+}
 
-  return radii;
+static void
+babl_palette_free_grid (BablPaletteGrid *grid)
+{
+  if (!grid)
+    return;
+  babl_free (grid->index);
+  babl_free (grid);
 }
 
-static const BablPaletteRadius *
-babl_palette_get_radii (BablPalette *pal,
-                        int          entry)
+static const BablPaletteGrid *
+babl_palette_get_grid (BablPalette *pal)
 {
-  BablPaletteRadius *radii;
+  BablPaletteGrid *grid = __atomic_load_n (&pal->grid, __ATOMIC_ACQUIRE);
+  BablPaletteGrid *expected = NULL;
 
-#ifdef HAVE_STDATOMIC_H
-  radii = atomic_load_explicit (&pal->radii, memory_order_consume);
+  if (grid || pal->count <= GRID_MIN_COLORS)
+    return grid;
 
-  if (! radii)
+  grid = babl_palette_create_grid (pal);
+  if (!__atomic_compare_exchange_n (&pal->grid, &expected, grid, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
     {
-      BablPaletteRadius *existing_radii;
+      /* another thread got there first */
+      babl_palette_free_grid (grid);
+      grid = expected;
+    }
+  return grid;
+}
 
-      existing_radii = NULL;
-      radii          = babl_palette_create_radii (pal);
+/* the closest of the candidates of the pixel's cell, ties going to the
+ * lowest index like with _babl_palette_match_u8
+ */
+static inline int
+babl_palette_grid_match (const BablPalette     *pal,
+                         const BablPaletteGrid *grid,
+                         const unsigned char   *p)
+{
+  int cell = (p[0] >> GRID_SHIFT) |
+             ((p[1] >> GRID_SHIFT) << GRID_BITS) |
+             ((p[2] >> GRID_SHIFT) << (GRID_BITS * 2));
+  int best = INT_MAX;
+  unsigned int k;
 
-      if (! atomic_compare_exchange_strong_explicit (&pal->radii,
-                                                     &existing_radii, radii,
-                                                     memory_order_acq_rel,
-                                                     memory_order_consume))
-        {
-          babl_free (radii);
+  for (k = grid->offset[cell]; k < grid->offset[cell + 1]; k++)
+    {
+      int j   = grid->index[k];
+      int key = (diff2_u8 (p, pal->data_u8 + 4 * j) << 8) | j;
 
-          radii = existing_radii;
-        }
+      if (key < best)
+        best = key;
     }
+  return best & 0xff;
+}
+
+static BablPaletteCache *
+babl_palette_create_cache (void)
+{
+  BablPaletteCache *cache = babl_malloc (sizeof (BablPaletteCache));
+  int i, j;
+
+  for (i = 0; i < HASH_SETS; i++)
+    for (j = 0; j < HASH_WAYS; j++)
+      {
+        cache->hash[i][j] = i + 1; /* always a miss */
+      }
+  return cache;
+}
+
+/* the shard of the calling thread, threads are numbered in the order they
+ * first convert to a palette
+ */
+static int
+babl_palette_cache_shard (void)
+{
+#ifdef HAVE_TLS
+  static int            n_threads = 0;
+  static __thread int   shard     = -1;
+
+  if (shard < 0)
+    shard = __atomic_fetch_add (&n_threads, 1, __ATOMIC_RELAXED) % CACHE_SHARDS;
+  return shard;
 #else
-  radii = pal->radii;
+  return 0;
 #endif
+}
+
+static BablPaletteCache *
+babl_palette_get_cache (BablPalette *pal)
+{
+  BablPaletteCache **slot = &pal->caches[babl_palette_cache_shard ()];
+  BablPaletteCache  *cache = __atomic_load_n (slot, __ATOMIC_ACQUIRE);
+  BablPaletteCache  *expected = NULL;
+
+  if (cache)
+    return cache;
 
-  return radii + (pal->count - 1) * entry;
+  cache = babl_palette_create_cache ();
+  if (!__atomic_compare_exchange_n (slot, &expected, cache, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      /* another thread got there first */
+      babl_free (cache);
+      cache = expected;
+    }
+  return cache;
 }
 
 static void
-babl_palette_reset_hash (BablPalette *pal)
+babl_palette_free_caches (BablPalette *pal)
 {
   int i;
-  for (i = 0; i < HASH_TABLE_SIZE; i++)
+
+  for (i = 0; i < CACHE_SHARDS; i++)
     {
-      pal->hash[i] = i + 1; /* always a miss */
+      babl_free (pal->caches[i]);
+      pal->caches[i] = NULL;
     }
 }
 
 #define BABL_IDX_FACTOR 255.5
 
-static int
-babl_palette_lookup (BablPalette         *pal,
-                     const unsigned char *p,
-                     int                  best_idx)
-{
-  unsigned int pixel      = p[0] | (p[1] << 8) | (p[2] << 16);
-  int          hash_index = pixel % HASH_TABLE_SIZE;
-  unsigned int hash_value = pal->hash[hash_index];
-  unsigned int hash_pixel = hash_value & 0x00ffffffu;
-  int          idx        = hash_value >> 24;
-
-  /* note:  we're assuming the palette has no more than 256 colors, otherwise
-   * the index doesn't fit in the top 8 bits of the hash-table value.  since
-   * we're only using this functions with u8 palette formats, there's no need
-   * to actually verify this, but if we add wider formats in the future, it's
-   * something to be aware of.
-   */
-
-  if (pixel == hash_pixel)
+static inline int
+babl_palette_cache_get (BablPaletteCache *cache,
+                        unsigned int      pixel)
+{
+  volatile unsigned int *set = cache->hash[pixel % HASH_SETS];
+  int                    i;
+
+  for (i = 0; i < HASH_WAYS; i++)
     {
-      return idx;
+      unsigned int hash_value = set[i];
+
+      if ((hash_value & 0x00ffffffu) == pixel)
+        return hash_value >> 24;
     }
-  else
+  return -1;
+}
+
+static inline void
+babl_palette_cache_put (BablPaletteCache *cache,
+                        unsigned int      pixel,
+                        int               idx)
+{
+  volatile unsigned int *set = cache->hash[pixel % HASH_SETS];
+  int                    i;
+
+  /* the most recently found color goes first, the oldest one is dropped */
+  for (i = HASH_WAYS - 1; i > 0; i--)
+    set[i] = set[i - 1];
+  set[0] = ((unsigned int) idx << 24) | pixel;
+}
+
+/* finds the palette entries closest to n R'G'B'A u8 pixels, writing them
+ * idx_stride bytes apart.
+ *
+ * note:  we're assuming the palette has no more than 256 colors, otherwise
+ * the index doesn't fit in the top 8 bits of the hash-table value.  since
+ * we're only using this functions with u8 palette formats, there's no need
+ * to actually verify this, but if we add wider formats in the future, it's
+ * something to be aware of.
+ */
+static void
+babl_palette_lookup_buf (BablPalette         *pal,
+                         const unsigned char *rgba,
+                         unsigned char       *idx,
+                         int                  idx_stride,
+                         long                 n)
+{
+  BablPaletteCache *cache = babl_palette_get_cache (pal);
+
+  while (n > 0)
     {
-      const BablPaletteRadius *radii = babl_palette_get_radii (pal, best_idx);
-      const unsigned char     *q;
-      int                      best_diff2;
-      int                      best_diff;
-      int                      diff0;
-      int                      i;
-
-      /* best_idx is the closest palette entry to the previous pixel (referred
-       * to as the source color).  based on the assumption that nearby pixels
-       * have similar color, we start the search for the current closest entry
-       * at best_idx, and iterate over the entry's color list, as calculated in
-       * babl_palette_init_radii(), in search for a better match.
+      unsigned char miss_rgba[PALETTE_BATCH * 4];
+      unsigned char miss_idx[PALETTE_BATCH];
+      short         slot[PALETTE_BATCH];
+      int           batch    = n < PALETTE_BATCH ? n : PALETTE_BATCH;
+      int           n_miss   = 0;
+      unsigned int  previous = 0xffffffffu;
+      int           i;
+
+      /* cached pixels are done right away, the others get a slot in the
+       * batch searched for below, which runs of a pixel share
        */
+      for (i = 0; i < batch; i++)
+        {
+          const unsigned char *p     = rgba + i * 4;
+          unsigned int         pixel = p[0] | (p[1] << 8) | (p[2] << 16);
+          int                  found;
 
-      q          = pal->data_u8 + 4 * best_idx;
-      best_diff2 = diff2_u8 (p, q);
-      best_diff  = ceil_sqrt_u8[best_diff2];
-      diff0      = best_diff;
+          if (pixel == previous)
+            {
+              slot[i] = slot[i - 1];
+              if (slot[i] < 0)
+                idx[i * idx_stride] = idx[(i - 1) * idx_stride];
+              continue;
+            }
+          previous = pixel;
+
+          found = babl_palette_cache_get (cache, pixel);
+          if (found >= 0)
+            {
+              idx[i * idx_stride] = found;
+              slot[i] = -1;
+            }
+          else
+            {
+              memcpy (miss_rgba + n_miss * 4, p, 4);
+              slot[i] = n_miss++;
+            }
+        }
 
-      for (i = 0; i < pal->count - 1; i++)
+      if (n_miss)
         {
-          const BablPaletteRadius *radius = &radii[i];
-          int                      min_diff;
-          int                      diff2;
-
-          /* radius->diff is the distance from the source color to the current
-           * color.  diff0 is the distance from the source color to the input
-           * color.  according to the triangle inequality, the distance from
-           * the current color to the input color is at least
-           * radius->diff - diff0.  if the shortest distance found so far is
-           * less than that, then the best match found so far is necessarily
-           * better than the current color, and we can stop the search, since
-           * the color list is sorted in ascending radius->diff order.
-           */
-
-          idx      = radius->idx;
-          min_diff = radius->diff - diff0;
-
-          if (best_diff < min_diff || (best_diff == min_diff && best_idx < idx))
-            break;
-
-          q     = pal->data_u8 + 4 * idx;
-          diff2 = diff2_u8 (p, q);
-
-          if (diff2 < best_diff2 || (diff2 == best_diff2 && idx < best_idx))
+          const BablPaletteGrid *grid = babl_palette_get_grid (pal);
+
+          if (grid)
             {
-              best_idx   = idx;
-              best_diff2 = diff2;
-              best_diff  = ceil_sqrt_u8[diff2];
+              for (i = 0; i < n_miss; i++)
+                miss_idx[i] = babl_palette_grid_match (pal, grid,
+                                                       miss_rgba + i * 4);
             }
+          else
+            {
+              _babl_palette_match_u8 (pal->data_u8, pal->count,
+                                      miss_rgba, miss_idx, n_miss);
+            }
+
+          for (i = 0; i < n_miss; i++)
+            {
+              const unsigned char *p = miss_rgba + i * 4;
+
+              babl_palette_cache_put (cache,
+                                      p[0] | (p[1] << 8) | (p[2] << 16),
+                                      miss_idx[i]);
+            }
+
+          for (i = 0; i < batch; i++)
+            if (slot[i] >= 0)
+              idx[i * idx_stride] = miss_idx[slot[i]];
         }
 
-      pal->hash[hash_index] = ((unsigned int) best_idx << 24) | pixel;
+      rgba += batch * 4;
+      idx  += batch * idx_stride;
+      n    -= batch;
+    }
+}
+
+/* encodes up to PALETTE_BATCH RGBA float pixels with the TRC of the
+ * palette space, as the R'G'B'A u8 the palette is matched with
+ */
+static void
+babl_palette_encode (const Babl    *space,
+                     const float   *src,
+                     unsigned char *dst,
+                     long           n)
+{
+  float encoded[PALETTE_BATCH * 4];
+  long  i;
+  int   c;
+
+  babl_trc_from_linear_buf (space->space.trc[0], src, encoded, 4, 4, 3, n);
 
-      return best_idx;
+  for (i = 0; i < n; i++)
+    {
+      for (c = 0; c < 3; c++)
+        {
+          float value = src[i * 4 + c];
+
+          if (value >= 1.0f)
+            dst[i * 4 + c] = 255;
+          else if (value <= 0.0f)
+            dst[i * 4 + c] = 0;
+          else
+            dst[i * 4 + c] = encoded[i * 4 + c] * 255 + 0.5f;
+        }
+      if (src[i * 4 + 3] >= 1.0f)
+        dst[i * 4 + 3] = 255;
+      else if (src[i * 4 + 3] <= 0.0f)
+        dst[i * 4 + 3] = 0;
+      else
+        dst[i * 4 + 3] = src[i * 4 + 3] * 255 + 0.5f;
     }
 }
 
@@ -311,7 +537,8 @@ make_pal (const Babl *pal_space,
   pal->data = babl_malloc (bpp * count);
   pal->data_double = babl_malloc (4 * sizeof(double) * count);
   pal->data_u8 = babl_malloc (4 * sizeof(char) * count);
-  pal->radii = NULL;
+  pal->grid = NULL;
+  memset (pal->caches, 0, sizeof (pal->caches));
 
   memcpy (pal->data, data, bpp * count);
 
@@ -320,12 +547,6 @@ make_pal (const Babl *pal_space,
   babl_process (babl_fish (format, babl_format_with_space ("R'G'B'A u8", pal_space)),
                 data, pal->data_u8, count);
 
-#ifndef HAVE_STDATOMIC_H
-  pal->radii = babl_palette_create_radii (pal);
-#endif
-
-  babl_palette_reset_hash (pal);
-
   return pal;
 }
 
@@ -335,50 +556,99 @@ babl_palette_free (BablPalette *pal)
   babl_free (pal->data);
   babl_free (pal->data_double);
   babl_free (pal->data_u8);
-  babl_free (pal->radii);
+  babl_palette_free_grid (pal->grid);
+  babl_palette_free_caches (pal);
   babl_free (pal);
 }
 
+static BablPalette default_pal;
+static int         default_pal_inited = 0;
+
 static BablPalette *
 default_palette (void)
 {
-  static BablPalette pal;
-  static int inited = 0;
-
   babl_mutex_lock (babl_format_mutex);
 
-  if (inited)
+  if (default_pal_inited)
     {
       babl_mutex_unlock (babl_format_mutex);
 
-      return &pal;
+      return &default_pal;
     }
 
-  init_ceil_sqrt_u8 ();
+  memset (&default_pal, 0, sizeof (default_pal));
+  default_pal.count = 16;
+  default_pal.format = babl_format ("R'G'B'A u8"); /* dynamically generated,
+                                                      so the default palette
+                                                      can not be fully static.
+                                                    */
+  default_pal.data = defpal_data;
+  default_pal.data_double = defpal_double;
+  default_pal.data_u8 = defpal_data;
 
-  memset (&pal, 0, sizeof (pal));
-  pal.count = 16;
-  pal.format = babl_format ("R'G'B'A u8"); /* dynamically generated, so
-                                              the default palette can
-                                              not be fully static.
-                                            */
-  pal.data = defpal_data;
-  pal.data_double = defpal_double;
-  pal.data_u8 = defpal_data;
-  pal.radii = defpal_radii;
+  babl_process (babl_fish (default_pal.format, babl_format ("RGBA double")),
+                default_pal.data, default_pal.data_double, default_pal.count);
 
-  babl_process (babl_fish (pal.format, babl_format ("RGBA double")),
-                pal.data, pal.data_double, pal.count);
+  default_pal_inited = 1;
 
-  babl_palette_init_radii (&pal, pal.radii);
+  babl_mutex_unlock (babl_format_mutex);
 
-  babl_palette_reset_hash (&pal);
+  return &default_pal;
+}
 
-  inited = 1;
+void
+_babl_palette_default_destroy (void)
+{
+  if (!default_pal_inited)
+    return;
+  babl_palette_free_grid (default_pal.grid);
+  default_pal.grid = NULL;
+  babl_palette_free_caches (&default_pal);
+  default_pal_inited = 0;
+}
 
-  babl_mutex_unlock (babl_format_mutex);
+/* matches RGBA double pixels, storing the found indices as doubles, with
+ * their alpha too when with_alpha is set
+ */
+static void
+rgba_double_to_pal (const Babl   *space,
+                    BablPalette  *pal,
+                    const double *src,
+                    double       *dst,
+                    long          n,
+                    int           with_alpha)
+{
+  while (n > 0)
+    {
+      float         rgba[PALETTE_BATCH * 4];
+      unsigned char rgba_u8[PALETTE_BATCH * 4];
+      unsigned char idx[PALETTE_BATCH];
+      long          batch = n < PALETTE_BATCH ? n : PALETTE_BATCH;
+      long          i;
+
+      for (i = 0; i < batch * 4; i++)
+        rgba[i] = src[i];
+
+      babl_palette_encode (space, rgba, rgba_u8, batch);
+      babl_palette_lookup_buf (pal, rgba_u8, idx, 1, batch);
 
-  return &pal;
+      for (i = 0; i < batch; i++)
+        {
+          if (with_alpha)
+            {
+              dst[i * 2 + 0] = idx[i] / BABL_IDX_FACTOR;
+              dst[i * 2 + 1] = src[i * 4 + 3];
+            }
+          else
+            {
+              dst[i] = idx[i] / BABL_IDX_FACTOR;
+            }
+        }
+
+      src += batch * 4;
+      dst += batch * (with_alpha ? 2 : 1);
+      n   -= batch;
+    }
 }
 
 static void
@@ -391,41 +661,11 @@ rgba_to_pal (Babl *conversion,
   const Babl *space = babl_conversion_get_source_space (conversion);
   BablPalette **palptr = dst_model_data;
   BablPalette *pal;
-  int best_idx = 0;
   assert (palptr);
   pal = *palptr;
   assert(pal);
 
-  while (n--)
-    {
-      double *src_d = (void*) src_b;
-      unsigned char src[4];
-      int c;
-      for (c = 0; c < 3; c++)
-      {
-        if (src_d[c] >= 1.0f)
-          src[c] = 255;
-        else if (src_d[c] <= 0.0f)
-          src[c] = 0;
-        else
-          src[c] = babl_trc_from_linear (space->space.trc[0],
-                                         src_d[c]) * 255 + 0.5f;
-      }
-      if (src_d[3] >= 1.0f)
-        src[3] = 255;
-      else if (src_d[3] <= 0.0f)
-        src[3] = 0;
-      else
-        src[3] = src_d[3] * 255 + 0.5f;
-
-      best_idx = babl_palette_lookup (pal, src, best_idx);
-
-      ((double *) dst)[0] = best_idx / BABL_IDX_FACTOR;
-
-      src_b += sizeof (double) * 4;
-      dst += sizeof (double) * 1;
-    }
-
+  rgba_double_to_pal (space, pal, (void*) src_b, (void*) dst, n, 0);
 }
 
 static void
@@ -438,41 +678,11 @@ rgba_to_pala (Babl *conversion,
   const Babl *space = babl_conversion_get_destination_space (conversion);
   BablPalette **palptr = dst_model_data;
   BablPalette *pal;
-  int best_idx = 0;
   assert (palptr);
   pal = *palptr;
   assert(pal);
 
-  while (n--)
-    {
-      double *src_d = (void*) src_i;
-      unsigned char src[4];
-      int c;
-      for (c = 0; c < 3; c++)
-      {
-        if (src_d[c] >= 1.0f)
-          src[c] = 255;
-        else if (src_d[c] <= 0.0f)
-          src[c] = 0;
-        else
-          src[c] = babl_trc_from_linear (space->space.trc[0],
-                                         src_d[c]) * 255 + 0.5f;
-      }
-      if (src_d[3] >= 1.0f)
-        src[3] = 255;
-      else if (src_d[3] <= 0.0f)
-        src[3] = 0;
-      else
-        src[3] = src_d[3] * 255 + 0.5f;
-
-      best_idx = babl_palette_lookup (pal, src, best_idx);
-
-      ((double *) dst)[0] = best_idx / BABL_IDX_FACTOR;
-      ((double *) dst)[1] = src_d[3];
-
-      src_i += sizeof (double) * 4;
-      dst += sizeof (double) * 2;
-    }
+  rgba_double_to_pal (space, pal, (void*) src_i, (void*) dst, n, 1);
 }
 
 static void
@@ -544,39 +754,26 @@ rgba_float_to_pal_a (Babl          *conversion,
   const Babl *space = babl_conversion_get_destination_space (conversion);
   BablPalette **palptr = src_model_data;
   BablPalette *pal;
-  int best_idx = 0;
+  const float *src_f = (void*) src_b;
   assert (palptr);
   pal = *palptr;
   assert(pal);
 
-  while (n--)
+  while (n > 0)
     {
-      float *src_f = (void*) src_b;
-      unsigned char src[4];
-      int c;
-      for (c = 0; c < 3; c++)
-      {
-        if (src_f[c] >= 1.0f)
-          src[c] = 255;
-        else if (src_f[c] <= 0.0f)
-          src[c] = 0;
-        else
-          src[c] = babl_trc_from_linear (space->space.trc[0],
-                                         src_f[c]) * 255 + 0.5f;
-      }
-      if (src_f[3] >= 1.0f)
-        src[3] = 255;
-      else if (src_f[3] <= 0.0f)
-        src[3] = 0;
-      else
-        src[3] = src_f[3] * 255 + 0.5f;
+      unsigned char rgba_u8[PALETTE_BATCH * 4];
+      long          batch = n < PALETTE_BATCH ? n : PALETTE_BATCH;
+      long          i;
 
+      babl_palette_encode (space, src_f, rgba_u8, batch);
+      babl_palette_lookup_buf (pal, rgba_u8, dst, 2, batch);
 
-      dst[0] = best_idx = babl_palette_lookup (pal, src, best_idx);
-      dst[1] = src[3];
+      for (i = 0; i < batch; i++)
+        dst[i * 2 + 1] = rgba_u8[i * 4 + 3];
 
-      src_b += sizeof (float) * 4;
-      dst += sizeof (char) * 2;
+      src_f += batch * 4;
+      dst   += batch * 2;
+      n     -= batch;
     }
 }
 
@@ -591,37 +788,22 @@ rgba_float_to_pal (Babl          *conversion,
   const Babl *space = babl_conversion_get_destination_space (conversion);
   BablPalette **palptr = src_model_data;
   BablPalette *pal;
-  int best_idx = 0;
+  const float *src_f = (void*) src_b;
   assert (palptr);
   pal = *palptr;
   assert(pal);
 
-  while (n--)
+  while (n > 0)
     {
-      float *src_f = (void*) src_b;
-      unsigned char src[4];
-      int c;
-      for (c = 0; c < 3; c++)
-      {
-        if (src_f[c] >= 1.0f)
-          src[c] = 255;
-        else if (src_f[c] <= 0.0f)
-          src[c] = 0;
-        else
-          src[c] = babl_trc_from_linear (space->space.trc[0],
-                                         src_f[c]) * 255 + 0.5f;
-      }
-      if (src_f[3] >= 1.0f)
-        src[3] = 255;
-      else if (src_f[3] <= 0.0f)
-        src[3] = 0;
-      else
-        src[3] = src_f[3] * 255 + 0.5f;
+      unsigned char rgba_u8[PALETTE_BATCH * 4];
+      long          batch = n < PALETTE_BATCH ? n : PALETTE_BATCH;
 
-      dst[0] = best_idx = babl_palette_lookup (pal, src, best_idx);
+      babl_palette_encode (space, src_f, rgba_u8, batch);
+      babl_palette_lookup_buf (pal, rgba_u8, dst, 1, batch);
 
-      src_b += sizeof (float) * 4;
-      dst += sizeof (char) * 1;
+      src_f += batch * 4;
+      dst   += batch;
+      n     -= batch;
     }
 }
 
@@ -634,18 +816,11 @@ rgba_u8_to_pal (Babl          *conversion,
 {
   BablPalette **palptr = src_model_data;
   BablPalette *pal;
-  int best_idx = 0;
   assert (palptr);
   pal = *palptr;
   assert(pal);
 
-  while (n--)
-    {
-      dst[0] = best_idx = babl_palette_lookup (pal, src, best_idx);
-
-      src += sizeof (char) * 4;
-      dst += sizeof (char) * 1;
-    }
+  babl_palette_lookup_buf (pal, src, dst, 1, n);
 }
 
 static void
@@ -657,18 +832,14 @@ rgba_u8_to_pal_a (Babl          *conversion,
 {
   BablPalette **palptr = src_model_data;
   BablPalette *pal;
-  int best_idx = 0;
+  long i;
   assert (palptr);
   pal = *palptr;
   assert(pal);
-  while (n--)
-    {
-      dst[0] = best_idx = babl_palette_lookup (pal, src, best_idx);
-      dst[1] = src[3];
 
-      src += sizeof (char) * 4;
-      dst += sizeof (char) * 2;
-    }
+  babl_palette_lookup_buf (pal, src, dst, 2, n);
+  for (i = 0; i < n; i++)
+    dst[i * 2 + 1] = src[i * 4 + 3];
 }
 
 static long
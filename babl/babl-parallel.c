@@ -0,0 +1,235 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "babl-internal.h"
+#include "babl-parallel.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define BABL_PARALLEL_MAX_THREADS 64
+
+static int
+parallel_n_threads (void)
+{
+  static int n_threads = 0;
+
+  if (n_threads)
+    return n_threads;
+
+  if (getenv ("BABL_THREADS"))
+    n_threads = atoi (getenv ("BABL_THREADS"));
+  else
+    {
+#if defined(_WIN32)
+      n_threads = 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+      n_threads = sysconf (_SC_NPROCESSORS_ONLN);
+#else
+      n_threads = 1;
+#endif
+    }
+
+  if (n_threads < 1)
+    n_threads = 1;
+  else if (n_threads > BABL_PARALLEL_MAX_THREADS)
+    n_threads = BABL_PARALLEL_MAX_THREADS;
+  return n_threads;
+}
+
+#ifndef _WIN32
+
+/* The pool runs one batch of jobs at a time, a generation counter wakes up
+ * the workers, which then pick job indices from a shared atomic counter
+ * until they run out; the dispatching thread does the same and waits for
+ * the busy workers before returning.
+ */
+typedef struct BablParallelPool
+{
+  pthread_mutex_t   dispatch_mutex; /* held for the duration of a batch */
+  pthread_mutex_t   mutex;
+  pthread_cond_t    wake_cond;
+  pthread_cond_t    done_cond;
+  pthread_t         threads[BABL_PARALLEL_MAX_THREADS];
+  int               n_workers;
+  int               started;
+  int               quit;
+  long              generation;
+  int               busy;
+
+  BablParallelFunc  func;
+  void             *user_data;
+  int               n_jobs;
+  int               next_job;
+} BablParallelPool;
+
+static BablParallelPool pool = {
+  PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+};
+
+static void
+parallel_run_jobs (BablParallelFunc  func,
+                   void             *user_data,
+                   int               n_jobs)
+{
+  int job;
+
+  if (n_jobs <= 0)
+    return;
+
+  while ((job = __atomic_fetch_add (&pool.next_job, 1, __ATOMIC_ACQ_REL)) < n_jobs)
+    func (job, n_jobs, user_data);
+}
+
+static void *
+parallel_worker (void *data)
+{
+  long seen = 0;
+
+  pthread_mutex_lock (&pool.mutex);
+  while (1)
+    {
+      BablParallelFunc  func;
+      void             *user_data;
+      int               n_jobs;
+
+      while (seen == pool.generation && !pool.quit)
+        pthread_cond_wait (&pool.wake_cond, &pool.mutex);
+      if (pool.quit)
+        break;
+
+      seen      = pool.generation;
+      func      = pool.func;
+      user_data = pool.user_data;
+      n_jobs    = pool.n_jobs;
+      pool.busy++;
+      pthread_mutex_unlock (&pool.mutex);
+
+      parallel_run_jobs (func, user_data, n_jobs);
+
+      pthread_mutex_lock (&pool.mutex);
+      if (--pool.busy == 0)
+        pthread_cond_signal (&pool.done_cond);
+    }
+  pthread_mutex_unlock (&pool.mutex);
+  return NULL;
+}
+
+static void
+parallel_start (void)
+{
+  int n_workers = parallel_n_threads () - 1;
+
+  pool.quit = 0;
+  pool.n_workers = 0;
+  for (int i = 0; i < n_workers; i++)
+    {
+      if (pthread_create (&pool.threads[pool.n_workers], NULL,
+                          parallel_worker, NULL) == 0)
+        pool.n_workers++;
+    }
+  pool.started = 1;
+}
+
+void
+babl_parallel_distribute (int               n_jobs,
+                          BablParallelFunc  func,
+                          void             *user_data)
+{
+  if (n_jobs <= 1 ||
+      parallel_n_threads () <= 1 ||
+      pthread_mutex_trylock (&pool.dispatch_mutex) != 0)
+    {
+      for (int job = 0; job < n_jobs; job++)
+        func (job, n_jobs, user_data);
+      return;
+    }
+
+  pthread_mutex_lock (&pool.mutex);
+  if (!pool.started)
+    parallel_start ();
+  pool.func      = func;
+  pool.user_data = user_data;
+  pool.n_jobs    = n_jobs;
+  pool.next_job  = 0;
+  pool.generation++;
+  pthread_cond_broadcast (&pool.wake_cond);
+  pthread_mutex_unlock (&pool.mutex);
+
+  parallel_run_jobs (func, user_data, n_jobs);
+
+  pthread_mutex_lock (&pool.mutex);
+  while (pool.busy > 0)
+    pthread_cond_wait (&pool.done_cond, &pool.mutex);
+  /* retire the batch, workers waking up late should not pick from it */
+  pool.n_jobs = 0;
+  pthread_mutex_unlock (&pool.mutex);
+
+  pthread_mutex_unlock (&pool.dispatch_mutex);
+}
+
+void
+babl_parallel_exit (void)
+{
+  pthread_mutex_lock (&pool.dispatch_mutex);
+  pthread_mutex_lock (&pool.mutex);
+  if (!pool.started)
+    {
+      pthread_mutex_unlock (&pool.mutex);
+      pthread_mutex_unlock (&pool.dispatch_mutex);
+      return;
+    }
+  pool.quit = 1;
+  pthread_cond_broadcast (&pool.wake_cond);
+  pthread_mutex_unlock (&pool.mutex);
+
+  for (int i = 0; i < pool.n_workers; i++)
+    pthread_join (pool.threads[i], NULL);
+  pool.n_workers = 0;
+  pool.started = 0;
+  pthread_mutex_unlock (&pool.dispatch_mutex);
+}
+
+#else
+
+void
+babl_parallel_distribute (int               n_jobs,
+                          BablParallelFunc  func,
+                          void             *user_data)
+{
+  for (int job = 0; job < n_jobs; job++)
+    func (job, n_jobs, user_data);
+}
+
+void
+babl_parallel_exit (void)
+{
+}
+
+#endif
+
+int
+babl_parallel_get_n_threads (void)
+{
+  return parallel_n_threads ();
+}
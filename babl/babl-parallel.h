@@ -0,0 +1,58 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BABL_PARALLEL_H
+#define _BABL_PARALLEL_H
+
+/* A small persistent pool of worker threads, used for work that is large
+ * enough to be worth splitting across cores, like filling the 24bit LUTs
+ * of u8 fish paths and babl_process_rows_parallel.
+ *
+ * The pool is created lazily on first use, sized from the number of
+ * online CPUs - or the BABL_THREADS environment variable, a value of 1
+ * disables threading. The calling thread participates in the work.
+ */
+
+typedef void (*BablParallelFunc) (int   job,
+                                  int   n_jobs,
+                                  void *user_data);
+
+/* babl_parallel_get_n_threads:
+ *
+ * Returns the number of threads, including the calling one, work
+ * distributed with babl_parallel_distribute will be spread over.
+ */
+int  babl_parallel_get_n_threads (void);
+
+/* babl_parallel_distribute:
+ *
+ * Calls func for each job in 0..n_jobs-1, returning when all jobs have
+ * completed. If the pool is already busy with work, for instance when
+ * called from within a job, the jobs are run on the calling thread.
+ */
+void babl_parallel_distribute    (int               n_jobs,
+                                  BablParallelFunc  func,
+                                  void             *user_data);
+
+/* babl_parallel_exit:
+ *
+ * Stops and joins the worker threads, called from babl_exit.
+ */
+void babl_parallel_exit          (void);
+
+#endif
@@ -38,6 +38,11 @@ typedef struct
   cmsHPROFILE   lcms_profile;
   cmsHTRANSFORM lcms_to_rgba;
   cmsHTRANSFORM lcms_from_rgba;
+  /* the same transforms for float and 16bit CMYK pixels, with float RGBA */
+  cmsHTRANSFORM lcms_to_rgba_float;
+  cmsHTRANSFORM lcms_from_rgba_float;
+  cmsHTRANSFORM lcms_to_rgba_u16;
+  cmsHTRANSFORM lcms_from_rgba_u16;
 #endif
   int  filler;
 } BablCMYK;
@@ -19,6 +19,7 @@
 #include "config.h"
 #include "babl-internal.h"
 #include "babl-base.h"
+#include "babl-parallel.h"
 
 static int ref_count = 0;
 
@@ -97,12 +98,14 @@ babl_dir_list (void)
 
 
 static const char **simd_init (void);
+static void         simd_inhibit_lut (void);
 void
 babl_init (void)
 {
   const char **exclusion_pattern;
   babl_cpu_accel_set_use (1);
   exclusion_pattern = simd_init ();
+  simd_inhibit_lut ();
 
   if (ref_count++ == 0)
     {
@@ -123,6 +126,7 @@ babl_init (void)
       babl_core_init ();
       babl_sanity ();
       babl_extension_base ();
+      _babl_fish_reference_init ();
       babl_sanity ();
 
       dir_list = babl_dir_list ();
@@ -140,10 +144,22 @@ babl_exit (void)
   if (!-- ref_count)
     {
       babl_store_db ();
+      babl_parallel_exit ();
 
+      if (getenv ("BABL_HASH_INFO"))
+        {
+          babl_hash_table_report (babl_fish_db ()->id_hash, "fish ids");
+          babl_hash_table_report (babl_fish_db ()->name_hash, "fish names");
+          babl_hash_table_report (babl_format_db ()->name_hash, "format names");
+        }
       babl_extension_deinit ();
       babl_free (babl_extension_db ());;
+      _babl_fish_path_table_destroy ();
+      _babl_fish_reference_cache_destroy ();
+      _babl_palette_default_destroy ();
+      _babl_icc_lcms_destroy ();
       babl_free (babl_fish_db ());;
+      _babl_format_cache_clear ();
       babl_free (babl_conversion_db ());;
       babl_free (babl_format_db ());;
       babl_free (babl_model_db ());;
@@ -184,6 +200,68 @@ void _babl_space_add_universal_rgb_generic (const Babl *space);
 void (*_babl_space_add_universal_rgb) (const Babl *space) =
   _babl_space_add_universal_rgb_generic;
 
+void _babl_space_add_cmyk_generic (const Babl *space);
+void (*_babl_space_add_cmyk) (const Babl *space) =
+  _babl_space_add_cmyk_generic;
+
+int _babl_do_lut_generic (uint32_t   *lut,
+                          int         source_bpp,
+                          int         dest_bpp,
+                          const void *__restrict__ source,
+                          void       *__restrict__ destination,
+                          long        n);
+int (*_babl_do_lut) (uint32_t   *lut,
+                     int         source_bpp,
+                     int         dest_bpp,
+                     const void *__restrict__ source,
+                     void       *__restrict__ destination,
+                     long        n) = _babl_do_lut_generic;
+
+int _babl_reference_to_float_generic (int         type_id,
+                                      const void *src,
+                                      float      *dst,
+                                      long        n);
+int _babl_reference_from_float_generic (int          type_id,
+                                        const float *src,
+                                        void        *dst,
+                                        long         n);
+void _babl_reference_matrix_buf4_generic (const float *matrix,
+                                          float       *rgba,
+                                          long         n);
+int (*_babl_reference_to_float) (int         type_id,
+                                 const void *src,
+                                 float      *dst,
+                                 long        n) = _babl_reference_to_float_generic;
+int (*_babl_reference_from_float) (int          type_id,
+                                   const float *src,
+                                   void        *dst,
+                                   long         n) = _babl_reference_from_float_generic;
+void (*_babl_reference_matrix_buf4) (const float *matrix,
+                                     float       *rgba,
+                                     long         n) = _babl_reference_matrix_buf4_generic;
+void _babl_palette_match_u8_generic (const uint8_t *palette,
+                                     int            count,
+                                     const uint8_t *rgba,
+                                     uint8_t       *idx,
+                                     long           n);
+void (*_babl_palette_match_u8) (const uint8_t *palette,
+                                int            count,
+                                const uint8_t *rgba,
+                                uint8_t       *idx,
+                                long           n) = _babl_palette_match_u8_generic;
+void _babl_half_to_float_buf_generic (const uint16_t *src,
+                                      float          *dst,
+                                      long            n);
+void _babl_float_to_half_buf_generic (const float *src,
+                                      uint16_t    *dst,
+                                      long         n);
+void (*_babl_half_to_float_buf) (const uint16_t *src,
+                                 float          *dst,
+                                 long            n) = _babl_half_to_float_buf_generic;
+void (*_babl_float_to_half_buf) (const float *src,
+                                 uint16_t    *dst,
+                                 long         n) = _babl_float_to_half_buf_generic;
+
 const Babl *
 (*babl_trc_lookup_by_name) (const char *name) = babl_trc_lookup_by_name_generic;
 const Babl *
@@ -198,6 +276,64 @@ void babl_base_init_x86_64_v2 (void);
 void babl_base_init_x86_64_v3 (void);
 void _babl_space_add_universal_rgb_x86_64_v2 (const Babl *space);
 void _babl_space_add_universal_rgb_x86_64_v3 (const Babl *space);
+void _babl_space_add_cmyk_x86_64_v2 (const Babl *space);
+void _babl_space_add_cmyk_x86_64_v3 (const Babl *space);
+int _babl_do_lut_x86_64_v2 (uint32_t   *lut,
+                            int         source_bpp,
+                            int         dest_bpp,
+                            const void *__restrict__ source,
+                            void       *__restrict__ destination,
+                            long        n);
+int _babl_do_lut_x86_64_v3 (uint32_t   *lut,
+                            int         source_bpp,
+                            int         dest_bpp,
+                            const void *__restrict__ source,
+                            void       *__restrict__ destination,
+                            long        n);
+int _babl_reference_to_float_x86_64_v2 (int         type_id,
+                                        const void *src,
+                                        float      *dst,
+                                        long        n);
+int _babl_reference_from_float_x86_64_v2 (int          type_id,
+                                          const float *src,
+                                          void        *dst,
+                                          long         n);
+void _babl_reference_matrix_buf4_x86_64_v2 (const float *matrix,
+                                            float       *rgba,
+                                            long         n);
+void _babl_palette_match_u8_x86_64_v2 (const uint8_t *palette,
+                                       int            count,
+                                       const uint8_t *rgba,
+                                       uint8_t       *idx,
+                                       long           n);
+void _babl_half_to_float_buf_x86_64_v2 (const uint16_t *src,
+                                        float          *dst,
+                                        long            n);
+void _babl_float_to_half_buf_x86_64_v2 (const float *src,
+                                        uint16_t    *dst,
+                                        long         n);
+int _babl_reference_to_float_x86_64_v3 (int         type_id,
+                                        const void *src,
+                                        float      *dst,
+                                        long        n);
+int _babl_reference_from_float_x86_64_v3 (int          type_id,
+                                          const float *src,
+                                          void        *dst,
+                                          long         n);
+void _babl_reference_matrix_buf4_x86_64_v3 (const float *matrix,
+                                            float       *rgba,
+                                            long         n);
+void _babl_palette_match_u8_x86_64_v3 (const uint8_t *palette,
+                                       int            count,
+                                       const uint8_t *rgba,
+                                       uint8_t       *idx,
+                                       long           n);
+void _babl_half_to_float_buf_x86_64_v3 (const uint16_t *src,
+                                        float          *dst,
+                                        long            n);
+void _babl_float_to_half_buf_x86_64_v3 (const float *src,
+                                        uint16_t    *dst,
+                                        long         n);
 
 const Babl *
 babl_trc_lookup_by_name_x86_64_v2 (const char *name);
@@ -221,6 +357,35 @@ babl_trc_new_x86_64_v3 (const char *name,
 #ifdef ARCH_ARM
 void babl_base_init_arm_neon (void);
 void _babl_space_add_universal_rgb_arm_neon (const Babl *space);
+void _babl_space_add_cmyk_arm_neon (const Babl *space);
+int _babl_do_lut_arm_neon (uint32_t   *lut,
+                           int         source_bpp,
+                           int         dest_bpp,
+                           const void *__restrict__ source,
+                           void       *__restrict__ destination,
+                           long        n);
+int _babl_reference_to_float_arm_neon (int         type_id,
+                                       const void *src,
+                                       float      *dst,
+                                       long        n);
+int _babl_reference_from_float_arm_neon (int          type_id,
+                                         const float *src,
+                                         void        *dst,
+                                         long         n);
+void _babl_reference_matrix_buf4_arm_neon (const float *matrix,
+                                           float       *rgba,
+                                           long         n);
+void _babl_palette_match_u8_arm_neon (const uint8_t *palette,
+                                      int            count,
+                                      const uint8_t *rgba,
+                                      uint8_t       *idx,
+                                      long           n);
+void _babl_half_to_float_buf_arm_neon (const uint16_t *src,
+                                       float          *dst,
+                                       long            n);
+void _babl_float_to_half_buf_arm_neon (const float *src,
+                                       uint16_t    *dst,
+                                       long         n);
 
 const Babl *
 babl_trc_lookup_by_name_arm_neon (const char *name);
@@ -234,6 +399,14 @@ babl_trc_new_arm_neon (const char *name,
 
 #endif
 
+static const char *simd_variant = "generic";
+
+const char *
+_babl_simd_variant (void)
+{
+  return simd_variant;
+}
+
 static const char **simd_init (void)
 {
   static const char *exclude[] = {"neon-", "x86-64-v3", "x86-64-v2", NULL};
@@ -242,6 +415,7 @@ static const char **simd_init (void)
   if ((accel & BABL_CPU_ACCEL_X86_64_V3) == BABL_CPU_ACCEL_X86_64_V3)
   {
     static const char *exclude[] = {NULL};
+    simd_variant = "x86-64-v3";
     babl_base_init = babl_base_init_x86_64_v2; /// !!
                                                // this is correct,
                                                // it performs better
@@ -249,20 +423,38 @@ static const char **simd_init (void)
     babl_trc_new = babl_trc_new_x86_64_v2;
     babl_trc_lookup_by_name = babl_trc_lookup_by_name_x86_64_v2;
     _babl_space_add_universal_rgb = _babl_space_add_universal_rgb_x86_64_v3;
+    _babl_space_add_cmyk = _babl_space_add_cmyk_x86_64_v3;
+    _babl_do_lut = _babl_do_lut_x86_64_v3;
+    _babl_reference_to_float = _babl_reference_to_float_x86_64_v3;
+    _babl_reference_from_float = _babl_reference_from_float_x86_64_v3;
+    _babl_reference_matrix_buf4 = _babl_reference_matrix_buf4_x86_64_v3;
+    _babl_palette_match_u8 = _babl_palette_match_u8_x86_64_v3;
+    _babl_half_to_float_buf = _babl_half_to_float_buf_x86_64_v3;
+    _babl_float_to_half_buf = _babl_float_to_half_buf_x86_64_v3;
     return exclude;
   }
   else if ((accel & BABL_CPU_ACCEL_X86_64_V2) == BABL_CPU_ACCEL_X86_64_V2)
   {
     static const char *exclude[] = {"x86-64-v3-", NULL};
+    simd_variant = "x86-64-v2";
     babl_base_init = babl_base_init_x86_64_v2;
     babl_trc_new = babl_trc_new_x86_64_v2;
     babl_trc_lookup_by_name = babl_trc_lookup_by_name_x86_64_v2;
     _babl_space_add_universal_rgb = _babl_space_add_universal_rgb_x86_64_v2;
+    _babl_space_add_cmyk = _babl_space_add_cmyk_x86_64_v2;
+    _babl_do_lut = _babl_do_lut_x86_64_v2;
+    _babl_reference_to_float = _babl_reference_to_float_x86_64_v2;
+    _babl_reference_from_float = _babl_reference_from_float_x86_64_v2;
+    _babl_reference_matrix_buf4 = _babl_reference_matrix_buf4_x86_64_v2;
+    _babl_palette_match_u8 = _babl_palette_match_u8_x86_64_v2;
+    _babl_half_to_float_buf = _babl_half_to_float_buf_x86_64_v2;
+    _babl_float_to_half_buf = _babl_float_to_half_buf_x86_64_v2;
     return exclude;
   }
   else
   {
     static const char *exclude[] = {"x86-64-v3-", "x86-64-v2-", NULL};
+    simd_variant = "generic";
     return exclude;
   }
 #endif
@@ -271,18 +463,38 @@ static const char **simd_init (void)
   if ((accel & BABL_CPU_ACCEL_ARM_NEON) == BABL_CPU_ACCEL_ARM_NEON)
   {
     static const char *exclude[] = {NULL};
+    simd_variant = "arm-neon";
     babl_base_init = babl_base_init_arm_neon;
     babl_trc_new = babl_trc_new_arm_neon;
     babl_trc_lookup_by_name = babl_trc_lookup_by_name_arm_neon;
     _babl_space_add_universal_rgb = _babl_space_add_universal_rgb_arm_neon;
+    _babl_space_add_cmyk = _babl_space_add_cmyk_arm_neon;
+    _babl_do_lut = _babl_do_lut_arm_neon;
+    _babl_reference_to_float = _babl_reference_to_float_arm_neon;
+    _babl_reference_from_float = _babl_reference_from_float_arm_neon;
+    _babl_reference_matrix_buf4 = _babl_reference_matrix_buf4_arm_neon;
+    _babl_palette_match_u8 = _babl_palette_match_u8_arm_neon;
+    _babl_half_to_float_buf = _babl_half_to_float_buf_arm_neon;
+    _babl_float_to_half_buf = _babl_float_to_half_buf_arm_neon;
     return exclude;
   }
   else
   {
     static const char *exclude[] = {"arm-neon-", NULL};
+    simd_variant = "generic";
     return exclude;
   }
 #endif
   return exclude;
 }
 
+/* BABL_INHIBIT_LUT_SIMD keeps the loops applying LUTs scalar, for checking
+ * that the vector ones give the same results
+ */
+static void
+simd_inhibit_lut (void)
+{
+  if (getenv ("BABL_INHIBIT_LUT_SIMD"))
+    _babl_do_lut = _babl_do_lut_generic;
+}
+
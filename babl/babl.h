@@ -259,6 +259,47 @@ long         babl_process_rows (const Babl *babl_fish,
                                 long        n,
                                 int         rows);
 
+/**
+ * babl_process_rows_parallel:
+ *
+ * Like babl_process_rows, but splits the rows - or the pixels of rows when
+ * there are fewer rows than threads - over babl's worker threads, returning
+ * once all of them are converted. Small conversions are done on the calling
+ * thread. The number of threads used defaults to the number of CPUs and can
+ * be set with the BABL_THREADS environment variable.
+ *
+ * Since: babl-0.1.110
+ */
+long         babl_process_rows_parallel (const Babl *babl_fish,
+                                         const void *source,
+                                         int         source_stride,
+                                         void       *dest,
+                                         int         dest_stride,
+                                         long        n,
+                                         int         rows);
+
+/**
+ * babl_process_planes:
+ *
+ * Converts rows of n pixels of the source format of babl_fish, with each
+ * of its components in a plane of its own, like the Y', Cb and Cr planes
+ * of "Y'CbCr709 4:2:0 u8", to the packed destination format. planes and
+ * plane_strides hold the first row and the stride of the plane of each
+ * component, subsampled components have a sample for every
+ * horizontal × vertical pixels of their sampling, which is repeated over
+ * the pixels it covers. Large conversions are split over babl's worker
+ * threads like with babl_process_rows_parallel.
+ *
+ * Since: babl-0.1.110
+ */
+long         babl_process_planes (const Babl  *babl_fish,
+                                  const void **planes,
+                                  const int   *plane_strides,
+                                  void        *dest,
+                                  int          dest_stride,
+                                  long         n,
+                                  int          rows);
+
 
 /**
  * babl_get_name:
@@ -34,6 +34,8 @@ BABL_SIMD_SUFFIX(babl_base_init) (void)
   BABL_SIMD_SUFFIX (babl_formats_init) ();
 
   babl_hmpf_on_name_lookups--;
+
+  BABL_SIMD_SUFFIX (babl_base_universal_rgb) ();
 }
 
 void
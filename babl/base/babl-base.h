@@ -19,6 +19,8 @@
 #ifndef _BABL_BASE_H
 #define _BABL_BASE_H
 
+#include <stdint.h>
+
 #ifdef ARM_NEON
 #define BABL_SIMD_SUFFIX(symbol) symbol##_arm_neon
 #else
@@ -38,6 +40,7 @@ extern void (*babl_base_init)    (void);
 void BABL_SIMD_SUFFIX(babl_base_init)    (void);
 void BABL_SIMD_SUFFIX(babl_base_destroy) (void);
 void BABL_SIMD_SUFFIX(babl_formats_init) (void);
+void BABL_SIMD_SUFFIX(babl_base_universal_rgb) (void);
 
 void BABL_SIMD_SUFFIX(babl_base_type_half) (void);
 void BABL_SIMD_SUFFIX(babl_base_type_float)  (void);
@@ -51,4 +54,27 @@ void BABL_SIMD_SUFFIX(babl_base_model_cmyk)  (void);
 void BABL_SIMD_SUFFIX(babl_base_model_gray)  (void);
 void BABL_SIMD_SUFFIX(babl_base_model_ycbcr) (void);
 
+int  BABL_SIMD_SUFFIX(_babl_reference_to_float)    (int          type_id,
+                                                    const void  *src,
+                                                    float       *dst,
+                                                    long         n);
+int  BABL_SIMD_SUFFIX(_babl_reference_from_float)  (int          type_id,
+                                                    const float *src,
+                                                    void        *dst,
+                                                    long         n);
+void BABL_SIMD_SUFFIX(_babl_reference_matrix_buf4) (const float *matrix,
+                                                    float       *rgba,
+                                                    long         n);
+void BABL_SIMD_SUFFIX(_babl_palette_match_u8)      (const uint8_t *palette,
+                                                    int            count,
+                                                    const uint8_t *rgba,
+                                                    uint8_t       *idx,
+                                                    long           n);
+void BABL_SIMD_SUFFIX(_babl_half_to_float_buf)     (const uint16_t *src,
+                                                    float          *dst,
+                                                    long            n);
+void BABL_SIMD_SUFFIX(_babl_float_to_half_buf)     (const float    *src,
+                                                    uint16_t       *dst,
+                                                    long            n);
+
 #endif
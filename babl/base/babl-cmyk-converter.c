@@ -0,0 +1,587 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2017, Øyvind Kolås and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "babl-internal.h"
+#include "base/util.h"
+#include "babl-base.h"
+
+#ifdef X86_64_V3
+#include <immintrin.h>
+#endif
+#ifdef ARM_NEON
+#include <arm_neon.h>
+#endif
+
+/* CMYK spaces convert to and from RGB through color lookup tables baked
+ * from the reference conversion - and thus from the lcms transforms of
+ * the space when it has an ICC profile. The RGB to CMYK table is evaluated
+ * with tetrahedral interpolation, the CMYK to RGB table tetrahedrally in CMY
+ * and linearly in K. The tables are baked the first time the conversions
+ * are used, which is also when the path search measures their error against
+ * the reference, paths through them are only used when within the
+ * tolerance asked for.
+ *
+ * Table nodes are padded to 4 floats, K is the innermost axis of the CMYK
+ * table; the weighted sums of the nodes are done for all channels, and for
+ * both K slices, at once - with AVX2 in the x86-64-v3 variant and NEON in
+ * the arm-neon variant.
+ */
+
+#define CLUT4_GRID  17  /* CMYK to RGB, 17^4 nodes */
+#define CLUT3_GRID  33  /* R'G'B' to CMYK, 33^3 nodes */
+
+typedef struct
+{
+  const Babl *space;
+  float      *table;  /* baked on first use */
+} CmykClut;
+
+static float *
+bake_cmyk_to_rgb (const Babl *space)
+{
+  const int  n_nodes = CLUT4_GRID * CLUT4_GRID * CLUT4_GRID * CLUT4_GRID;
+  double    *cmyka   = babl_malloc (sizeof (double) * 5 * n_nodes);
+  double    *rgba    = babl_malloc (sizeof (double) * 4 * n_nodes);
+  float     *table   = babl_malloc (sizeof (float) * 4 * n_nodes);
+  int        i       = 0;
+
+  for (int c = 0; c < CLUT4_GRID; c++)
+  for (int m = 0; m < CLUT4_GRID; m++)
+  for (int y = 0; y < CLUT4_GRID; y++)
+  for (int k = 0; k < CLUT4_GRID; k++, i++)
+    {
+      cmyka[i * 5 + 0] = c / (CLUT4_GRID - 1.0);
+      cmyka[i * 5 + 1] = m / (CLUT4_GRID - 1.0);
+      cmyka[i * 5 + 2] = y / (CLUT4_GRID - 1.0);
+      cmyka[i * 5 + 3] = k / (CLUT4_GRID - 1.0);
+      cmyka[i * 5 + 4] = 1.0;
+    }
+
+  babl_process (babl_fish_reference (babl_format_with_space ("CMYKA double",
+                                                             space),
+                                     babl_format ("RGBA double")),
+                cmyka, rgba, n_nodes);
+
+  for (i = 0; i < n_nodes; i++)
+    {
+      table[i * 4 + 0] = rgba[i * 4 + 0];
+      table[i * 4 + 1] = rgba[i * 4 + 1];
+      table[i * 4 + 2] = rgba[i * 4 + 2];
+      table[i * 4 + 3] = 0.0f;
+    }
+
+  babl_free (cmyka);
+  babl_free (rgba);
+  return table;
+}
+
+static float *
+bake_rgb_to_cmyk (const Babl *space)
+{
+  const int  n_nodes = CLUT3_GRID * CLUT3_GRID * CLUT3_GRID;
+  double    *rgba    = babl_malloc (sizeof (double) * 4 * n_nodes);
+  double    *cmyka   = babl_malloc (sizeof (double) * 5 * n_nodes);
+  float     *table   = babl_malloc (sizeof (float) * 4 * n_nodes);
+  int        i       = 0;
+
+  for (int r = 0; r < CLUT3_GRID; r++)
+  for (int g = 0; g < CLUT3_GRID; g++)
+  for (int b = 0; b < CLUT3_GRID; b++, i++)
+    {
+      rgba[i * 4 + 0] = r / (CLUT3_GRID - 1.0);
+      rgba[i * 4 + 1] = g / (CLUT3_GRID - 1.0);
+      rgba[i * 4 + 2] = b / (CLUT3_GRID - 1.0);
+      rgba[i * 4 + 3] = 1.0;
+    }
+
+  babl_process (babl_fish_reference (babl_format ("R'G'B'A double"),
+                                     babl_format_with_space ("CMYKA double",
+                                                             space)),
+                rgba, cmyka, n_nodes);
+
+  for (i = 0; i < n_nodes; i++)
+    for (int c = 0; c < 4; c++)
+      table[i * 4 + c] = cmyka[i * 5 + c];
+
+  babl_free (rgba);
+  babl_free (cmyka);
+  return table;
+}
+
+static const float *
+clut_table (CmykClut *clut,
+            float  *(*bake) (const Babl *space))
+{
+  float *table = __atomic_load_n (&clut->table, __ATOMIC_ACQUIRE);
+
+  if (!table)
+    {
+      float *expected = NULL;
+
+      table = bake (clut->space);
+      if (!__atomic_compare_exchange_n (&clut->table, &expected, table, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+          /* another thread baked it first */
+          babl_free (table);
+          table = expected;
+        }
+    }
+  return table;
+}
+
+/* the conversions owning a table release it when destroyed, the CMYK float
+ * to RGBA float conversion borrows the table of the CMYKA float one
+ */
+static int
+clut_conversion_destroy (void *data)
+{
+  const Babl *conversion = data;
+  CmykClut   *clut       = conversion->conversion.data;
+
+  babl_free (clut->table);
+  babl_free (clut);
+  return 0;
+}
+
+/* the grid cell a coordinate falls in and the position within it, the cell
+ * is clamped while still a float - keeping the conversion to int defined and
+ * lookups within the table for any input. Values outside the grid are
+ * clamped to its edges like lcms does, NaN ends up at the first node.
+ */
+static inline int
+clut_cell (float  value,
+           int    grid,
+           float *frac)
+{
+  float pos     = value * (grid - 1);
+  float clamped = pos >= 0.0f ? pos : 0.0f;
+  int   cell;
+
+  if (clamped > grid - 1)
+    clamped = grid - 1;
+  cell = clamped;
+  if (cell > grid - 2)
+    cell = grid - 2;
+
+  *frac = clamped - cell;
+  return cell;
+}
+
+/* orders axes a and b by descending position in the cell */
+static inline void
+sort2 (float *frac,
+       int   *stride,
+       int    a,
+       int    b)
+{
+  if (frac[a] < frac[b])
+    {
+      float f   = frac[a];
+      int   s   = stride[a];
+
+      frac[a]   = frac[b];
+      frac[b]   = f;
+      stride[a] = stride[b];
+      stride[b] = s;
+    }
+}
+
+/* the nodes of a tetrahedron weighted and summed, for the 4 floats of
+ * two adjacent nodes at each corner when lerp is set - the two K slices
+ * of the CMYK table, which are then blended with the K position
+ */
+static inline void
+tetra_sum (const float *n0,
+           const float *n1,
+           const float *n2,
+           const float *n3,
+           float        w0,
+           float        w1,
+           float        w2,
+           float        w3,
+           int          lerp,
+           float        fk,
+           float       *out)
+{
+#if defined(X86_64_V3)
+  if (lerp)
+    {
+      __m256 sum = _mm256_mul_ps (_mm256_set1_ps (w0), _mm256_loadu_ps (n0));
+      __m128 lo, hi;
+
+      sum = _mm256_add_ps (sum, _mm256_mul_ps (_mm256_set1_ps (w1), _mm256_loadu_ps (n1)));
+      sum = _mm256_add_ps (sum, _mm256_mul_ps (_mm256_set1_ps (w2), _mm256_loadu_ps (n2)));
+      sum = _mm256_add_ps (sum, _mm256_mul_ps (_mm256_set1_ps (w3), _mm256_loadu_ps (n3)));
+      lo  = _mm256_castps256_ps128 (sum);
+      hi  = _mm256_extractf128_ps (sum, 1);
+      _mm_storeu_ps (out, _mm_add_ps (lo, _mm_mul_ps (_mm_set1_ps (fk),
+                                                      _mm_sub_ps (hi, lo))));
+    }
+  else
+    {
+      __m128 sum = _mm_mul_ps (_mm_set1_ps (w0), _mm_loadu_ps (n0));
+
+      sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (w1), _mm_loadu_ps (n1)));
+      sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (w2), _mm_loadu_ps (n2)));
+      sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (w3), _mm_loadu_ps (n3)));
+      _mm_storeu_ps (out, sum);
+    }
+#elif defined(ARM_NEON)
+  float32x4_t lo = vmulq_n_f32 (vld1q_f32 (n0), w0);
+
+  lo = vmlaq_n_f32 (lo, vld1q_f32 (n1), w1);
+  lo = vmlaq_n_f32 (lo, vld1q_f32 (n2), w2);
+  lo = vmlaq_n_f32 (lo, vld1q_f32 (n3), w3);
+  if (lerp)
+    {
+      float32x4_t hi = vmulq_n_f32 (vld1q_f32 (n0 + 4), w0);
+
+      hi = vmlaq_n_f32 (hi, vld1q_f32 (n1 + 4), w1);
+      hi = vmlaq_n_f32 (hi, vld1q_f32 (n2 + 4), w2);
+      hi = vmlaq_n_f32 (hi, vld1q_f32 (n3 + 4), w3);
+      lo = vmlaq_n_f32 (lo, vsubq_f32 (hi, lo), fk);
+    }
+  vst1q_f32 (out, lo);
+#else
+  for (int c = 0; c < 4; c++)
+    {
+      float lo = w0 * n0[c] + w1 * n1[c] + w2 * n2[c] + w3 * n3[c];
+
+      if (lerp)
+        {
+          float hi = w0 * n0[c + 4] + w1 * n1[c + 4] +
+                     w2 * n2[c + 4] + w3 * n3[c + 4];
+          lo += fk * (hi - lo);
+        }
+      out[c] = lo;
+    }
+#endif
+}
+
+/* tetrahedral interpolation in a cube of the grid, from the cell origin
+ * along the axes by descending position in the cell
+ */
+static inline void
+tetra_eval (const float *table,
+            int          base,
+            int         *stride,
+            float       *frac,
+            int          lerp,
+            float        fk,
+            float       *out)
+{
+  const float *n0, *n1, *n2, *n3;
+
+  sort2 (frac, stride, 0, 1);
+  sort2 (frac, stride, 1, 2);
+  sort2 (frac, stride, 0, 1);
+
+  n0 = table + base;
+  n1 = n0 + stride[0];
+  n2 = n1 + stride[1];
+  n3 = n2 + stride[2];
+  tetra_sum (n0, n1, n2, n3,
+             1.0f - frac[0], frac[0] - frac[1], frac[1] - frac[2], frac[2],
+             lerp, fk, out);
+}
+
+/* CMY is interpolated tetrahedrally in the two K slices around the pixel,
+ * which are blended linearly - as lcms does for 4 inputs. This reproduces
+ * functions that are linear in CMY and in K, like the conversion of CMYK
+ * spaces without a profile, exactly.
+ */
+static inline void
+clut4_eval (const float *__restrict__ table,
+            const float *cmyk,
+            float       *out)
+{
+  int   stride[3] = { CLUT4_GRID * CLUT4_GRID * CLUT4_GRID * 4,
+                      CLUT4_GRID * CLUT4_GRID * 4,
+                      CLUT4_GRID * 4 };
+  float frac[3];
+  float fk;
+  int   base = clut_cell (cmyk[3], CLUT4_GRID, &fk) * 4;
+
+  for (int c = 0; c < 3; c++)
+    base += clut_cell (cmyk[c], CLUT4_GRID, &frac[c]) * stride[c];
+
+  tetra_eval (table, base, stride, frac, 1, fk, out);
+}
+
+static inline void
+clut3_eval (const float *__restrict__ table,
+            const float *rgb,
+            float       *out)
+{
+  int   stride[3] = { CLUT3_GRID * CLUT3_GRID * 4,
+                      CLUT3_GRID * 4,
+                      4 };
+  float frac[3];
+  int   base = 0;
+
+  for (int c = 0; c < 3; c++)
+    base += clut_cell (rgb[c], CLUT3_GRID, &frac[c]) * stride[c];
+
+  tetra_eval (table, base, stride, frac, 0, 0.0f, out);
+}
+
+static void
+cmyka_float_to_rgba_float (const Babl *conversion,
+                           const char *src,
+                           char       *dst,
+                           long        samples,
+                           void       *data)
+{
+  const float *table = clut_table (data, bake_cmyk_to_rgb);
+  const float *s     = (void *) src;
+  float       *d     = (void *) dst;
+
+  while (samples--)
+    {
+      float alpha = s[4];
+
+      clut4_eval (table, s, d);
+      d[3] = alpha;
+      s += 5;
+      d += 4;
+    }
+}
+
+static void
+cmyk_float_to_rgba_float (const Babl *conversion,
+                          const char *src,
+                          char       *dst,
+                          long        samples,
+                          void       *data)
+{
+  const float *table = clut_table (data, bake_cmyk_to_rgb);
+  const float *s     = (void *) src;
+  float       *d     = (void *) dst;
+
+  while (samples--)
+    {
+      clut4_eval (table, s, d);
+      d[3] = 1.0f;
+      s += 4;
+      d += 4;
+    }
+}
+
+static void
+nonlinear_rgba_float_to_cmyka_float (const Babl *conversion,
+                                     const char *src,
+                                     char       *dst,
+                                     long        samples,
+                                     void       *data)
+{
+  const float *table = clut_table (data, bake_rgb_to_cmyk);
+  const float *s     = (void *) src;
+  float       *d     = (void *) dst;
+
+  while (samples--)
+    {
+      float alpha = s[3];
+
+      clut3_eval (table, s, d);
+      d[4] = alpha;
+      s += 4;
+      d += 5;
+    }
+}
+
+#ifdef HAVE_LCMS
+
+/* Conversions calling the float and 16bit lcms transforms of spaces with a
+ * profile directly. lcms takes float CMYK in the 0.0-100.0 range, float
+ * pixels are scaled in chunks on the stack, alpha is copied by us.
+ *
+ * CMYKA float to RGBA float is also a lookup table conversion, the two are
+ * registered side by side like the conversions of extensions are: the lcms
+ * transform is within the default tolerance of the reference and the table
+ * is not - interpolating between nodes of a profile - but cheaper; the path
+ * search uses the former for exact fishes and the latter for fast ones.
+ */
+
+#define LCMS_CHUNK  256
+
+static void
+lcms_cmyka_float_to_rgba_float (const Babl *conversion,
+                                const char *src,
+                                char       *dst,
+                                long        samples,
+                                void       *data)
+{
+  const Babl  *space = data;
+  const float *s     = (void *) src;
+  float       *d     = (void *) dst;
+  float        cmyka[LCMS_CHUNK * 5];
+
+  while (samples > 0)
+    {
+      long n = samples < LCMS_CHUNK ? samples : LCMS_CHUNK;
+
+      for (long i = 0; i < n * 5; i++)
+        cmyka[i] = s[i] * 100.0f;
+      cmsDoTransform (space->space.cmyk.lcms_to_rgba_float, cmyka, d, n);
+      for (long i = 0; i < n; i++)
+        d[i * 4 + 3] = s[i * 5 + 4];
+
+      s       += n * 5;
+      d       += n * 4;
+      samples -= n;
+    }
+}
+
+static void
+lcms_rgba_float_to_cmyka_float (const Babl *conversion,
+                                const char *src,
+                                char       *dst,
+                                long        samples,
+                                void       *data)
+{
+  const Babl  *space = data;
+  const float *s     = (void *) src;
+  float       *d     = (void *) dst;
+
+  cmsDoTransform (space->space.cmyk.lcms_from_rgba_float, s, d, samples);
+  for (long i = 0; i < samples; i++)
+    {
+      for (int c = 0; c < 4; c++)
+        d[i * 5 + c] *= 0.01f;
+      d[i * 5 + 4] = s[i * 4 + 3];
+    }
+}
+
+static void
+lcms_cmyka_u16_to_rgba_float (const Babl *conversion,
+                              const char *src,
+                              char       *dst,
+                              long        samples,
+                              void       *data)
+{
+  const Babl     *space = data;
+  const uint16_t *s     = (void *) src;
+  float          *d     = (void *) dst;
+
+  cmsDoTransform (space->space.cmyk.lcms_to_rgba_u16, s, d, samples);
+  for (long i = 0; i < samples; i++)
+    d[i * 4 + 3] = s[i * 5 + 4] / 65535.0f;
+}
+
+static void
+lcms_rgba_float_to_cmyka_u16 (const Babl *conversion,
+                              const char *src,
+                              char       *dst,
+                              long        samples,
+                              void       *data)
+{
+  const Babl  *space = data;
+  const float *s     = (void *) src;
+  uint16_t    *d     = (void *) dst;
+
+  cmsDoTransform (space->space.cmyk.lcms_from_rgba_u16, s, d, samples);
+  for (long i = 0; i < samples; i++)
+    {
+      float alpha = s[i * 4 + 3];
+
+      if (alpha >= 1.0f)
+        d[i * 5 + 4] = 65535;
+      else if (alpha > 0.0f)
+        d[i * 5 + 4] = alpha * 65535.0f + 0.5f;
+      else
+        d[i * 5 + 4] = 0;
+    }
+}
+
+static void
+add_lcms_conversions (const Babl *space)
+{
+  const BablCMYK *cmyk = &space->space.cmyk;
+
+  if (!cmyk->lcms_profile)
+    return;
+
+  if (cmyk->lcms_to_rgba_float)
+    babl_conversion_new (babl_format_with_space ("CMYKA float", space),
+                         babl_format ("RGBA float"),
+                         "linear", lcms_cmyka_float_to_rgba_float,
+                         "data", (void *) space,
+                         NULL);
+  if (cmyk->lcms_from_rgba_float)
+    babl_conversion_new (babl_format ("RGBA float"),
+                         babl_format_with_space ("CMYKA float", space),
+                         "linear", lcms_rgba_float_to_cmyka_float,
+                         "data", (void *) space,
+                         NULL);
+  if (cmyk->lcms_to_rgba_u16)
+    babl_conversion_new (babl_format_with_space ("CMYKA u16", space),
+                         babl_format ("RGBA float"),
+                         "linear", lcms_cmyka_u16_to_rgba_float,
+                         "data", (void *) space,
+                         NULL);
+  if (cmyk->lcms_from_rgba_u16)
+    babl_conversion_new (babl_format ("RGBA float"),
+                         babl_format_with_space ("CMYKA u16", space),
+                         "linear", lcms_rgba_float_to_cmyka_u16,
+                         "data", (void *) space,
+                         NULL);
+}
+
+#endif
+
+/* Called the first time a CMYK space is used for creation of a fish, adds
+ * the conversions between its CMYK formats and RGB.
+ */
+void
+BABL_SIMD_SUFFIX(_babl_space_add_cmyk) (const Babl *space);
+void
+BABL_SIMD_SUFFIX(_babl_space_add_cmyk) (const Babl *space)
+{
+  CmykClut   *to_rgb   = babl_calloc (1, sizeof (CmykClut));
+  CmykClut   *from_rgb = babl_calloc (1, sizeof (CmykClut));
+  const Babl *conversion;
+
+  to_rgb->space   = space;
+  from_rgb->space = space;
+
+  conversion = babl_conversion_new (babl_format_with_space ("CMYKA float",
+                                                            space),
+                                    babl_format ("RGBA float"),
+                                    "linear", cmyka_float_to_rgba_float,
+                                    "data", to_rgb,
+                                    NULL);
+  babl_set_destructor ((void *) conversion, clut_conversion_destroy);
+  babl_conversion_new (babl_format_with_space ("CMYK float", space),
+                       babl_format ("RGBA float"),
+                       "linear", cmyk_float_to_rgba_float,
+                       "data", to_rgb,
+                       NULL);
+  conversion = babl_conversion_new (babl_format ("R'G'B'A float"),
+                                    babl_format_with_space ("CMYKA float",
+                                                            space),
+                                    "linear",
+                                    nonlinear_rgba_float_to_cmyka_float,
+                                    "data", from_rgb,
+                                    NULL);
+  babl_set_destructor ((void *) conversion, clut_conversion_destroy);
+#ifdef HAVE_LCMS
+  add_lcms_conversions (space);
+#endif
+}
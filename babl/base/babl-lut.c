@@ -0,0 +1,407 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* The inner loops applying the LUTs of u8 fish paths, built once per
+ * SIMD variant of the base library. The x86-64-v3 variant processes 8
+ * pixels at a time with AVX2 gathers for the common cases, falling back
+ * to the scalar loops for the remainder.
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include "babl-internal.h"
+#include "babl-base.h"
+
+#ifdef X86_64_V3
+#include <immintrin.h>
+#endif
+
+#define BPP_4ASSOCIATED   14
+
+/* (256*255)/alpha, replacing the per pixel divide when unpremultiplying */
+static const uint32_t lut_ralpha[256] = {
+      0, 65280, 32640, 21760, 16320, 13056, 10880,  9325,
+   8160,  7253,  6528,  5934,  5440,  5021,  4662,  4352,
+   4080,  3840,  3626,  3435,  3264,  3108,  2967,  2838,
+   2720,  2611,  2510,  2417,  2331,  2251,  2176,  2105,
+   2040,  1978,  1920,  1865,  1813,  1764,  1717,  1673,
+   1632,  1592,  1554,  1518,  1483,  1450,  1419,  1388,
+   1360,  1332,  1305,  1280,  1255,  1231,  1208,  1186,
+   1165,  1145,  1125,  1106,  1088,  1070,  1052,  1036,
+   1020,  1004,   989,   974,   960,   946,   932,   919,
+    906,   894,   882,   870,   858,   847,   836,   826,
+    816,   805,   796,   786,   777,   768,   759,   750,
+    741,   733,   725,   717,   709,   701,   694,   687,
+    680,   672,   666,   659,   652,   646,   640,   633,
+    627,   621,   615,   610,   604,   598,   593,   588,
+    582,   577,   572,   567,   562,   557,   553,   548,
+    544,   539,   535,   530,   526,   522,   518,   514,
+    510,   506,   502,   498,   494,   490,   487,   483,
+    480,   476,   473,   469,   466,   462,   459,   456,
+    453,   450,   447,   444,   441,   438,   435,   432,
+    429,   426,   423,   421,   418,   415,   413,   410,
+    408,   405,   402,   400,   398,   395,   393,   390,
+    388,   386,   384,   381,   379,   377,   375,   373,
+    370,   368,   366,   364,   362,   360,   358,   356,
+    354,   352,   350,   349,   347,   345,   343,   341,
+    340,   338,   336,   334,   333,   331,   329,   328,
+    326,   324,   323,   321,   320,   318,   316,   315,
+    313,   312,   310,   309,   307,   306,   305,   303,
+    302,   300,   299,   298,   296,   295,   294,   292,
+    291,   290,   288,   287,   286,   285,   283,   282,
+    281,   280,   278,   277,   276,   275,   274,   273,
+    272,   270,   269,   268,   267,   266,   265,   264,
+    263,   262,   261,   260,   259,   258,   257,   256,
+};
+
+#ifdef X86_64_V3
+
+static inline long
+lut_4_4_avx2 (const uint32_t *lut,
+              const uint32_t *src,
+              uint32_t       *dst,
+              long            n)
+{
+  const __m256i rgb_mask   = _mm256_set1_epi32 (0xffffff);
+  const __m256i alpha_mask = _mm256_set1_epi32 (0xff000000);
+  long i;
+
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    __m256i col = _mm256_loadu_si256 ((const __m256i*)(src + i));
+    __m256i val = _mm256_i32gather_epi32 ((const int*)lut,
+                                          _mm256_and_si256 (col, rgb_mask), 4);
+    _mm256_storeu_si256 ((__m256i*)(dst + i),
+      _mm256_or_si256 (val, _mm256_and_si256 (col, alpha_mask)));
+  }
+  return i;
+}
+
+static inline long
+lut_4associated_4_avx2 (const uint32_t *lut,
+                        const uint32_t *src,
+                        uint32_t       *dst,
+                        long            n)
+{
+  const __m256i byte_mask = _mm256_set1_epi32 (0xff);
+  const __m256i zero      = _mm256_setzero_si256 ();
+  long i;
+
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    __m256i col    = _mm256_loadu_si256 ((const __m256i*)(src + i));
+    __m256i alpha  = _mm256_srli_epi32 (col, 24);
+    __m256i ralpha = _mm256_i32gather_epi32 ((const int*)lut_ralpha, alpha, 4);
+    __m256i r      = _mm256_and_si256 (col, byte_mask);
+    __m256i g      = _mm256_and_si256 (_mm256_srli_epi32 (col, 8), byte_mask);
+    __m256i b      = _mm256_and_si256 (_mm256_srli_epi32 (col, 16), byte_mask);
+    __m256i opaque = _mm256_cmpgt_epi32 (alpha, zero);
+    __m256i idx, val;
+
+    r = _mm256_and_si256 (_mm256_srli_epi32 (_mm256_mullo_epi32 (r, ralpha), 8), byte_mask);
+    g = _mm256_and_si256 (_mm256_srli_epi32 (_mm256_mullo_epi32 (g, ralpha), 8), byte_mask);
+    b = _mm256_and_si256 (_mm256_srli_epi32 (_mm256_mullo_epi32 (b, ralpha), 8), byte_mask);
+    idx = _mm256_or_si256 (r, _mm256_or_si256 (_mm256_slli_epi32 (g, 8),
+                                               _mm256_slli_epi32 (b, 16)));
+
+    /* fully transparent pixels are not looked up, and come out as 0 */
+    val = _mm256_mask_i32gather_epi32 (zero, (const int*)lut, idx, opaque, 4);
+    _mm256_storeu_si256 ((__m256i*)(dst + i),
+      _mm256_or_si256 (val, _mm256_slli_epi32 (alpha, 24)));
+  }
+  return i;
+}
+
+static inline long
+lut_4_16_avx2 (const uint32_t *lut,
+               const uint32_t *src,
+               uint32_t       *dst,
+               long            n)
+{
+  const __m256i rgb_mask = _mm256_set1_epi32 (0xffffff);
+  const __m256  scale    = _mm256_set1_ps (255.0f);
+  long i;
+
+  /* each entry is 4 floats wide, so entries are loaded whole rather
+   * than gathered, with the computed alpha blended into the last lane
+   */
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    __m256i col    = _mm256_loadu_si256 ((const __m256i*)(src + i));
+    __m256i offset = _mm256_slli_epi32 (_mm256_and_si256 (col, rgb_mask), 2);
+    __m256  alpha  = _mm256_div_ps (_mm256_cvtepi32_ps (_mm256_srli_epi32 (col, 24)),
+                                    scale);
+    uint32_t offsets[8];
+
+    _mm256_storeu_si256 ((__m256i*)offsets, offset);
+    for (int j = 0; j < 8; j += 2)
+    {
+      __m256i pair = _mm256_inserti128_si256 (
+        _mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i*)(lut + offsets[j]))),
+        _mm_loadu_si128 ((const __m128i*)(lut + offsets[j + 1])), 1);
+      __m256i a = _mm256_castps_si256 (
+        _mm256_permutevar8x32_ps (alpha, _mm256_setr_epi32 (j, j, j, j,
+                                                            j + 1, j + 1, j + 1, j + 1)));
+      _mm256_storeu_si256 ((__m256i*)(dst + (i + j) * 4),
+                           _mm256_blend_epi32 (pair, a, 0x88));
+    }
+  }
+  return i;
+}
+
+static inline long
+lut_3_4_avx2 (const uint32_t *lut,
+              const uint8_t  *src,
+              uint32_t       *dst,
+              long            n)
+{
+  /* spread 4 packed pixels per lane into the 32bit big-endian indices
+   * src[0]*256*256+src[1]*256+src[2]
+   */
+  const __m256i shuffle = _mm256_setr_epi8 (2, 1, 0, -1, 5, 4, 3, -1,
+                                            8, 7, 6, -1, 11, 10, 9, -1,
+                                            2, 1, 0, -1, 5, 4, 3, -1,
+                                            8, 7, 6, -1, 11, 10, 9, -1);
+  long i;
+
+  /* the 16 byte loads read 4 bytes past the 8 pixels consumed */
+  for (i = 0; i + 10 <= n; i += 8)
+  {
+    __m256i packed = _mm256_inserti128_si256 (
+      _mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i*)(src + i * 3))),
+      _mm_loadu_si128 ((const __m128i*)(src + i * 3 + 12)), 1);
+    __m256i idx = _mm256_shuffle_epi8 (packed, shuffle);
+    _mm256_storeu_si256 ((__m256i*)(dst + i),
+                         _mm256_i32gather_epi32 ((const int*)lut, idx, 4));
+  }
+  return i;
+}
+
+static inline long
+lut_2_4_avx2 (const uint32_t *lut,
+              const uint16_t *src,
+              uint32_t       *dst,
+              long            n)
+{
+  long i;
+
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    __m256i idx = _mm256_cvtepu16_epi32 (_mm_loadu_si128 ((const __m128i*)(src + i)));
+    _mm256_storeu_si256 ((__m256i*)(dst + i),
+                         _mm256_i32gather_epi32 ((const int*)lut, idx, 4));
+  }
+  return i;
+}
+
+#endif
+
+int
+BABL_SIMD_SUFFIX (_babl_do_lut) (uint32_t   *lut,
+                                 int         source_bpp,
+                                 int         dest_bpp,
+                                 const void *__restrict__ source,
+                                 void       *__restrict__ destination,
+                                 long        n);
+
+int
+BABL_SIMD_SUFFIX (_babl_do_lut) (uint32_t   *lut,
+                                 int         source_bpp,
+                                 int         dest_bpp,
+                                 const void *__restrict__ source,
+                                 void       *__restrict__ destination,
+                                 long        n)
+{
+        if (source_bpp == BPP_4ASSOCIATED  && dest_bpp == 4)
+        {
+          uint32_t *src = (uint32_t*)source;
+          uint32_t *dst = (uint32_t*)destination;
+#ifdef X86_64_V3
+          long done = lut_4associated_4_avx2 (lut, src, dst, n);
+          src += done;
+          dst += done;
+          n -= done;
+#endif
+          while (n--)
+          {
+             uint32_t col = *src++;
+             uint8_t *rgba=(uint8_t*)&col;
+             uint8_t oalpha = rgba[3];
+             if (oalpha==0)
+             {
+               *dst++ = 0;
+             }
+             else
+             {
+               uint32_t col_opaque = col;
+               uint8_t *rgbaB=(uint8_t*)&col_opaque;
+               uint32_t ralpha = lut_ralpha[oalpha];
+               rgbaB[0] = (rgba[0]*ralpha)>>8;
+               rgbaB[1] = (rgba[1]*ralpha)>>8;
+               rgbaB[2] = (rgba[2]*ralpha)>>8;
+               rgbaB[3] = 0;
+               *dst++ = lut[col_opaque] | (oalpha<<24);
+             }
+          }
+        }
+        else if (source_bpp == 4 && dest_bpp == 16)
+        {
+          uint32_t *src = (uint32_t*)source;
+          uint32_t *dst = (uint32_t*)destination;
+#ifdef X86_64_V3
+          long done = lut_4_16_avx2 (lut, src, dst, n);
+          src += done;
+          dst += done * 4;
+          n -= done;
+#endif
+          while (n--)
+          {
+             uint32_t col = *src++;
+             uint32_t lut_offset = col & 0xffffff;
+             float alpha = (col>>24)/255.0f;
+
+             *dst++ = lut[lut_offset*4+0];
+             *dst++ = lut[lut_offset*4+1];
+             *dst++ = lut[lut_offset*4+2];
+             ((float*)(dst))[0] = alpha;
+             dst++;
+          }
+        }
+        else if (source_bpp == 4 && dest_bpp == 8)
+        {
+          uint32_t *src = (uint32_t*)source;
+          uint16_t *dst = (uint16_t*)destination;
+          uint16_t *lut16 = (uint16_t*)lut;
+          while (n--)
+          {
+             uint32_t col = *src++;
+             uint32_t lut_offset = col & 0xffffff;
+             uint16_t alpha = (col>>24) << 8; 
+
+             dst[0] = lut16[lut_offset*2+0];
+             dst[1] = lut16[lut_offset*2+1];
+             dst[2] = lut16[lut_offset*2+2];
+             dst[3] = alpha;
+             dst+=4;
+          }
+        }
+        else if (source_bpp == 2 && dest_bpp == 16)
+        {
+          uint16_t *src = (uint16_t*)source;
+          uint32_t *dst = (uint32_t*)destination;
+          while (n--)
+          {
+             uint32_t col = *src++;
+             *dst++ = lut[col*4+0];
+             *dst++ = lut[col*4+1];
+             *dst++ = lut[col*4+2];
+             *dst++ = lut[col*4+3];
+          }
+        }
+        else if (source_bpp == 4 && dest_bpp == 4)
+        {
+          uint32_t *src = (uint32_t*)source;
+          uint32_t *dst = (uint32_t*)destination;
+#ifdef X86_64_V3
+          long done = lut_4_4_avx2 (lut, src, dst, n);
+          src += done;
+          dst += done;
+          n -= done;
+#endif
+          while (n--)
+          {
+             uint32_t col = *src++;
+             *dst = (col & 0xff000000) | lut[col & 0xffffff];
+             dst++;
+          }
+        }
+        else if (source_bpp == 2 && dest_bpp == 4)
+        {
+          uint16_t *src = (uint16_t*)source;
+          uint32_t *dst = (uint32_t*)destination;
+#ifdef X86_64_V3
+          long done = lut_2_4_avx2 (lut, src, dst, n);
+          src += done;
+          dst += done;
+          n -= done;
+#endif
+          while (n--)
+          {
+            *dst = lut[*src++];
+            dst++;
+          }
+        }
+        else if (source_bpp == 2 && dest_bpp == 2)
+        {
+          uint16_t *src = (uint16_t*)source;
+          uint16_t *dst = (uint16_t*)destination;
+          uint16_t *lut16 = (uint16_t*)lut;
+          while (n--)
+          {
+             *dst = lut16[*src++];
+             dst++;
+          }
+        }
+        else if (source_bpp == 1 && dest_bpp == 4)
+        {
+          uint8_t *src = (uint8_t*)source;
+          uint32_t *dst = (uint32_t*)destination;
+          while (n--)
+          {
+             *dst = lut[*src++];
+             dst++;
+          }
+        }
+        else if (source_bpp == 3 && dest_bpp == 3)
+        {
+          uint8_t *src = (uint8_t*)source;
+          uint8_t *dst = (uint8_t*)destination;
+          while (n--)
+          {
+             uint32_t col = src[0]*256*256+src[1]*256+src[2];
+             uint32_t val = lut[col];
+             dst[2]=(val >> 16) & 0xff;
+             dst[1]=(val >> 8) & 0xff;
+             dst[0]=val & 0xff;
+             dst+=3;
+             src+=3;
+          }
+        }
+        else if (source_bpp == 3 && dest_bpp == 4)
+        {
+          uint8_t *src = (uint8_t*)source;
+          uint32_t *dst = (uint32_t*)destination;
+#ifdef X86_64_V3
+          long done = lut_3_4_avx2 (lut, src, dst, n);
+          src += done * 3;
+          dst += done;
+          n -= done;
+#endif
+          while (n--)
+          {
+             *dst = lut[src[0]*256*256+src[1]*256+src[2]];
+             dst++;
+             src+=3;
+          }
+        }
+        else
+        {
+          return 0;
+        }
+        return 1;
+}
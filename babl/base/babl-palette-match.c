@@ -0,0 +1,159 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2012, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* The nearest color search of palette conversions, matching a batch of
+ * R'G'B'A u8 pixels against all colors of a palette at once. The palette
+ * is split in planes, and the x86-64-v3 variant compares each of its
+ * colors with sixteen pixels at a time using AVX2, other variants leave
+ * the loop over the colors to the compiler to vectorize.
+ *
+ * The squared distance of a color, which is below 2^18, is shifted up
+ * and or-ed with the index of the color, so that a single minimum finds
+ * the closest color with ties going to the lowest index. The match of a
+ * pixel thus does not depend on the pixels converted before it.
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include "babl-internal.h"
+#include "babl-base.h"
+
+#ifdef X86_64_V3
+#include <immintrin.h>
+#endif
+
+#define MATCH_LANES 16
+
+static inline uint8_t
+match_pixel (const int32_t *red,
+             const int32_t *green,
+             const int32_t *blue,
+             int            count,
+             const uint8_t *rgba)
+{
+  int32_t r    = rgba[0];
+  int32_t g    = rgba[1];
+  int32_t b    = rgba[2];
+  int32_t best = INT32_MAX;
+
+  for (int32_t j = 0; j < count; j++)
+    {
+      int32_t dr  = r - red[j];
+      int32_t dg  = g - green[j];
+      int32_t db  = b - blue[j];
+      int32_t key = ((dr * dr + dg * dg + db * db) << 8) | j;
+
+      best = key < best ? key : best;
+    }
+
+  return best & 0xff;
+}
+
+#ifdef X86_64_V3
+/* the squared distances of eight pixels, given as 16bit red and green
+ * pairs and blue, from a color given the same way
+ */
+static inline __m256i
+distance_avx2 (__m256i rg,
+               __m256i b,
+               __m256i color_rg,
+               __m256i color_b)
+{
+  __m256i drg = _mm256_sub_epi16 (rg, color_rg);
+  __m256i db  = _mm256_sub_epi16 (b, color_b);
+
+  return _mm256_add_epi32 (_mm256_madd_epi16 (drg, drg),
+                           _mm256_madd_epi16 (db, db));
+}
+#endif
+
+/* finds the closest of count palette colors, given as R'G'B'A u8, for
+ * each of n R'G'B'A u8 pixels.
+ */
+void
+BABL_SIMD_SUFFIX (_babl_palette_match_u8) (const uint8_t *palette,
+                                           int            count,
+                                           const uint8_t *rgba,
+                                           uint8_t       *idx,
+                                           long           n)
+{
+  int32_t red[256], green[256], blue[256];
+  long    i = 0;
+
+  if (count > 256)
+    count = 256;
+
+  for (int j = 0; j < count; j++)
+    {
+      red[j]   = palette[j * 4 + 0];
+      green[j] = palette[j * 4 + 1];
+      blue[j]  = palette[j * 4 + 2];
+    }
+
+#ifdef X86_64_V3
+  {
+    const __m256i spread_rg = _mm256_setr_epi8 (
+      0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1,
+      0, -1, 1, -1, 4, -1, 5, -1, 8, -1, 9, -1, 12, -1, 13, -1);
+    const __m256i spread_b = _mm256_setr_epi8 (
+      2, -1, -1, -1, 6, -1, -1, -1, 10, -1, -1, -1, 14, -1, -1, -1,
+      2, -1, -1, -1, 6, -1, -1, -1, 10, -1, -1, -1, 14, -1, -1, -1);
+    const __m256i low = _mm256_set1_epi32 (0xff);
+
+    for (; i + MATCH_LANES <= n; i += MATCH_LANES)
+      {
+        /* two independent sets of eight pixels, to not wait on the
+         * latency of the minimum
+         */
+        __m256i px0   = _mm256_loadu_si256 ((const __m256i*)(rgba + i * 4));
+        __m256i px1   = _mm256_loadu_si256 ((const __m256i*)(rgba + i * 4 + 32));
+        __m256i rg0   = _mm256_shuffle_epi8 (px0, spread_rg);
+        __m256i rg1   = _mm256_shuffle_epi8 (px1, spread_rg);
+        __m256i b0    = _mm256_shuffle_epi8 (px0, spread_b);
+        __m256i b1    = _mm256_shuffle_epi8 (px1, spread_b);
+        __m256i best0 = _mm256_set1_epi32 (INT32_MAX);
+        __m256i best1 = best0;
+        __m128i packed;
+
+        for (int j = 0; j < count; j++)
+          {
+            __m256i color_rg = _mm256_set1_epi32 (red[j] | (green[j] << 16));
+            __m256i color_b  = _mm256_set1_epi32 (blue[j]);
+            __m256i index    = _mm256_set1_epi32 (j);
+
+            best0 = _mm256_min_epi32 (best0, _mm256_or_si256 (index,
+                      _mm256_slli_epi32 (distance_avx2 (rg0, b0, color_rg, color_b), 8)));
+            best1 = _mm256_min_epi32 (best1, _mm256_or_si256 (index,
+                      _mm256_slli_epi32 (distance_avx2 (rg1, b1, color_rg, color_b), 8)));
+          }
+
+        best0  = _mm256_and_si256 (best0, low);
+        best1  = _mm256_and_si256 (best1, low);
+        packed = _mm_packus_epi16 (
+                   _mm_packus_epi32 (_mm256_castsi256_si128 (best0),
+                                     _mm256_extracti128_si256 (best0, 1)),
+                   _mm_packus_epi32 (_mm256_castsi256_si128 (best1),
+                                     _mm256_extracti128_si256 (best1, 1)));
+        _mm_storeu_si128 ((__m128i*)(idx + i), packed);
+      }
+  }
+#endif
+
+  for (; i < n; i++)
+    idx[i] = match_pixel (red, green, blue, count, rgba + i * 4);
+}
@@ -0,0 +1,240 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* The inner loops of the single precision reference fish, unpacking and
+ * packing the u8, u16, half and float components of formats laid out like
+ * their model and applying the RGB matrix between spaces, built once per
+ * SIMD variant of the base library. The x86-64-v3 variant uses AVX2 and the
+ * arm-neon variant NEON for the matrix, other loops are left for the
+ * compiler to vectorize. The results are the same as those of the
+ * generic per component type conversions.
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <math.h>
+#include "babl-internal.h"
+#include "babl-base.h"
+
+#ifdef X86_64_V3
+#include <immintrin.h>
+#endif
+#ifdef ARM_NEON
+#include <arm_neon.h>
+#endif
+
+static inline void
+unpack_u16 (const uint16_t *src,
+            float          *dst,
+            long            n)
+{
+  long i = 0;
+#ifdef X86_64_V3
+  const __m256 scale = _mm256_set1_ps (65535.0f);
+
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256i v = _mm256_cvtepu16_epi32 (_mm_loadu_si128 ((const __m128i*)(src + i)));
+      _mm256_storeu_ps (dst + i, _mm256_div_ps (_mm256_cvtepi32_ps (v), scale));
+    }
+#endif
+  for (; i < n; i++)
+    dst[i] = src[i] / 65535.0f;
+}
+
+/* float times 255 or 65535 is exact in double precision, which is where
+ * the generic conversions round, rounding the product in single precision
+ * would be off by one for values like 0.3
+ */
+#ifdef X86_64_V3
+static inline __m256i
+scale_round_avx2 (const float *src,
+                  __m256d      scale)
+{
+  const __m256 zero = _mm256_setzero_ps ();
+  const __m256 one  = _mm256_set1_ps (1.0f);
+  __m256       v    = _mm256_min_ps (_mm256_max_ps (_mm256_loadu_ps (src), zero), one);
+  __m128i      lo   = _mm256_cvtpd_epi32 (_mm256_mul_pd (
+                        _mm256_cvtps_pd (_mm256_castps256_ps128 (v)), scale));
+  __m128i      hi   = _mm256_cvtpd_epi32 (_mm256_mul_pd (
+                        _mm256_cvtps_pd (_mm256_extractf128_ps (v, 1)), scale));
+
+  return _mm256_inserti128_si256 (_mm256_castsi128_si256 (lo), hi, 1);
+}
+#endif
+
+static inline void
+pack_u8 (const float *src,
+         uint8_t     *dst,
+         long         n)
+{
+  long i = 0;
+#ifdef X86_64_V3
+  const __m256d scale = _mm256_set1_pd (255.0);
+
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256i u = scale_round_avx2 (src + i, scale);
+      __m128i w = _mm_packus_epi32 (_mm256_castsi256_si128 (u),
+                                    _mm256_extracti128_si256 (u, 1));
+      _mm_storel_epi64 ((__m128i*)(dst + i), _mm_packus_epi16 (w, w));
+    }
+#endif
+  for (; i < n; i++)
+    {
+      float v = src[i];
+      dst[i] = v >= 1.0f ? 255 : v > 0.0f ? (uint8_t) rint (v * 255.0) : 0;
+    }
+}
+
+static inline void
+pack_u16 (const float *src,
+          uint16_t    *dst,
+          long         n)
+{
+  long i = 0;
+#ifdef X86_64_V3
+  const __m256d scale = _mm256_set1_pd (65535.0);
+
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256i u = scale_round_avx2 (src + i, scale);
+      _mm_storeu_si128 ((__m128i*)(dst + i),
+                        _mm_packus_epi32 (_mm256_castsi256_si128 (u),
+                                          _mm256_extracti128_si256 (u, 1)));
+    }
+#endif
+  for (; i < n; i++)
+    {
+      float v = src[i];
+      dst[i] = v >= 1.0f ? 65535 : v > 0.0f ? (uint16_t) rint (v * 65535.0) : 0;
+    }
+}
+
+/* converts n values of the type with the given id to float, returning 0
+ * for types not handled here.
+ */
+int
+BABL_SIMD_SUFFIX (_babl_reference_to_float) (int         type_id,
+                                             const void *src,
+                                             float      *dst,
+                                             long        n)
+{
+  switch (type_id)
+    {
+      case BABL_U8:
+        {
+          const uint8_t *s = src;
+
+          for (long i = 0; i < n; i++)
+            dst[i] = s[i] / 255.0f;
+        }
+        return 1;
+      case BABL_U16:
+        unpack_u16 (src, dst, n);
+        return 1;
+      case BABL_HALF:
+        BABL_SIMD_SUFFIX (_babl_half_to_float_buf) (src, dst, n);
+        return 1;
+      case BABL_FLOAT:
+        if (src != dst)
+          memcpy (dst, src, n * sizeof (float));
+        return 1;
+      default:
+        return 0;
+    }
+}
+
+/* converts n floats to values of the type with the given id, returning 0
+ * for types not handled here.
+ */
+int
+BABL_SIMD_SUFFIX (_babl_reference_from_float) (int          type_id,
+                                               const float *src,
+                                               void        *dst,
+                                               long         n)
+{
+  switch (type_id)
+    {
+      case BABL_U8:
+        pack_u8 (src, dst, n);
+        return 1;
+      case BABL_U16:
+        pack_u16 (src, dst, n);
+        return 1;
+      case BABL_HALF:
+        BABL_SIMD_SUFFIX (_babl_float_to_half_buf) (src, dst, n);
+        return 1;
+      case BABL_FLOAT:
+        if (src != dst)
+          memcpy (dst, src, n * sizeof (float));
+        return 1;
+      default:
+        return 0;
+    }
+}
+
+/* multiplies the RGB of n RGBA float pixels, in place, with a row major
+ * 3x3 matrix, leaving alpha as is.
+ */
+void
+BABL_SIMD_SUFFIX (_babl_reference_matrix_buf4) (const float *matrix,
+                                                float       *rgba,
+                                                long         n)
+{
+  long i = 0;
+#if defined(X86_64_V3)
+  /* two pixels per register, the columns of the matrix are scaled by
+   * broadcast R, G and B and summed
+   */
+  const __m256 col0 = _mm256_setr_ps (matrix[0], matrix[3], matrix[6], 0.0f,
+                                      matrix[0], matrix[3], matrix[6], 0.0f);
+  const __m256 col1 = _mm256_setr_ps (matrix[1], matrix[4], matrix[7], 0.0f,
+                                      matrix[1], matrix[4], matrix[7], 0.0f);
+  const __m256 col2 = _mm256_setr_ps (matrix[2], matrix[5], matrix[8], 0.0f,
+                                      matrix[2], matrix[5], matrix[8], 0.0f);
+
+  for (; i + 2 <= n; i += 2)
+    {
+      __m256 v = _mm256_loadu_ps (rgba + i * 4);
+      __m256 o = _mm256_mul_ps (col0, _mm256_permute_ps (v, 0x00));
+
+      o = _mm256_add_ps (o, _mm256_mul_ps (col1, _mm256_permute_ps (v, 0x55)));
+      o = _mm256_add_ps (o, _mm256_mul_ps (col2, _mm256_permute_ps (v, 0xaa)));
+      _mm256_storeu_ps (rgba + i * 4, _mm256_blend_ps (o, v, 0x88));
+    }
+#elif defined(ARM_NEON)
+  const float c0[4] = { matrix[0], matrix[3], matrix[6], 0.0f };
+  const float c1[4] = { matrix[1], matrix[4], matrix[7], 0.0f };
+  const float c2[4] = { matrix[2], matrix[5], matrix[8], 0.0f };
+  const float32x4_t col0 = vld1q_f32 (c0);
+  const float32x4_t col1 = vld1q_f32 (c1);
+  const float32x4_t col2 = vld1q_f32 (c2);
+
+  for (; i < n; i++)
+    {
+      float32x4_t v = vld1q_f32 (rgba + i * 4);
+      float32x4_t o = vmulq_n_f32 (col0, vgetq_lane_f32 (v, 0));
+
+      o = vmlaq_n_f32 (o, col1, vgetq_lane_f32 (v, 1));
+      o = vmlaq_n_f32 (o, col2, vgetq_lane_f32 (v, 2));
+      vst1q_f32 (rgba + i * 4, vsetq_lane_f32 (vgetq_lane_f32 (v, 3), o, 3));
+    }
+#endif
+  babl_matrix_mul_vectorff_buf4 (matrix, rgba + i * 4, rgba + i * 4, n - i);
+}
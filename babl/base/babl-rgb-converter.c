@@ -4,6 +4,166 @@
 #include "babl-trc.h"
 #include "babl-base.h"
 
+/* For u8 output the destination TRC is applied by finding the code whose
+ * range contains the linear value: ENCODE_BINS coarse bins give the lowest
+ * code possible in a bin, and the linear thresholds between codes are
+ * stepped through from there.
+ */
+#define ENCODE_BINS 4096
+
+typedef struct
+{
+  float   threshold[256]; /* linear value from which code i is used */
+  uint8_t bin_code[ENCODE_BINS];
+  uint8_t below;          /* code of negative values, 0 unless the TRC clamps */
+} U8Encode;
+
+static inline int
+u8_encode_reference (const Babl *trc,
+                     float       value)
+{
+  value = babl_trc_from_linear (trc, value);
+  if (value <= 0.0f)
+    return 0;
+  if (value >= 1.0f)
+    return 255;
+  return value * 255.0f + 0.5f;
+}
+
+/* the smallest float encoding to code or above, found by bisecting the
+ * bit patterns of positive floats - which are ordered like their values -
+ * so that the tables give the same result as applying the TRC
+ */
+static float
+u8_encode_threshold (const Babl *trc,
+                     int         code)
+{
+  union { uint32_t i; float f; } lo = { 0 }, hi = { 0x3f800000 }, mid;
+
+  while (lo.i < hi.i)
+  {
+    mid.i = lo.i + (hi.i - lo.i) / 2;
+    if (u8_encode_reference (trc, mid.f) >= code)
+      hi.i = mid.i;
+    else
+      lo.i = mid.i + 1;
+  }
+  return lo.f;
+}
+
+static void
+prep_u8_encode (U8Encode   *encode,
+                const Babl *trc)
+{
+  int code = 0;
+
+  encode->threshold[0] = -1.0f;
+  encode->below = u8_encode_reference (trc, -1.0f);
+  for (int i = 1; i < 256; i++)
+    encode->threshold[i] = u8_encode_threshold (trc, i);
+
+  for (int bin = 0; bin < ENCODE_BINS; bin++)
+  {
+    float value = bin / (float) ENCODE_BINS;
+    while (code < 255 && value >= encode->threshold[code + 1])
+      code++;
+    encode->bin_code[bin] = code;
+  }
+}
+
+/* the tables only depend on the TRC, they are built the first time a
+ * fused converter encodes with it
+ */
+static const U8Encode *
+trc_u8_encode (const Babl *trc_)
+{
+  BablTRC  *trc = (void*) trc_;
+  U8Encode *encode = __atomic_load_n (&trc->u8_encode, __ATOMIC_ACQUIRE);
+  void     *expected = NULL;
+
+  if (encode)
+    return encode;
+
+  encode = babl_malloc (sizeof (U8Encode));
+  prep_u8_encode (encode, trc_);
+  if (!__atomic_compare_exchange_n (&trc->u8_encode, &expected, encode, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+  {
+    /* another thread got there first */
+    babl_free (encode);
+    encode = expected;
+  }
+  return encode;
+}
+
+/* For u16 and half input the source TRC is applied by looking up the
+ * linear value of each of the 65536 codes, the tables are shared by all
+ * conversions decoding with the TRC and built the first time one runs.
+ */
+#define WIDE_LUT_SIZE 65536
+
+static float *
+prep_wide_lut (const Babl *trc,
+               int         half)
+{
+  float    *lut   = babl_malloc (sizeof (float) * WIDE_LUT_SIZE);
+  uint16_t *codes = babl_malloc (sizeof (uint16_t) * WIDE_LUT_SIZE);
+
+  for (int i = 0; i < WIDE_LUT_SIZE; i++)
+    codes[i] = i;
+
+  if (half)
+    _babl_half_to_float_buf (codes, lut, WIDE_LUT_SIZE);
+  else
+    for (int i = 0; i < WIDE_LUT_SIZE; i++)
+      lut[i] = codes[i] / 65535.0f;
+  babl_free (codes);
+
+  babl_trc_to_linear_buf (trc, lut, lut, 1, 1, 1, WIDE_LUT_SIZE);
+  return lut;
+}
+
+/* the tables are shared by the conversions of all spaces decoding with a
+ * TRC, the first of them to be destroyed releases the tables of its TRCs
+ */
+static int
+wide_lut_conversion_destroy (void *data)
+{
+  const Babl *source_space = babl_conversion_get_source_space (data);
+
+  for (int c = 0; c < 3; c++)
+  {
+    BablTRC *trc = (void*) source_space->space.trc[c];
+
+    babl_free (__atomic_exchange_n (&trc->u16_lut, NULL, __ATOMIC_ACQ_REL));
+    babl_free (__atomic_exchange_n (&trc->half_lut, NULL, __ATOMIC_ACQ_REL));
+  }
+  return 0;
+}
+
+static const float *
+trc_wide_lut (const Babl *trc_,
+              int         half)
+{
+  BablTRC *trc = (void*) trc_;
+  float  **slot = half ? &trc->half_lut : &trc->u16_lut;
+  float   *lut = __atomic_load_n (slot, __ATOMIC_ACQUIRE);
+  float   *expected = NULL;
+
+  if (lut)
+    return lut;
+
+  lut = prep_wide_lut (trc_, half);
+  if (!__atomic_compare_exchange_n (slot, &expected, lut, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+  {
+    /* another thread got there first */
+    babl_free (lut);
+    lut = expected;
+  }
+  return lut;
+}
+
 static void
 prep_conversion (const Babl *babl)
 {
@@ -36,6 +196,39 @@ prep_conversion (const Babl *babl)
   }
 }
 
+static void
+wide_lut_conversion (const Babl *babl,
+                     int         matrix)
+{
+  if (matrix)
+    prep_conversion (babl);
+  babl_set_destructor ((void*) babl, wide_lut_conversion_destroy);
+}
+
+/* like the wide tables, the encoding tables of a TRC are shared by the
+ * conversions of all spaces encoding with it
+ */
+static int
+u8_encode_conversion_destroy (void *data)
+{
+  const Babl *destination_space = babl_conversion_get_destination_space (data);
+
+  for (int c = 0; c < 3; c++)
+  {
+    BablTRC *trc = (void*) destination_space->space.trc[c];
+
+    babl_free (__atomic_exchange_n (&trc->u8_encode, NULL, __ATOMIC_ACQ_REL));
+  }
+  return 0;
+}
+
+static void
+u8_encode_conversion (const Babl *babl)
+{
+  prep_conversion (babl);
+  babl_set_destructor ((void*) babl, u8_encode_conversion_destroy);
+}
+
 #define TRC_IN(rgba_in, rgba_out)  do{ int i;\
   for (i = 0; i < samples; i++) \
   { \
@@ -184,6 +377,78 @@ universal_y_converter (const Babl    *conversion,
 }
 
 
+/* The fused converters below carry each pixel from decoding, through the
+ * TRCs and the matrix, to encoding in registers - instead of making a pass
+ * over an intermediate float buffer per step, which a path of the
+ * individual conversions would do.
+ */
+static inline uint8_t
+fused_encode_u8 (const U8Encode *encode,
+                 float           value)
+{
+  int bin, code;
+
+  if (value >= 1.0f)
+    return 255;
+
+  /* checked on the integer, as NaN compares can be optimized away */
+  bin = value * ENCODE_BINS;
+  if (bin < 0 || bin >= ENCODE_BINS)
+    return encode->below;
+
+  code = encode->bin_code[bin];
+  while (code < 255 && value >= encode->threshold[code + 1])
+    code++;
+  return code;
+}
+
+static inline uint8_t
+fused_alpha_u8 (float value)
+{
+  if (value <= 0.0f)
+    return 0;
+  if (value >= 1.0f)
+    return 255;
+  return value * 255.0f + 0.5f;
+}
+
+static inline void
+fused_nonlinear_u8_converter (const Babl    *conversion,
+                              unsigned char *__restrict__ src_char,
+                              unsigned char *__restrict__ dst_char,
+                              long           samples,
+                              void          *data,
+                              int            components)
+{
+  const Babl *destination_space = conversion->conversion.destination->format.space;
+  const float *m = data;
+  const float *in_trc_lut_red   = m + 9;
+  const float *in_trc_lut_green = in_trc_lut_red + 256;
+  const float *in_trc_lut_blue  = in_trc_lut_green + 256;
+  const U8Encode *encode[3]     = {
+    trc_u8_encode (destination_space->space.trc[0]),
+    trc_u8_encode (destination_space->space.trc[1]),
+    trc_u8_encode (destination_space->space.trc[2]) };
+  const uint8_t *in  = (void*)src_char;
+  uint8_t       *out = (void*)dst_char;
+  long i;
+
+  for (i = 0; i < samples; i++)
+  {
+    float r = in_trc_lut_red[in[0]];
+    float g = in_trc_lut_green[in[1]];
+    float b = in_trc_lut_blue[in[2]];
+
+    out[0] = fused_encode_u8 (encode[0], m[0] * r + m[1] * g + m[2] * b);
+    out[1] = fused_encode_u8 (encode[1], m[3] * r + m[4] * g + m[5] * b);
+    out[2] = fused_encode_u8 (encode[2], m[6] * r + m[7] * g + m[8] * b);
+    if (components == 4)
+      out[3] = in[3];
+    in  += components;
+    out += components;
+  }
+}
+
 static inline void
 universal_nonlinear_rgb_u8_converter (const Babl    *conversion,
                                       unsigned char *__restrict__ src_char,
@@ -191,36 +456,185 @@ universal_nonlinear_rgb_u8_converter (const Babl    *conversion,
                                       long           samples,
                                       void          *data)
 {
-  const Babl *destination_space = conversion->conversion.destination->format.space;
+  fused_nonlinear_u8_converter (conversion, src_char, dst_char, samples, data, 3);
+}
 
-  float * matrixf = data;
-  float * in_trc_lut_red = matrixf + 9;
-  float * in_trc_lut_green = in_trc_lut_red + 256;
-  float * in_trc_lut_blue = in_trc_lut_green + 256;
-  unsigned int i;
-  uint8_t *rgb_in_u8 = (void*)src_char;
-  uint8_t *rgb_out_u8 = (void*)dst_char;
+static inline void
+universal_nonlinear_rgba_u8_converter (const Babl    *conversion,
+                                       unsigned char *__restrict__ src_char,
+                                       unsigned char *__restrict__ dst_char,
+                                       long           samples,
+                                       void          *data)
+{
+  fused_nonlinear_u8_converter (conversion, src_char, dst_char, samples, data, 4);
+}
 
-  float rgba_out[4*samples];
+static inline void
+universal_nonlinear_rgba_u8_linear_converter (const Babl    *conversion,
+                                              unsigned char *__restrict__ src_char,
+                                              unsigned char *__restrict__ dst_char,
+                                              long           samples,
+                                              void          *data)
+{
+  const float *m = data;
+  const float *in_trc_lut_red   = m + 9;
+  const float *in_trc_lut_green = in_trc_lut_red + 256;
+  const float *in_trc_lut_blue  = in_trc_lut_green + 256;
+  const uint8_t *in  = (void*)src_char;
+  float         *out = (void*)dst_char;
+  long i;
 
   for (i = 0; i < samples; i++)
   {
-    rgba_out[i*4+0]=in_trc_lut_red[rgb_in_u8[i*3+0]];
-    rgba_out[i*4+1]=in_trc_lut_green[rgb_in_u8[i*3+1]];
-    rgba_out[i*4+2]=in_trc_lut_blue[rgb_in_u8[i*3+2]];
-    rgba_out[i*4+3]=rgb_in_u8[i*3+2] * 255.0f;
+    float r = in_trc_lut_red[in[0]];
+    float g = in_trc_lut_green[in[1]];
+    float b = in_trc_lut_blue[in[2]];
+
+    out[0] = m[0] * r + m[1] * g + m[2] * b;
+    out[1] = m[3] * r + m[4] * g + m[5] * b;
+    out[2] = m[6] * r + m[7] * g + m[8] * b;
+    out[3] = in[3] / 255.0f;
+    in  += 4;
+    out += 4;
   }
+}
 
-  babl_matrix_mul_vectorff_buf4 (matrixf, rgba_out, rgba_out, samples);
+/* R'G'B'A u16 and half to RGBA float in another space, a gather from the
+ * TRC tables followed by the matrix
+ */
+static inline void
+wide_nonlinear_rgba_linear_converter (const Babl    *conversion,
+                                      unsigned char *__restrict__ src_char,
+                                      unsigned char *__restrict__ dst_char,
+                                      long           samples,
+                                      void          *data,
+                                      int            half)
+{
+  const Babl *source_space = babl_conversion_get_source_space (conversion);
+  const float *m = data;
+  const float *lut_red   = trc_wide_lut (source_space->space.trc[0], half);
+  const float *lut_green = trc_wide_lut (source_space->space.trc[1], half);
+  const float *lut_blue  = trc_wide_lut (source_space->space.trc[2], half);
+  const uint16_t *in  = (void*)src_char;
+  float          *out = (void*)dst_char;
+  long i;
 
+  for (i = 0; i < samples; i++)
   {
-    TRC_OUT(rgba_out, rgba_out);
+    float r = lut_red[in[0]];
+    float g = lut_green[in[1]];
+    float b = lut_blue[in[2]];
+
+    out[0] = m[0] * r + m[1] * g + m[2] * b;
+    out[1] = m[3] * r + m[4] * g + m[5] * b;
+    out[2] = m[6] * r + m[7] * g + m[8] * b;
+    if (half)
+      _babl_half_to_float (&out[3], &in[3], 1);
+    else
+      out[3] = in[3] / 65535.0f;
+    in  += 4;
+    out += 4;
+  }
+}
+
+static inline void
+universal_nonlinear_rgba_u16_linear_converter (const Babl    *conversion,
+                                               unsigned char *__restrict__ src_char,
+                                               unsigned char *__restrict__ dst_char,
+                                               long           samples,
+                                               void          *data)
+{
+  wide_nonlinear_rgba_linear_converter (conversion, src_char, dst_char, samples, data, 0);
+}
 
-    for (i = 0; i < samples; i++)
-      for (unsigned int c = 0; c < 3; c ++)
-        rgb_out_u8[i*3+c] = rgba_out[i*4+c] * 255.0f;
+static inline void
+universal_nonlinear_rgba_half_linear_converter (const Babl    *conversion,
+                                                unsigned char *__restrict__ src_char,
+                                                unsigned char *__restrict__ dst_char,
+                                                long           samples,
+                                                void          *data)
+{
+  wide_nonlinear_rgba_linear_converter (conversion, src_char, dst_char, samples, data, 1);
+}
+
+/* the same within a single space, where only the TRCs are applied */
+static inline void
+wide_nonlinear_rgba_linear_same_space (const Babl    *conversion,
+                                       unsigned char *__restrict__ src_char,
+                                       unsigned char *__restrict__ dst_char,
+                                       long           samples,
+                                       int            half)
+{
+  const Babl *source_space = babl_conversion_get_source_space (conversion);
+  const float *lut_red   = trc_wide_lut (source_space->space.trc[0], half);
+  const float *lut_green = trc_wide_lut (source_space->space.trc[1], half);
+  const float *lut_blue  = trc_wide_lut (source_space->space.trc[2], half);
+  const uint16_t *in  = (void*)src_char;
+  float          *out = (void*)dst_char;
+  long i;
+
+  for (i = 0; i < samples; i++)
+  {
+    out[0] = lut_red[in[0]];
+    out[1] = lut_green[in[1]];
+    out[2] = lut_blue[in[2]];
+    if (half)
+      _babl_half_to_float (&out[3], &in[3], 1);
+    else
+      out[3] = in[3] / 65535.0f;
+    in  += 4;
+    out += 4;
   }
+}
+
+static inline void
+universal_nonlinear_rgba_u16_linear_same_space (const Babl    *conversion,
+                                                unsigned char *__restrict__ src_char,
+                                                unsigned char *__restrict__ dst_char,
+                                                long           samples,
+                                                void          *data)
+{
+  wide_nonlinear_rgba_linear_same_space (conversion, src_char, dst_char, samples, 0);
+}
+
+static inline void
+universal_nonlinear_rgba_half_linear_same_space (const Babl    *conversion,
+                                                 unsigned char *__restrict__ src_char,
+                                                 unsigned char *__restrict__ dst_char,
+                                                 long           samples,
+                                                 void          *data)
+{
+  wide_nonlinear_rgba_linear_same_space (conversion, src_char, dst_char, samples, 1);
+}
+
+static inline void
+universal_linear_rgba_nonlinear_u8_converter (const Babl    *conversion,
+                                              unsigned char *__restrict__ src_char,
+                                              unsigned char *__restrict__ dst_char,
+                                              long           samples,
+                                              void          *data)
+{
+  const Babl     *destination_space = conversion->conversion.destination->format.space;
+  const float    *m      = data;
+  const U8Encode *encode[3] = {
+    trc_u8_encode (destination_space->space.trc[0]),
+    trc_u8_encode (destination_space->space.trc[1]),
+    trc_u8_encode (destination_space->space.trc[2]) };
+  const float *in  = (void*)src_char;
+  uint8_t     *out = (void*)dst_char;
+  long i;
 
+  for (i = 0; i < samples; i++)
+  {
+    float r = in[0], g = in[1], b = in[2];
+
+    out[0] = fused_encode_u8 (encode[0], m[0] * r + m[1] * g + m[2] * b);
+    out[1] = fused_encode_u8 (encode[1], m[3] * r + m[4] * g + m[5] * b);
+    out[2] = fused_encode_u8 (encode[2], m[6] * r + m[7] * g + m[8] * b);
+    out[3] = fused_alpha_u8 (in[3]);
+    in  += 4;
+    out += 4;
+  }
 }
 
 
@@ -289,45 +703,6 @@ universal_rgba_converter_sse2 (const Babl *conversion,
   babl_matrix_mul_vectorff_buf4_sse2 (matrixf, rgba_in, rgba_out, samples);
 }
 
-static inline void
-universal_nonlinear_rgb_u8_converter_sse2 (const Babl    *conversion,
-                                           unsigned char *__restrict__ src_char,
-                                           unsigned char *__restrict__ dst_char,
-                                           long           samples,
-                                           void          *data)
-{
-  const Babl *destination_space = conversion->conversion.destination->format.space;
-
-  float * matrixf = data;
-  float * in_trc_lut_red = matrixf + 9;
-  float * in_trc_lut_green = in_trc_lut_red + 256;
-  float * in_trc_lut_blue = in_trc_lut_green + 256;
-  unsigned int i;
-  uint8_t *rgb_in_u8 = (void*)src_char;
-  uint8_t *rgb_out_u8 = (void*)dst_char;
-
-  // The alignment is necessary for SIMD intrinsics in babl_matrix_mul_vectorff_buf4_sse2()
-  float __attribute__ ((aligned (16))) rgba_out[4*samples];
-
-  for (i = 0; i < samples; i++)
-  {
-    rgba_out[i*4+0]=in_trc_lut_red[rgb_in_u8[i*3+0]];
-    rgba_out[i*4+1]=in_trc_lut_green[rgb_in_u8[i*3+1]];
-    rgba_out[i*4+2]=in_trc_lut_blue[rgb_in_u8[i*3+2]];
-  }
-
-  babl_matrix_mul_vectorff_buf4_sse2 (matrixf, rgba_out, rgba_out, samples);
-
-  {
-    TRC_OUT(rgba_out, rgba_out);
-
-    for (i = 0; i < samples; i++)
-      for (unsigned c = 0; c < 3; c ++)
-        rgb_out_u8[i*3+c] = rgba_out[i*4+c] * 255 + 0.5f;
-  }
-}
-
-
 static inline void
 universal_nonlinear_rgb_linear_converter_sse2 (const Babl    *conversion,
                                                unsigned char *__restrict__ src_char,
@@ -378,6 +753,24 @@ universal_linear_rgb_nonlinear_converter_sse2 (const Babl    *conversion,
 #endif
 
 
+/* conversions within a single space, sRGB gets these from babl base as
+ * it is never set up like other spaces
+ */
+static void
+add_same_space_adapters (const Babl *space)
+{
+  wide_lut_conversion (babl_conversion_new(
+                       babl_format_with_space("R'G'B'A u16", space),
+                       babl_format_with_space("RGBA float", space),
+                       "linear", universal_nonlinear_rgba_u16_linear_same_space,
+                       NULL), 0);
+  wide_lut_conversion (babl_conversion_new(
+                       babl_format_with_space("R'G'B'A half", space),
+                       babl_format_with_space("RGBA float", space),
+                       "linear", universal_nonlinear_rgba_half_linear_same_space,
+                       NULL), 0);
+}
+
 static int
 add_rgb_adapter (Babl *babl,
                  void *space)
@@ -431,17 +824,6 @@ add_rgb_adapter (Babl *babl,
                        babl_format_with_space("R'G'B'A float", babl),
                        "linear", universal_linear_rgb_nonlinear_converter_sse2,
                        NULL));
-
-       prep_conversion(babl_conversion_new(
-                       babl_format_with_space("R'G'B' u8", space),
-                       babl_format_with_space("R'G'B' u8", babl),
-                       "linear", universal_nonlinear_rgb_u8_converter_sse2,
-                       NULL));
-       prep_conversion(babl_conversion_new(
-                       babl_format_with_space("R'G'B' u8", babl),
-                       babl_format_with_space("R'G'B' u8", space),
-                       "linear", universal_nonlinear_rgb_u8_converter_sse2,
-                       NULL));
     }
     else
 #endif
@@ -483,17 +865,6 @@ add_rgb_adapter (Babl *babl,
 #endif
 
 #if 1
-       prep_conversion(babl_conversion_new(
-                       babl_format_with_space("R'G'B' u8", space),
-                       babl_format_with_space("R'G'B' u8", babl),
-                       "linear", universal_nonlinear_rgb_u8_converter,
-                       NULL));
-       prep_conversion(babl_conversion_new(
-                       babl_format_with_space("R'G'B' u8", babl),
-                       babl_format_with_space("R'G'B' u8", space),
-                       "linear", universal_nonlinear_rgb_u8_converter,
-                       NULL));
-
        prep_conversion(babl_conversion_new(
                        babl_format_with_space("RGBA float", babl),
                        babl_format_with_space("R'G'B'A float", space),
@@ -506,6 +877,66 @@ add_rgb_adapter (Babl *babl,
                        NULL));
 #endif
     }
+    u8_encode_conversion (babl_conversion_new(
+                         babl_format_with_space("R'G'B' u8", space),
+                         babl_format_with_space("R'G'B' u8", babl),
+                         "linear", universal_nonlinear_rgb_u8_converter,
+                         NULL));
+    u8_encode_conversion (babl_conversion_new(
+                         babl_format_with_space("R'G'B' u8", babl),
+                         babl_format_with_space("R'G'B' u8", space),
+                         "linear", universal_nonlinear_rgb_u8_converter,
+                         NULL));
+    u8_encode_conversion (babl_conversion_new(
+                         babl_format_with_space("R'G'B'A u8", space),
+                         babl_format_with_space("R'G'B'A u8", babl),
+                         "linear", universal_nonlinear_rgba_u8_converter,
+                         NULL));
+    u8_encode_conversion (babl_conversion_new(
+                         babl_format_with_space("R'G'B'A u8", babl),
+                         babl_format_with_space("R'G'B'A u8", space),
+                         "linear", universal_nonlinear_rgba_u8_converter,
+                         NULL));
+    prep_conversion(babl_conversion_new(
+                    babl_format_with_space("R'G'B'A u8", space),
+                    babl_format_with_space("RGBA float", babl),
+                    "linear", universal_nonlinear_rgba_u8_linear_converter,
+                    NULL));
+    prep_conversion(babl_conversion_new(
+                    babl_format_with_space("R'G'B'A u8", babl),
+                    babl_format_with_space("RGBA float", space),
+                    "linear", universal_nonlinear_rgba_u8_linear_converter,
+                    NULL));
+    wide_lut_conversion (babl_conversion_new(
+                         babl_format_with_space("R'G'B'A u16", space),
+                         babl_format_with_space("RGBA float", babl),
+                         "linear", universal_nonlinear_rgba_u16_linear_converter,
+                         NULL), 1);
+    wide_lut_conversion (babl_conversion_new(
+                         babl_format_with_space("R'G'B'A u16", babl),
+                         babl_format_with_space("RGBA float", space),
+                         "linear", universal_nonlinear_rgba_u16_linear_converter,
+                         NULL), 1);
+    wide_lut_conversion (babl_conversion_new(
+                         babl_format_with_space("R'G'B'A half", space),
+                         babl_format_with_space("RGBA float", babl),
+                         "linear", universal_nonlinear_rgba_half_linear_converter,
+                         NULL), 1);
+    wide_lut_conversion (babl_conversion_new(
+                         babl_format_with_space("R'G'B'A half", babl),
+                         babl_format_with_space("RGBA float", space),
+                         "linear", universal_nonlinear_rgba_half_linear_converter,
+                         NULL), 1);
+    u8_encode_conversion (babl_conversion_new(
+                         babl_format_with_space("RGBA float", space),
+                         babl_format_with_space("R'G'B'A u8", babl),
+                         "linear", universal_linear_rgba_nonlinear_u8_converter,
+                         NULL));
+    u8_encode_conversion (babl_conversion_new(
+                         babl_format_with_space("RGBA float", babl),
+                         babl_format_with_space("R'G'B'A u8", space),
+                         "linear", universal_linear_rgba_nonlinear_u8_converter,
+                         NULL));
     prep_conversion(babl_conversion_new(
                     babl_format_with_space("RGB float", space),
                     babl_format_with_space("RGB float", babl),
@@ -532,6 +963,10 @@ add_rgb_adapter (Babl *babl,
                     "linear", universal_ya_converter,
                     NULL));
   }
+  else
+  {
+    add_same_space_adapters (space);
+  }
   return 0;
 }
 
@@ -547,3 +982,9 @@ BABL_SIMD_SUFFIX(_babl_space_add_universal_rgb) (const Babl *space)
 {
   babl_space_class_for_each (add_rgb_adapter, (void*)space);
 }
+
+void
+BABL_SIMD_SUFFIX(babl_base_universal_rgb) (void)
+{
+  add_same_space_adapters (babl_space ("sRGB"));
+}
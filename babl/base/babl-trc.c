@@ -28,6 +28,11 @@
 #include "babl-internal.h"
 #include "babl-base.h"
 #include "base/util.h"
+#include "babl-parallel.h"
+
+#ifdef X86_64_V3
+#include <immintrin.h>
+#endif
 
 static BablTRC trc_db[MAX_TRCS];
 
@@ -388,6 +393,164 @@ static inline void _babl_trc_linear_buf (const Babl  *trc_,
   }
 }
 
+/* evaluates a sampled curve, or its inverse, with the same clamping and
+ * interpolation as babl_trc_lut_to_linear and babl_trc_lut_from_linear,
+ * without branching on where in the table the value falls.
+ */
+static inline float
+_babl_trc_lut_eval (const float *table,
+                    int          size,
+                    float        x)
+{
+  float v = x * (size - 1);
+  int   entry;
+  float diff;
+
+  if (!(v > 0.0f))
+    return table[0];
+  if (v >= size - 1)
+    return table[size - 1];
+  entry = v;
+  diff  = v - entry;
+  return table[entry] * (1.0f - diff) + table[entry + 1] * diff;
+}
+
+static inline void
+_babl_trc_lut_eval_buf (const float *table,
+                        int          size,
+                        const float *in,
+                        float       *out,
+                        int          in_gap,
+                        int          out_gap,
+                        int          components,
+                        int          count)
+{
+  int i = 0;
+
+  if (size < 2)
+    {
+      for (i = 0; i < count; i ++)
+        for (int c = 0; c < components; c ++)
+          out[out_gap * i + c] = table[0];
+      return;
+    }
+
+#ifdef X86_64_V3
+  if (in_gap == out_gap && (in_gap == components ||
+                            (in_gap == 4 && components == 3)))
+    {
+      /* eight components at a time, gathering the two table entries
+       * around each of them, for RGBA the alpha lanes of out are kept
+       */
+      const __m256  scale    = _mm256_set1_ps (size - 1);
+      const __m256  zero     = _mm256_setzero_ps ();
+      const __m256  one      = _mm256_set1_ps (1.0f);
+      const __m256i last     = _mm256_set1_epi32 (size - 2);
+      const int     rgba     = in_gap != components;
+      long          block    = 8;
+      long          n;
+      long          j        = 0;
+
+      /* only whole pixels, the rest is done per pixel without evaluating
+       * a component twice - which in place would apply the curve twice
+       */
+      while (block % in_gap)
+        block += 8;
+      n = (long) count * in_gap / block * block;
+
+      for (; j + 8 <= n; j += 8)
+        {
+          /* max returns its second operand for NaN */
+          __m256  v     = _mm256_min_ps (_mm256_max_ps (_mm256_mul_ps (
+                              _mm256_loadu_ps (in + j), scale), zero), scale);
+          __m256i entry = _mm256_min_epi32 (_mm256_cvttps_epi32 (v), last);
+          __m256  diff  = _mm256_sub_ps (v, _mm256_cvtepi32_ps (entry));
+          __m256  a     = _mm256_i32gather_ps (table, entry, 4);
+          __m256  b     = _mm256_i32gather_ps (table + 1, entry, 4);
+          __m256  o     = _mm256_add_ps (_mm256_mul_ps (a, _mm256_sub_ps (one, diff)),
+                                         _mm256_mul_ps (b, diff));
+
+          if (rgba)
+            o = _mm256_blend_ps (o, _mm256_loadu_ps (out + j), 0x88);
+          _mm256_storeu_ps (out + j, o);
+        }
+      i = j / in_gap;
+    }
+#endif
+
+  for (; i < count; i ++)
+    for (int c = 0; c < components; c ++)
+      out[out_gap * i + c] = _babl_trc_lut_eval (table, size, in[in_gap * i + c]);
+}
+
+static void
+_babl_trc_lut_to_linear_buf (const Babl  *trc_,
+                             const float *in,
+                             float       *out,
+                             int          in_gap,
+                             int          out_gap,
+                             int          components,
+                             int          count)
+{
+  BablTRC *trc = (void*)trc_;
+  _babl_trc_lut_eval_buf (trc->lut, trc->lut_size,
+                          in, out, in_gap, out_gap, components, count);
+}
+
+static void
+_babl_trc_lut_from_linear_buf (const Babl  *trc_,
+                               const float *in,
+                               float       *out,
+                               int          in_gap,
+                               int          out_gap,
+                               int          components,
+                               int          count)
+{
+  BablTRC *trc = (void*)trc_;
+  _babl_trc_lut_eval_buf (trc->inv_lut, trc->lut_size,
+                          in, out, in_gap, out_gap, components, count);
+}
+
+/* sampled curves from camera and scanner profiles can have tens of
+ * thousands of entries, each entry of the inverse table is found by
+ * bisection, spread over the worker threads for large tables.
+ */
+#define INV_LUT_BLOCK 4096
+
+static void
+_babl_trc_inv_lut_job (int   job,
+                       int   n_jobs,
+                       void *user_data)
+{
+  BablTRC *trc   = user_data;
+  int      n_lut = trc->lut_size;
+  int      end   = (job + 1) * INV_LUT_BLOCK;
+
+  if (end > n_lut)
+    end = n_lut;
+
+  for (int j = job * INV_LUT_BLOCK; j < end; j++)
+    {
+      double min = 0.0;
+      double max = 1.0;
+      for (int k = 0; k < 16; k++)
+        {
+          double guess = (min + max) / 2;
+          float reversed_index = babl_trc_lut_to_linear (BABL(trc), guess) * (n_lut-1.0f);
+
+          if (reversed_index < j)
+            {
+              min = guess;
+            }
+          else if (reversed_index > j)
+            {
+              max = guess;
+            }
+        }
+      trc->inv_lut[j] = (min + max) / 2;
+    }
+}
+
 const Babl *
 BABL_SIMD_SUFFIX (babl_trc_lookup_by_name) (const char *name);
 
@@ -465,33 +628,13 @@ BABL_SIMD_SUFFIX (babl_trc_new) (const char *name,
 
   if (n_lut)
   {
-    int j;
     trc_db[i].lut_size = n_lut;
     trc_db[i].lut = babl_calloc (sizeof (float), n_lut);
     memcpy (trc_db[i].lut, lut, sizeof (float) * n_lut);
     trc_db[i].inv_lut = babl_calloc (sizeof (float), n_lut);
 
-    for (j = 0; j < n_lut; j++)
-    {
-      int k;
-      double min = 0.0;
-      double max = 1.0;
-      for (k = 0; k < 16; k++)
-      {
-        double guess = (min + max) / 2;
-        float reversed_index = babl_trc_lut_to_linear (BABL(&trc_db[i]), guess) * (n_lut-1.0f);
-
-        if (reversed_index < j)
-        {
-          min = guess;
-        }
-        else if (reversed_index > j)
-        {
-          max = guess;
-        }
-      }
-      trc_db[i].inv_lut[j] = (min + max) / 2;
-    }
+    babl_parallel_distribute ((n_lut + INV_LUT_BLOCK - 1) / INV_LUT_BLOCK,
+                              _babl_trc_inv_lut_job, &trc_db[i]);
   }
 
   trc_db[i].fun_to_linear_buf = _babl_trc_to_linear_buf_generic;
@@ -589,6 +732,8 @@ BABL_SIMD_SUFFIX (babl_trc_new) (const char *name,
     case BABL_TRC_LUT:
       trc_db[i].fun_to_linear = babl_trc_lut_to_linear;
       trc_db[i].fun_from_linear = babl_trc_lut_from_linear;
+      trc_db[i].fun_to_linear_buf = _babl_trc_lut_to_linear_buf;
+      trc_db[i].fun_from_linear_buf = _babl_trc_lut_from_linear_buf;
       break;
   }
   return (Babl*)&trc_db[i];
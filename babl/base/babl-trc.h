@@ -69,6 +69,9 @@ typedef struct
   char             name[128];
   int valid_u8_lut;
   float u8_lut[256];
+  void *u8_encode; /* tables for encoding linear values to u8, built lazily */
+  float *u16_lut;  /* linear values of all u16 codes, built lazily */
+  float *half_lut; /* linear values of all half bit patterns, built lazily */
 } BablTRC;
 
 static inline void babl_trc_from_linear_buf (const Babl *trc_,
@@ -612,6 +612,226 @@ cmy_to_rgba (const Babl *conversion,
 }
 #endif
 
+/* conversions between the integer and float CMYK formats, giving the path
+ * search steps to and from "CMYKA float" - where CMYK spaces convert to
+ * and from RGB.
+ */
+static void
+CMYK_u8_to_CMYKA_float (const Babl *conversion,
+                        const char *src,
+                        char       *dst,
+                        long        n,
+                        void       *data)
+{
+  const uint8_t *s = (void *) src;
+  float         *d = (void *) dst;
+
+  while (n--)
+    {
+      for (int c = 0; c < 4; c++)
+        d[c] = s[c] / 255.0f;
+      d[4] = 1.0f;
+      s += 4;
+      d += 5;
+    }
+}
+
+static void
+CMYKA_u8_to_CMYKA_float (const Babl *conversion,
+                         const char *src,
+                         char       *dst,
+                         long        n,
+                         void       *data)
+{
+  const uint8_t *s = (void *) src;
+  float         *d = (void *) dst;
+
+  n *= 5;
+  while (n--)
+    *d++ = *s++ / 255.0f;
+}
+
+static void
+CMYK_u16_to_CMYKA_float (const Babl *conversion,
+                         const char *src,
+                         char       *dst,
+                         long        n,
+                         void       *data)
+{
+  const uint16_t *s = (void *) src;
+  float          *d = (void *) dst;
+
+  while (n--)
+    {
+      for (int c = 0; c < 4; c++)
+        d[c] = s[c] / 65535.0f;
+      d[4] = 1.0f;
+      s += 4;
+      d += 5;
+    }
+}
+
+static void
+CMYKA_u16_to_CMYKA_float (const Babl *conversion,
+                          const char *src,
+                          char       *dst,
+                          long        n,
+                          void       *data)
+{
+  const uint16_t *s = (void *) src;
+  float          *d = (void *) dst;
+
+  n *= 5;
+  while (n--)
+    *d++ = *s++ / 65535.0f;
+}
+
+static void
+CMYK_float_to_CMYKA_float (const Babl *conversion,
+                           const char *src,
+                           char       *dst,
+                           long        n,
+                           void       *data)
+{
+  const float *s = (void *) src;
+  float       *d = (void *) dst;
+
+  while (n--)
+    {
+      for (int c = 0; c < 4; c++)
+        d[c] = s[c];
+      d[4] = 1.0f;
+      s += 4;
+      d += 5;
+    }
+}
+
+static inline int
+float_to_int_clamped (float value,
+                      float max)
+{
+  if (value >= 1.0f)
+    return max;
+  else if (value > 0.0f)
+    return value * max + 0.5f;
+  return 0;
+}
+
+static void
+CMYKA_float_to_CMYK_u8 (const Babl *conversion,
+                        const char *src,
+                        char       *dst,
+                        long        n,
+                        void       *data)
+{
+  const float *s = (void *) src;
+  uint8_t     *d = (void *) dst;
+
+  while (n--)
+    {
+      for (int c = 0; c < 4; c++)
+        d[c] = float_to_int_clamped (s[c], 255.0f);
+      s += 5;
+      d += 4;
+    }
+}
+
+static void
+CMYKA_float_to_CMYKA_u8 (const Babl *conversion,
+                         const char *src,
+                         char       *dst,
+                         long        n,
+                         void       *data)
+{
+  const float *s = (void *) src;
+  uint8_t     *d = (void *) dst;
+
+  n *= 5;
+  while (n--)
+    *d++ = float_to_int_clamped (*s++, 255.0f);
+}
+
+static void
+CMYKA_float_to_CMYK_u16 (const Babl *conversion,
+                         const char *src,
+                         char       *dst,
+                         long        n,
+                         void       *data)
+{
+  const float *s = (void *) src;
+  uint16_t    *d = (void *) dst;
+
+  while (n--)
+    {
+      for (int c = 0; c < 4; c++)
+        d[c] = float_to_int_clamped (s[c], 65535.0f);
+      s += 5;
+      d += 4;
+    }
+}
+
+static void
+CMYKA_float_to_CMYKA_u16 (const Babl *conversion,
+                          const char *src,
+                          char       *dst,
+                          long        n,
+                          void       *data)
+{
+  const float *s = (void *) src;
+  uint16_t    *d = (void *) dst;
+
+  n *= 5;
+  while (n--)
+    *d++ = float_to_int_clamped (*s++, 65535.0f);
+}
+
+static void
+CMYKA_float_to_CMYK_float (const Babl *conversion,
+                           const char *src,
+                           char       *dst,
+                           long        n,
+                           void       *data)
+{
+  const float *s = (void *) src;
+  float       *d = (void *) dst;
+
+  while (n--)
+    {
+      for (int c = 0; c < 4; c++)
+        d[c] = s[c];
+      s += 5;
+      d += 4;
+    }
+}
+
+static void
+format_conversions (void)
+{
+  static const struct
+  {
+    const char     *format;
+    BablFuncLinear  to_float;
+    BablFuncLinear  from_float;
+  } formats[] = {
+    { "CMYK u8",    CMYK_u8_to_CMYKA_float,    CMYKA_float_to_CMYK_u8 },
+    { "CMYKA u8",   CMYKA_u8_to_CMYKA_float,   CMYKA_float_to_CMYKA_u8 },
+    { "CMYK u16",   CMYK_u16_to_CMYKA_float,   CMYKA_float_to_CMYK_u16 },
+    { "CMYKA u16",  CMYKA_u16_to_CMYKA_float,  CMYKA_float_to_CMYKA_u16 },
+    { "CMYK float", CMYK_float_to_CMYKA_float, CMYKA_float_to_CMYK_float },
+  };
+  const Babl *cmyka_float = babl_format ("CMYKA float");
+
+  for (size_t i = 0; i < sizeof (formats) / sizeof (formats[0]); i++)
+    {
+      babl_conversion_new (babl_format (formats[i].format), cmyka_float,
+                           "linear", formats[i].to_float,
+                           NULL);
+      babl_conversion_new (cmyka_float, babl_format (formats[i].format),
+                           "linear", formats[i].from_float,
+                           NULL);
+    }
+}
+
 void
 BABL_SIMD_SUFFIX (babl_base_model_cmyk) (void)
 {
@@ -1179,5 +1399,7 @@ BABL_SIMD_SUFFIX (babl_base_model_cmyk) (void)
     babl_component ("A"),
     NULL
   );
+
+  format_conversions ();
 }
 
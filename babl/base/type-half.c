@@ -69,11 +69,22 @@
 #include "babl-classes.h"
 #include "babl-ids.h"
 #include "babl-base.h"
+#include "babl-half.h"
+
+#ifdef X86_64_V3
+#include <immintrin.h>
+#endif
+#ifdef ARM_NEON
+#include <arm_neon.h>
+#endif
 
 static int next = 1; /* should be 0 for big endian */
 
 //-----------------------------------------------------------------------------
 
+/* rounds like _babl_float_to_half_value, the bits shifted out of the
+ * mantissa - the low word of the double included - deciding the rounding.
+ */
 static void 
 doubles2halfp(void *target, 
               void *source, 
@@ -82,17 +93,18 @@ doubles2halfp(void *target,
     uint16_t *hp = (uint16_t *) target; // Type pun output as an unsigned 16-bit int
     uint32_t *xp = (uint32_t *) source; // Type pun input as an unsigned 32-bit int
     uint16_t    hs, he, hm;
-    uint32_t x, xs, xe, xm;
+    uint32_t x, lo, xs, xe, xm;
+    uint32_t round, sticky;
     int hes;
 
-    xp += next;  // Little Endian adjustment if necessary
-    
     if( source == NULL || target == NULL ) { // Nothing to convert (e.g., imag part of pure real)
         return;
     }
     while( numel-- ) {
-        x = *xp++; xp++; // The extra xp++ is to skip over the remaining 32 bits of the mantissa
-        if( (x & 0x7FFFFFFFu) == 0 ) {  // Signed zero
+        x  = xp[next];      // High 32 bits, sign exponent and top of the mantissa
+        lo = xp[1 - next];  // Remaining 32 bits of the mantissa
+        xp += 2;
+        if( (x & 0x7FFFFFFFu) == 0 && lo == 0 ) {  // Signed zero
             *hp++ = (uint16_t) (x >> 16);  // Return the signed zero
         } else { // Not zero
             xs = x & 0x80000000u;  // Pick off sign bit
@@ -101,10 +113,10 @@ doubles2halfp(void *target,
             if( xe == 0 ) {  // Denormal will underflow, return a signed zero
                 *hp++ = (uint16_t) (xs >> 16);
             } else if( xe == 0x7FF00000u ) {  // Inf or NaN (all the exponent bits are set)
-                if( xm == 0 ) { // If mantissa is zero ...
+                if( xm == 0 && lo == 0 ) { // If mantissa is zero ...
                     *hp++ = (uint16_t) ((xs >> 16) | 0x7C00u); // Signed Inf
-                } else {
-                    *hp++ = (uint16_t) 0xFE00u; // NaN, only 1st mantissa bit set
+                } else { // Quiet NaN, with the sign and top of the payload
+                    *hp++ = (uint16_t) ((xs >> 16) | 0x7E00u | (xm >> 10));
                 }
             } else { // Normalized number
                 hs = (uint16_t) (xs >> 16); // Sign bit
@@ -112,20 +124,24 @@ doubles2halfp(void *target,
                 if( hes >= 0x1F ) {  // Overflow
                     *hp++ = (uint16_t) ((xs >> 16) | 0x7C00u); // Signed Inf
                 } else if( hes <= 0 ) {  // Underflow
-                    if( (10 - hes) > 21 ) {  // Mantissa shifted all the way off & no rounding possibility
+                    if( (10 - hes) > 20 ) {  // Below half the smallest denormal, rounds to zero
                         hm = (uint16_t) 0u;  // Set mantissa to zero
                     } else {
                         xm |= 0x00100000u;  // Add the hidden leading bit
                         hm = (uint16_t) (xm >> (11 - hes)); // Mantissa
-                        if( (xm >> (10 - hes)) & 0x00000001u ) // Check for rounding
-                            hm += (uint16_t) 1u; // Round, might overflow into exp bit, but this is OK
+                        round  = (xm >> (10 - hes)) & 0x00000001u;
+                        sticky = (xm & ((1u << (10 - hes)) - 1u)) | lo;
+                        if( round && (sticky || (hm & 1u)) ) // Round to nearest, ties to even
+                            hm += (uint16_t) 1u; // Might overflow into exp bit, but this is OK
                     }
                     *hp++ = (hs | hm); // Combine sign bit and mantissa bits, biased exponent is zero
                 } else {
                     he = (uint16_t) (hes << 10); // Exponent
                     hm = (uint16_t) (xm >> 10); // Mantissa
-                    if( xm & 0x00000200u ) // Check for rounding
-                        *hp++ = (hs | he | hm) + (uint16_t) 1u; // Round, might overflow to inf, this is OK
+                    round  = xm & 0x00000200u;
+                    sticky = (xm & 0x000001FFu) | lo;
+                    if( round && (sticky || (hm & 1u)) ) // Round to nearest, ties to even
+                        *hp++ = (hs | he | hm) + (uint16_t) 1u; // Might overflow to inf, this is OK
                     else
                         *hp++ = (hs | he | hm);  // No rounding
                 }
@@ -134,65 +150,6 @@ doubles2halfp(void *target,
     }
 }
 
-static void 
-halfp2doubles(void *target, 
-              void *source, 
-              long  numel)
-{
-    uint16_t *hp = (uint16_t *) source; // Type pun input as an unsigned 16-bit int
-    uint32_t *xp = (uint32_t *) target; // Type pun output as an unsigned 32-bit int
-    uint16_t h, hs, he, hm;
-    uint32_t xs, xe, xm;
-    int32_t xes;
-    int e;
-    
-    if( source == NULL || target == NULL ) // Nothing to convert (e.g., imag part of pure real)
-        return;
-    while( numel-- ) {
-        uint32_t x;
-
-        h = *hp++;
-        if( (h & 0x7FFFu) == 0 ) {  // Signed zero
-            x = ((uint32_t) h) << 16;  // Return the signed zero
-        } else { // Not zero
-            hs = h & 0x8000u;  // Pick off sign bit
-            he = h & 0x7C00u;  // Pick off exponent bits
-            hm = h & 0x03FFu;  // Pick off mantissa bits
-            if( he == 0 ) {  // Denormal will convert to normalized
-                e = -1; // The following loop figures out how much extra to adjust the exponent
-                do {
-                    e++;
-                    hm <<= 1;
-                } while( (hm & 0x0400u) == 0 ); // Shift until leading bit overflows into exponent bit
-                xs = ((uint32_t) hs) << 16; // Sign bit
-                xes = ((int32_t) (he >> 10)) - 15 + 1023 - e; // Exponent unbias the halfp, then bias the double
-                xe = (uint32_t) (xes << 20); // Exponent
-                xm = ((uint32_t) (hm & 0x03FFu)) << 10; // Mantissa
-                x = (xs | xe | xm); // Combine sign bit, exponent bits, and mantissa bits
-            } else if( he == 0x7C00u ) {  // Inf or NaN (all the exponent bits are set)
-                if( hm == 0 ) { // If mantissa is zero ...
-                    x = (((uint32_t) hs) << 16) | ((uint32_t) 0x7FF00000u); // Signed Inf
-                } else {
-                    x = (uint32_t) 0xFFF80000u; // NaN, only the 1st mantissa bit set
-                }
-            } else {
-                xs = ((uint32_t) hs) << 16; // Sign bit
-                xes = ((int32_t) (he >> 10)) - 15 + 1023; // Exponent unbias the halfp, then bias the double
-                xe = (uint32_t) (xes << 20); // Exponent
-                xm = ((uint32_t) hm) << 10; // Mantissa
-                x = (xs | xe | xm); // Combine sign bit, exponent bits, and mantissa bits
-            }
-        }
-
-       xp[1 - next] = 0;
-       xp[next] = x;
-
-       xp += 2;
-    }
-}
-
-
-
 static void
 convert_double_half (BablConversion *conversion,
                      char           *src,
@@ -219,9 +176,9 @@ convert_half_double (BablConversion *conversion,
 {
   while (n--)
     {
-      halfp2doubles (dst, src, 1);
-      dst              += dst_pitch;
-      src              += src_pitch;
+      *(double *) dst = _babl_half_to_float_value (*(uint16_t *) src);
+      dst            += dst_pitch;
+      src            += src_pitch;
     }
 }
 
@@ -234,11 +191,17 @@ convert_float_half (BablConversion *conversion,
                     int             dst_pitch,
                     long            n)
 {
+  if (src_pitch == sizeof (float) && dst_pitch == sizeof (uint16_t))
+    {
+      _babl_float_to_half_buf ((float *) src, (uint16_t *) dst, n);
+      return;
+    }
+
   while (n--)
     {
-      _babl_float_to_half ((void*)dst, (float*)src, 1);
-      dst             += dst_pitch;
-      src             += src_pitch;
+      *(uint16_t *) dst = _babl_float_to_half_value (*(float *) src);
+      dst              += dst_pitch;
+      src              += src_pitch;
     }
 }
 
@@ -250,16 +213,65 @@ convert_half_float (BablConversion *conversion,
                     int             dst_pitch,
                     long            n)
 {
+  if (src_pitch == sizeof (uint16_t) && dst_pitch == sizeof (float))
+    {
+      _babl_half_to_float_buf ((uint16_t *) src, (float *) dst, n);
+      return;
+    }
+
   while (n--)
     {
-      _babl_half_to_float ((float*)dst, (void*)src, 1);
-      dst              += dst_pitch;
-      src              += src_pitch;
+      *(float *) dst = _babl_half_to_float_value (*(uint16_t *) src);
+      dst           += dst_pitch;
+      src           += src_pitch;
     }
 }
 
+/* converts n halfs to floats, the x86-64-v3 variant with F16C and the
+ * arm-neon variant with NEON where the FPU converts halfs, other variants
+ * leave the branch-free loop to the compiler to vectorize.
+ */
+void
+BABL_SIMD_SUFFIX (_babl_half_to_float_buf) (const uint16_t *src,
+                                            float          *dst,
+                                            long            n)
+{
+  long i = 0;
 
+#if defined(X86_64_V3)
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps (dst + i,
+                      _mm256_cvtph_ps (_mm_loadu_si128 ((const __m128i *)(src + i))));
+#elif defined(ARM_NEON) && (__ARM_FP & 2)
+  for (; i + 4 <= n; i += 4)
+    vst1q_f32 (dst + i, vcvt_f32_f16 (vreinterpret_f16_u16 (vld1_u16 (src + i))));
+#endif
+  for (; i < n; i++)
+    dst[i] = _babl_half_to_float_value (src[i]);
+}
 
+/* converts n floats to halfs, like _babl_half_to_float_buf, with the
+ * results of _babl_float_to_half_value in all variants.
+ */
+void
+BABL_SIMD_SUFFIX (_babl_float_to_half_buf) (const float *src,
+                                            uint16_t    *dst,
+                                            long         n)
+{
+  long i = 0;
+
+#if defined(X86_64_V3)
+  for (; i + 8 <= n; i += 8)
+    _mm_storeu_si128 ((__m128i *)(dst + i),
+                      _mm256_cvtps_ph (_mm256_loadu_ps (src + i),
+                                       _MM_FROUND_TO_NEAREST_INT));
+#elif defined(ARM_NEON) && (__ARM_FP & 2)
+  for (; i + 4 <= n; i += 4)
+    vst1_u16 (dst + i, vreinterpret_u16_f16 (vcvt_f16_f32 (vld1q_f32 (src + i))));
+#endif
+  for (; i < n; i++)
+    dst[i] = _babl_float_to_half_value (src[i]);
+}
 
 void
 BABL_SIMD_SUFFIX (babl_base_type_half) (void)
@@ -15,16 +15,131 @@
  * <https://www.gnu.org/licenses/>.
  */
 
+/* Y'CbCr with the luma coefficients of ITU-R BT.601 (the Y'CbCr models of
+ * babl base), BT.709 and BT.2020, all of them computed from the R'G'B' of
+ * the sRGB space. Besides float formats there are u8 and u16 formats in
+ * limited (video) and full range with 4:4:4, 4:2:2 and 4:2:0 chroma
+ * sampling, named like "Y'CbCr709 4:2:0 u8" and "Y'CbCr2020 4:2:2 u16 full".
+ * The subsampled formats are planar, their planes can be converted with
+ * babl_process_planes, while babl_process takes their samples interleaved
+ * like those of 4:4:4.
+ *
+ * All formats have single precision conversions to and from R'G'B'A
+ * float, loops the compiler vectorizes for the SIMD variants of this
+ * extension.
+ */
+
 #include "config.h"
 
 #include <math.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "babl.h"
 #include "base/util.h"
 
 
+typedef struct
+{
+  const char *model;
+  const char *model_alpha;
+  const char *alpha;       /* the name of the alpha component */
+  int         in_base;     /* the models are registered by babl base */
+  double      kr;          /* luma weights of red and blue */
+  double      kb;
+  double      encode[9];   /* R'G'B' to Y'CbCr */
+  float       encode_f[9];
+  float       cr_to_r;     /* the non-trivial entries of Y'CbCr to R'G'B' */
+  float       cb_to_g;
+  float       cr_to_g;
+  float       cb_to_b;
+} YCbCrStandard;
+
+static YCbCrStandard standards[] =
+{
+  { "Y'CbCr",     "Y'CbCrA",     "A",     1, 0.299,  0.114  },
+  { "Y'CbCr709",  "Y'CbCrA709",  "alpha", 0, 0.2126, 0.0722 },
+  { "Y'CbCr2020", "Y'CbCrA2020", "alpha", 0, 0.2627, 0.0593 },
+};
+#define N_STANDARDS (sizeof (standards) / sizeof (standards[0]))
+
+/* integer encodings of the components, the chroma of -0.5 to 0.5 is
+ * centered on chroma_center
+ */
+typedef struct
+{
+  const char *name;
+  int         bits;
+  const char *luma_type;
+  const char *chroma_type;
+  float       luma_min;
+  float       luma_max;
+  float       chroma_min;
+  float       chroma_max;
+  float       chroma_center;
+} YCbCrRange;
+
+static const YCbCrRange ranges[] =
+{
+  { "u8",        8, "u8-luma",  "u8-chroma",        16,   235,   16,    240,   128 },
+  { "u8 full",   8, "u8",       "u8-chroma-full",   0,    255,   0,     255,   128 },
+  { "u16",      16, "u16-luma", "u16-chroma",       4096, 60160, 4096,  61440, 32768 },
+  { "u16 full", 16, "u16",      "u16-chroma-full",  0,    65535, 0,     65535, 32768 },
+};
+#define N_RANGES (sizeof (ranges) / sizeof (ranges[0]))
+
+static const struct
+{
+  const char *name;
+  int         horizontal;
+  int         vertical;
+} samplings[] =
+{
+  { "4:4:4", 1, 1 },
+  { "4:2:2", 2, 1 },
+  { "4:2:0", 2, 2 },
+};
+#define N_SAMPLINGS (sizeof (samplings) / sizeof (samplings[0]))
+
+typedef struct
+{
+  const YCbCrStandard *standard;
+  const YCbCrRange    *range;
+} YCbCrCoding;
+
+static YCbCrCoding codings[N_STANDARDS][N_RANGES];
+
+/* the types of the ranges not in babl base, mapping the codes from min to
+ * max linearly to min_val to max_val
+ */
+typedef struct
+{
+  const char *name;
+  int         bits;
+  long        min;
+  long        max;
+  double      min_val;
+  double      max_val;
+  const char *doc;
+} YCbCrType;
+
+static const YCbCrType types[] =
+{
+  { "u8-chroma-full",   8, 0,    255,   -128.0 / 255.0,     127.0 / 255.0,
+    "8 bit unsigned integer, chroma centered on 128 with 255 codes per unit" },
+  { "u16-luma",        16, 4096, 60160, 0.0,                1.0,
+    "16 bit unsigned integer, values from 4096-60160" },
+  { "u16-chroma",      16, 4096, 61440, -0.5,               0.5,
+    "16 bit unsigned integer -0.5 to 0.5 maps to 4096-61440" },
+  { "u16-chroma-full", 16, 0,    65535, -32768.0 / 65535.0, 32767.0 / 65535.0,
+    "16 bit unsigned integer, chroma centered on 32768 with 65535 codes per unit" },
+};
+#define N_TYPES (sizeof (types) / sizeof (types[0]))
+
+
 static void components  (void);
+static void types_init  (void);
 static void models      (void);
 static void conversions (void);
 static void formats     (void);
@@ -38,6 +153,7 @@ init (void)
 {
   BABL_VERIFY_CPU();
   components ();
+  types_init ();
   models ();
   conversions ();
   formats ();
@@ -54,151 +170,313 @@ components (void)
 
 
 static void
-models (void)
+standard_init (YCbCrStandard *standard)
 {
-  babl_model_new (
-    "name", "Y'CbCr709",
-    babl_component ("Y'"),
-    babl_component ("Cb"),
-    babl_component ("Cr"),
-    NULL);
-
-  babl_model_new (
-    "name", "Y'CbCrA709",
-    babl_component ("Y'"),
-    babl_component ("Cb"),
-    babl_component ("Cr"),
-    babl_component ("alpha"),
-    "alpha",
-    NULL);
+  double kr = standard->kr;
+  double kb = standard->kb;
+  double kg = 1.0 - kr - kb;
+  double m[9] = {
+    kr,                          kg,                          kb,
+    -kr / (2.0 * (1.0 - kb)),    -kg / (2.0 * (1.0 - kb)),    0.5,
+    0.5,                         -kg / (2.0 * (1.0 - kr)),    -kb / (2.0 * (1.0 - kr))
+  };
+
+  for (int i = 0; i < 9; i++)
+    {
+      standard->encode[i]   = m[i];
+      standard->encode_f[i] = m[i];
+    }
+
+  standard->cr_to_r = 2.0 * (1.0 - kr);
+  standard->cb_to_g = -2.0 * kb * (1.0 - kb) / kg;
+  standard->cr_to_g = -2.0 * kr * (1.0 - kr) / kg;
+  standard->cb_to_b = 2.0 * (1.0 - kb);
 }
 
+static void
+convert_type_double (const Babl *conversion,
+                     char       *src,
+                     char       *dst,
+                     int         src_pitch,
+                     int         dst_pitch,
+                     long        n,
+                     void       *data)
+{
+  const YCbCrType *type = data;
+
+  while (n--)
+    {
+      long code = type->bits == 8 ? *(uint8_t *) src : *(uint16_t *) src;
+
+      code = code < type->min ? type->min : code > type->max ? type->max : code;
+      *(double *) dst = (code - type->min) / (double) (type->max - type->min) *
+                        (type->max_val - type->min_val) + type->min_val;
+
+      src += src_pitch;
+      dst += dst_pitch;
+    }
+}
 
 static void
-rgba_to_ycbcra709 (const Babl *conversion,
-                   char       *src,
-                   char       *dst,
-                   long        n)
+convert_double_type (const Babl *conversion,
+                     char       *src,
+                     char       *dst,
+                     int         src_pitch,
+                     int         dst_pitch,
+                     long        n,
+                     void       *data)
 {
+  const YCbCrType *type = data;
+
   while (n--)
     {
-      double red   = ((double *) src)[0];
-      double green = ((double *) src)[1];
-      double blue  = ((double *) src)[2];
-      double alpha = ((double *) src)[3];
+      double value = *(double *) src;
+      long   code;
+
+      if (value < type->min_val)
+        code = type->min;
+      else if (value > type->max_val)
+        code = type->max;
+      else
+        code = rint ((value - type->min_val) / (type->max_val - type->min_val) *
+                     (type->max - type->min) + type->min);
+
+      if (type->bits == 8)
+        *(uint8_t *) dst = code;
+      else
+        *(uint16_t *) dst = code;
+
+      src += src_pitch;
+      dst += dst_pitch;
+    }
+}
 
-      double luminance, cb, cr;
+static void
+convert_type_float (const Babl *conversion,
+                    char       *src,
+                    char       *dst,
+                    int         src_pitch,
+                    int         dst_pitch,
+                    long        n,
+                    void       *data)
+{
+  const YCbCrType *type = data;
 
-      red   = linear_to_gamma_2_2 (red);
-      green = linear_to_gamma_2_2 (green);
-      blue  = linear_to_gamma_2_2 (blue);
+  while (n--)
+    {
+      long code = type->bits == 8 ? *(uint8_t *) src : *(uint16_t *) src;
 
-      luminance =  0.2126 * red + 0.7152 * green + 0.0722 * blue;
-      cb        =  (blue - luminance) / 1.8556;
-      cr        =  (red  - luminance) / 1.5748;
+      code = code < type->min ? type->min : code > type->max ? type->max : code;
+      *(float *) dst = (code - type->min) / (float) (type->max - type->min) *
+                       (type->max_val - type->min_val) + type->min_val;
 
-      ((double *) dst)[0] = luminance;
-      ((double *) dst)[1] = cb;
-      ((double *) dst)[2] = cr;
-      ((double *) dst)[3] = alpha;
+      src += src_pitch;
+      dst += dst_pitch;
+    }
+}
 
-      src += sizeof (double) * 4;
-      dst += sizeof (double) * 4;
+static void
+convert_float_type (const Babl *conversion,
+                    char       *src,
+                    char       *dst,
+                    int         src_pitch,
+                    int         dst_pitch,
+                    long        n,
+                    void       *data)
+{
+  const YCbCrType *type = data;
+
+  while (n--)
+    {
+      float value = *(float *) src;
+      long  code;
+
+      if (value < type->min_val)
+        code = type->min;
+      else if (value > type->max_val)
+        code = type->max;
+      else
+        code = rint ((value - type->min_val) / (type->max_val - type->min_val) *
+                     (type->max - type->min) + type->min);
+
+      if (type->bits == 8)
+        *(uint8_t *) dst = code;
+      else
+        *(uint16_t *) dst = code;
+
+      src += src_pitch;
+      dst += dst_pitch;
+    }
+}
+
+static void
+types_init (void)
+{
+  for (unsigned int t = 0; t < N_TYPES; t++)
+    {
+      const YCbCrType *type = &types[t];
+
+      babl_type_new (
+        (void *) type->name,
+        "integer",
+        "unsigned",
+        "bits", type->bits,
+        "min", type->min,
+        "max", type->max,
+        "min_val", type->min_val,
+        "max_val", type->max_val,
+        "doc", type->doc,
+        NULL);
+
+      babl_conversion_new (babl_type (type->name), babl_type ("double"),
+                           "plane", convert_type_double, "data", type, NULL);
+      babl_conversion_new (babl_type ("double"), babl_type (type->name),
+                           "plane", convert_double_type, "data", type, NULL);
+      babl_conversion_new (babl_type (type->name), babl_type ("float"),
+                           "plane", convert_type_float, "data", type, NULL);
+      babl_conversion_new (babl_type ("float"), babl_type (type->name),
+                           "plane", convert_float_type, "data", type, NULL);
     }
 }
 
 
 static void
-rgba_to_ycbcr709 (const Babl *conversion,
-                  char       *src,
-                  char       *dst,
-                  long        n)
+models (void)
+{
+  for (unsigned int s = 0; s < N_STANDARDS; s++)
+    {
+      standard_init (&standards[s]);
+
+      for (unsigned int r = 0; r < N_RANGES; r++)
+        {
+          codings[s][r].standard = &standards[s];
+          codings[s][r].range    = &ranges[r];
+        }
+
+      if (standards[s].in_base)
+        continue;
+
+      babl_model_new (
+        "name", standards[s].model,
+        babl_component ("Y'"),
+        babl_component ("Cb"),
+        babl_component ("Cr"),
+        NULL);
+
+      babl_model_new (
+        "name", standards[s].model_alpha,
+        babl_component ("Y'"),
+        babl_component ("Cb"),
+        babl_component ("Cr"),
+        babl_component (standards[s].alpha),
+        "alpha",
+        NULL);
+    }
+}
+
+
+static inline void
+ycbcr_from_rgb (const double *m,
+                double        red,
+                double        green,
+                double        blue,
+                double       *ycbcr)
 {
+  ycbcr[0] = m[0] * red + m[1] * green + m[2] * blue;
+  ycbcr[1] = m[3] * red + m[4] * green + m[5] * blue;
+  ycbcr[2] = m[6] * red + m[7] * green + m[8] * blue;
+}
+
+static void
+rgba_to_ycbcra (const Babl *conversion,
+                char       *src,
+                char       *dst,
+                long        n,
+                void       *data)
+{
+  const YCbCrStandard *standard = data;
+
   while (n--)
     {
-      double red   = ((double *) src)[0];
-      double green = ((double *) src)[1];
-      double blue  = ((double *) src)[2];
+      double red   = linear_to_gamma_2_2 (((double *) src)[0]);
+      double green = linear_to_gamma_2_2 (((double *) src)[1]);
+      double blue  = linear_to_gamma_2_2 (((double *) src)[2]);
 
-      double luminance, cb, cr;
+      ycbcr_from_rgb (standard->encode, red, green, blue, (double *) dst);
+      ((double *) dst)[3] = ((double *) src)[3];
 
-      red   = linear_to_gamma_2_2 (red);
-      green = linear_to_gamma_2_2 (green);
-      blue  = linear_to_gamma_2_2 (blue);
+      src += sizeof (double) * 4;
+      dst += sizeof (double) * 4;
+    }
+}
 
-      luminance =  0.2126 * red + 0.7152 * green + 0.0722 * blue;
-      cb        =  (blue - luminance) / 1.8556;
-      cr        =  (red  - luminance) / 1.5748;
+static void
+rgba_to_ycbcr (const Babl *conversion,
+               char       *src,
+               char       *dst,
+               long        n,
+               void       *data)
+{
+  const YCbCrStandard *standard = data;
 
-      ((double *) dst)[0] = luminance;
-      ((double *) dst)[1] = cb;
-      ((double *) dst)[2] = cr;
+  while (n--)
+    {
+      double red   = linear_to_gamma_2_2 (((double *) src)[0]);
+      double green = linear_to_gamma_2_2 (((double *) src)[1]);
+      double blue  = linear_to_gamma_2_2 (((double *) src)[2]);
+
+      ycbcr_from_rgb (standard->encode, red, green, blue, (double *) dst);
 
       src += sizeof (double) * 4;
       dst += sizeof (double) * 3;
     }
 }
 
-
 static void
-ycbcra709_to_rgba (const Babl *conversion,
-                   char       *src,
-                   char       *dst,
-                   long        n)
+ycbcra_to_rgba (const Babl *conversion,
+                char       *src,
+                char       *dst,
+                long        n,
+                void       *data)
 {
+  const YCbCrStandard *standard = data;
+
   while (n--)
     {
       double luminance = ((double *) src)[0];
       double cb        = ((double *) src)[1];
       double cr        = ((double *) src)[2];
-      double alpha     = ((double *) src)[3];
-
-      double red, green, blue;
 
-      red   = 1.0 * luminance + 0.0    * cb + 1.5748 * cr;
-      green = 1.0 * luminance - 0.1873 * cb - 0.4681 * cr;
-      blue  = 1.0 * luminance + 1.8556 * cb + 0.0    * cr;
-
-      red   = gamma_2_2_to_linear (red);
-      green = gamma_2_2_to_linear (green);
-      blue  = gamma_2_2_to_linear (blue);
-
-      ((double *) dst)[0] = red;
-      ((double *) dst)[1] = green;
-      ((double *) dst)[2] = blue;
-      ((double *) dst)[3] = alpha;
+      ((double *) dst)[0] = gamma_2_2_to_linear (luminance + standard->cr_to_r * cr);
+      ((double *) dst)[1] = gamma_2_2_to_linear (luminance + standard->cb_to_g * cb +
+                                                             standard->cr_to_g * cr);
+      ((double *) dst)[2] = gamma_2_2_to_linear (luminance + standard->cb_to_b * cb);
+      ((double *) dst)[3] = ((double *) src)[3];
 
       src += sizeof (double) * 4;
       dst += sizeof (double) * 4;
     }
 }
 
-
 static void
-ycbcr709_to_rgba (const Babl *conversion,
-                  char       *src,
-                  char       *dst,
-                  long        n)
+ycbcr_to_rgba (const Babl *conversion,
+               char       *src,
+               char       *dst,
+               long        n,
+               void       *data)
 {
+  const YCbCrStandard *standard = data;
+
   while (n--)
     {
       double luminance = ((double *) src)[0];
       double cb        = ((double *) src)[1];
       double cr        = ((double *) src)[2];
 
-      double red, green, blue;
-
-      red   = 1.0 * luminance + 0.0    * cb + 1.5748 * cr;
-      green = 1.0 * luminance - 0.1873 * cb - 0.4681 * cr;
-      blue  = 1.0 * luminance + 1.8556 * cb + 0.0    * cr;
-
-      red   = gamma_2_2_to_linear (red);
-      green = gamma_2_2_to_linear (green);
-      blue  = gamma_2_2_to_linear (blue);
-
-      ((double *) dst)[0] = red;
-      ((double *) dst)[1] = green;
-      ((double *) dst)[2] = blue;
+      ((double *) dst)[0] = gamma_2_2_to_linear (luminance + standard->cr_to_r * cr);
+      ((double *) dst)[1] = gamma_2_2_to_linear (luminance + standard->cb_to_g * cb +
+                                                             standard->cr_to_g * cr);
+      ((double *) dst)[2] = gamma_2_2_to_linear (luminance + standard->cb_to_b * cb);
       ((double *) dst)[3] = 1.0;
 
       src += sizeof (double) * 3;
@@ -207,55 +485,299 @@ ycbcr709_to_rgba (const Babl *conversion,
 }
 
 
+/* single precision, from and to the R'G'B' of R'G'B'A float, where the
+ * models only differ from R'G'B' by a matrix
+ */
+static inline void
+rgb_from_ycbcr_f (const YCbCrStandard *standard,
+                  float                luminance,
+                  float                cb,
+                  float                cr,
+                  float               *rgb)
+{
+  rgb[0] = luminance + standard->cr_to_r * cr;
+  rgb[1] = luminance + standard->cb_to_g * cb + standard->cr_to_g * cr;
+  rgb[2] = luminance + standard->cb_to_b * cb;
+}
+
+static inline void
+ycbcr_from_rgb_f (const float *m,
+                  const float *rgb,
+                  float       *ycbcr)
+{
+  ycbcr[0] = m[0] * rgb[0] + m[1] * rgb[1] + m[2] * rgb[2];
+  ycbcr[1] = m[3] * rgb[0] + m[4] * rgb[1] + m[5] * rgb[2];
+  ycbcr[2] = m[6] * rgb[0] + m[7] * rgb[1] + m[8] * rgb[2];
+}
+
+static void
+rgba_float_to_ycbcr_float (const Babl  *conversion,
+                           const float *src,
+                           float       *dst,
+                           long         n,
+                           void        *data)
+{
+  const YCbCrStandard *standard = data;
+
+  for (long i = 0; i < n; i++)
+    ycbcr_from_rgb_f (standard->encode_f, src + i * 4, dst + i * 3);
+}
+
+static void
+rgba_float_to_ycbcra_float (const Babl  *conversion,
+                            const float *src,
+                            float       *dst,
+                            long         n,
+                            void        *data)
+{
+  const YCbCrStandard *standard = data;
+
+  for (long i = 0; i < n; i++)
+    {
+      ycbcr_from_rgb_f (standard->encode_f, src + i * 4, dst + i * 4);
+      dst[i * 4 + 3] = src[i * 4 + 3];
+    }
+}
+
+static void
+ycbcr_float_to_rgba_float (const Babl  *conversion,
+                           const float *src,
+                           float       *dst,
+                           long         n,
+                           void        *data)
+{
+  const YCbCrStandard *standard = data;
+
+  for (long i = 0; i < n; i++)
+    {
+      rgb_from_ycbcr_f (standard, src[i * 3 + 0], src[i * 3 + 1], src[i * 3 + 2],
+                        dst + i * 4);
+      dst[i * 4 + 3] = 1.0f;
+    }
+}
+
+static void
+ycbcra_float_to_rgba_float (const Babl  *conversion,
+                            const float *src,
+                            float       *dst,
+                            long         n,
+                            void        *data)
+{
+  const YCbCrStandard *standard = data;
+
+  for (long i = 0; i < n; i++)
+    {
+      rgb_from_ycbcr_f (standard, src[i * 4 + 0], src[i * 4 + 1], src[i * 4 + 2],
+                        dst + i * 4);
+      dst[i * 4 + 3] = src[i * 4 + 3];
+    }
+}
+
+/* the integer codes are clamped to the range of their type and scaled, as
+ * the conversions of the types do, with the scaling folded into a multiply
+ * and add
+ */
+#define DECODE_LOOP(type)                                                     \
+  {                                                                           \
+    const type *s = (const type *) src;                                       \
+                                                                              \
+    for (long i = 0; i < n; i++)                                              \
+      {                                                                       \
+        float luminance = s[i * 3 + 0];                                       \
+        float cb        = s[i * 3 + 1];                                       \
+        float cr        = s[i * 3 + 2];                                       \
+                                                                              \
+        luminance = luminance < range->luma_min ? range->luma_min :           \
+                    luminance > range->luma_max ? range->luma_max : luminance;\
+        cb        = cb < range->chroma_min ? range->chroma_min :              \
+                    cb > range->chroma_max ? range->chroma_max : cb;          \
+        cr        = cr < range->chroma_min ? range->chroma_min :              \
+                    cr > range->chroma_max ? range->chroma_max : cr;          \
+                                                                              \
+        rgb_from_ycbcr_f (standard,                                           \
+                          luminance * luma_scale + luma_offset,               \
+                          cb * chroma_scale + chroma_offset,                  \
+                          cr * chroma_scale + chroma_offset,                  \
+                          dst + i * 4);                                       \
+        dst[i * 4 + 3] = 1.0f;                                                \
+      }                                                                       \
+  }
+
+static void
+ycbcr_int_to_rgba_float (const Babl *conversion,
+                         const char *src,
+                         float      *dst,
+                         long        n,
+                         void       *data)
+{
+  const YCbCrCoding   *coding        = data;
+  const YCbCrStandard *standard      = coding->standard;
+  const YCbCrRange    *range         = coding->range;
+  const float          luma_scale    = 1.0f / (range->luma_max - range->luma_min);
+  const float          luma_offset   = -range->luma_min * luma_scale;
+  const float          chroma_scale  = 1.0f / (range->chroma_max - range->chroma_min);
+  const float          chroma_offset = -range->chroma_center * chroma_scale;
+
+  if (range->bits == 8)
+    DECODE_LOOP (uint8_t)
+  else
+    DECODE_LOOP (uint16_t)
+}
+
+#undef DECODE_LOOP
+
+#define ENCODE_LOOP(type)                                                     \
+  {                                                                           \
+    type *d = (type *) dst;                                                   \
+                                                                              \
+    for (long i = 0; i < n; i++)                                              \
+      {                                                                       \
+        float ycbcr[3];                                                       \
+        float luminance, cb, cr;                                              \
+                                                                              \
+        ycbcr_from_rgb_f (standard->encode_f, src + i * 4, ycbcr);            \
+        luminance = ycbcr[0] * luma_scale + range->luma_min;                  \
+        cb        = ycbcr[1] * chroma_scale + range->chroma_center;           \
+        cr        = ycbcr[2] * chroma_scale + range->chroma_center;           \
+                                                                              \
+        /* written such that NaN ends up as the minimum */                    \
+        luminance = luminance >= range->luma_min ? luminance : range->luma_min;\
+        luminance = luminance <= range->luma_max ? luminance : range->luma_max;\
+        cb        = cb >= range->chroma_min ? cb : range->chroma_min;         \
+        cb        = cb <= range->chroma_max ? cb : range->chroma_max;         \
+        cr        = cr >= range->chroma_min ? cr : range->chroma_min;         \
+        cr        = cr <= range->chroma_max ? cr : range->chroma_max;         \
+                                                                              \
+        /* ties to even, like the conversions of the integer types */       \
+        d[i * 3 + 0] = lrintf (luminance);                                   \
+        d[i * 3 + 1] = lrintf (cb);                                          \
+        d[i * 3 + 2] = lrintf (cr);                                          \
+      }                                                                       \
+  }
+
+static void
+rgba_float_to_ycbcr_int (const Babl  *conversion,
+                         const float *src,
+                         char        *dst,
+                         long         n,
+                         void        *data)
+{
+  const YCbCrCoding   *coding       = data;
+  const YCbCrStandard *standard     = coding->standard;
+  const YCbCrRange    *range        = coding->range;
+  const float          luma_scale   = range->luma_max - range->luma_min;
+  const float          chroma_scale = range->chroma_max - range->chroma_min;
+
+  if (range->bits == 8)
+    ENCODE_LOOP (uint8_t)
+  else
+    ENCODE_LOOP (uint16_t)
+}
+
+#undef ENCODE_LOOP
+
+
 static void
 conversions (void)
 {
-  babl_conversion_new (
-    babl_model ("RGBA"),
-    babl_model ("Y'CbCr709"),
-    "linear", rgba_to_ycbcr709,
-    NULL
-  );
-  babl_conversion_new (
-    babl_model ("RGBA"),
-    babl_model ("Y'CbCrA709"),
-    "linear", rgba_to_ycbcra709,
-    NULL
-  );
-  babl_conversion_new (
-    babl_model ("Y'CbCrA709"),
-    babl_model ("RGBA"),
-    "linear", ycbcra709_to_rgba,
-    NULL
-  );
-  babl_conversion_new (
-    babl_model ("Y'CbCr709"),
-    babl_model ("RGBA"),
-    "linear", ycbcr709_to_rgba,
-    NULL
-  );
+  for (unsigned int s = 0; s < N_STANDARDS; s++)
+    {
+      YCbCrStandard *standard = &standards[s];
+
+      if (!standard->in_base)
+        {
+          babl_conversion_new (babl_model ("RGBA"), babl_model (standard->model),
+                               "linear", rgba_to_ycbcr, "data", standard, NULL);
+          babl_conversion_new (babl_model ("RGBA"), babl_model (standard->model_alpha),
+                               "linear", rgba_to_ycbcra, "data", standard, NULL);
+          babl_conversion_new (babl_model (standard->model_alpha), babl_model ("RGBA"),
+                               "linear", ycbcra_to_rgba, "data", standard, NULL);
+          babl_conversion_new (babl_model (standard->model), babl_model ("RGBA"),
+                               "linear", ycbcr_to_rgba, "data", standard, NULL);
+        }
+    }
 }
 
 
 static void
 formats (void)
 {
-  babl_format_new (
-    babl_model ("Y'CbCrA709"),
-    babl_type ("float"),
-    babl_component ("Y'"),
-    babl_type ("float"),
-    babl_component ("Cb"),
-    babl_component ("Cr"),
-    babl_component ("alpha"),
-    NULL);
-
-  babl_format_new (
-    babl_model ("Y'CbCr709"),
-    babl_type ("float"),
-    babl_component ("Y'"),
-    babl_type ("float"),
-    babl_component ("Cb"),
-    babl_component ("Cr"),
-    NULL);
+  const Babl *rgba_float = babl_format ("R'G'B'A float");
+
+  for (unsigned int s = 0; s < N_STANDARDS; s++)
+    {
+      YCbCrStandard *standard = &standards[s];
+      const Babl    *ycbcr_float;
+      const Babl    *ycbcra_float;
+
+      ycbcra_float = babl_format_new (
+        babl_model (standard->model_alpha),
+        babl_type ("float"),
+        babl_component ("Y'"),
+        babl_component ("Cb"),
+        babl_component ("Cr"),
+        babl_component (standard->alpha),
+        NULL);
+
+      ycbcr_float = babl_format_new (
+        babl_model (standard->model),
+        babl_type ("float"),
+        babl_component ("Y'"),
+        babl_component ("Cb"),
+        babl_component ("Cr"),
+        NULL);
+
+      babl_conversion_new (rgba_float, ycbcr_float,
+                           "linear", rgba_float_to_ycbcr_float,
+                           "data", standard, NULL);
+      babl_conversion_new (rgba_float, ycbcra_float,
+                           "linear", rgba_float_to_ycbcra_float,
+                           "data", standard, NULL);
+      babl_conversion_new (ycbcr_float, rgba_float,
+                           "linear", ycbcr_float_to_rgba_float,
+                           "data", standard, NULL);
+      babl_conversion_new (ycbcra_float, rgba_float,
+                           "linear", ycbcra_float_to_rgba_float,
+                           "data", standard, NULL);
+
+      for (unsigned int r = 0; r < N_RANGES; r++)
+        for (unsigned int p = 0; p < N_SAMPLINGS; p++)
+          {
+            const YCbCrRange *range = &ranges[r];
+            const Babl       *format;
+            char              name[64];
+
+            snprintf (name, sizeof (name), "%s %s %s",
+                      standard->model, samplings[p].name, range->name);
+
+            format = babl_format_new (
+              "name", name,
+              samplings[p].horizontal > 1 || samplings[p].vertical > 1 ?
+                "planar" : "packed",
+              babl_model (standard->model),
+              babl_type (range->luma_type),
+              babl_sampling (1, 1),
+              babl_component ("Y'"),
+              babl_type (range->chroma_type),
+              babl_sampling (samplings[p].horizontal, samplings[p].vertical),
+              babl_component ("Cb"),
+              babl_component ("Cr"),
+              NULL);
+
+            babl_conversion_new (format, rgba_float,
+                                 "linear", ycbcr_int_to_rgba_float,
+                                 "data", &codings[s][r], NULL);
+            babl_conversion_new (rgba_float, format,
+                                 "linear", rgba_float_to_ycbcr_int,
+                                 "data", &codings[s][r], NULL);
+          }
+    }
+
+  /* the limited range BT.601 4:2:0 format of babl base */
+  babl_conversion_new (babl_format ("Y'CbCr u8"), rgba_float,
+                       "linear", ycbcr_int_to_rgba_float,
+                       "data", &codings[0][0], NULL);
+  babl_conversion_new (rgba_float, babl_format ("Y'CbCr u8"),
+                       "linear", rgba_float_to_ycbcr_int,
+                       "data", &codings[0][0], NULL);
 }
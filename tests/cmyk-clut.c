@@ -0,0 +1,167 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* conversions to and from a CMYK space, which go through fish paths and
+ * the color lookup tables of the space when fast enough and within
+ * tolerance, should agree with the reference conversions.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <babl/babl.h>
+#include "helpers.h"
+
+#define PIXELS    4096
+#define TOLERANCE 0.01
+
+static int
+compare (const Babl *source,
+         const Babl *destination,
+         const char *performance)
+{
+  static float  source_buf[PIXELS * 5];
+  static float  result[PIXELS * 5];
+  static float  reference[PIXELS * 5];
+  static double source_doubles[PIXELS * 5];
+  static double result_doubles[PIXELS * 5];
+  const Babl   *source_float = babl_format_with_space (
+                                 babl_format_get_n_components (source) == 5 ?
+                                 "CMYKA float" : "RGBA float",
+                                 babl_format_get_space (source));
+  const Babl   *result_float = babl_format_with_space (
+                                 babl_format_get_n_components (destination) == 5 ?
+                                 "CMYKA float" : "RGBA float",
+                                 babl_format_get_space (destination));
+  const Babl   *source_double = double_format (source);
+  const Babl   *result_double = double_format (destination);
+  const Babl   *fish = babl_fast_fish (source, destination, performance);
+  char          source_pixels[PIXELS * 20];
+  char          pixels[PIXELS * 20];
+  int           n_components = babl_format_get_n_components (result_float);
+  int           OK = 1;
+
+  if (!fish)
+    fish = babl_fish (source, destination);
+
+  for (int i = 0; i < PIXELS * 5; i++)
+    source_buf[i] = (i * 7919 % 4099) / 4098.0f;
+
+  babl_process (babl_fish (source_float, source),
+                source_buf, source_pixels, PIXELS);
+
+  babl_process (fish, source_pixels, pixels, PIXELS);
+  babl_process (babl_fish (destination, result_float),
+                pixels, result, PIXELS);
+
+  /* the reference converts the same pixels between doubles, where only
+   * paths within babl's tolerance of the reference fish are used, and not
+   * the color lookup tables the fish under test may use
+   */
+  babl_process (babl_fish (source, source_double),
+                source_pixels, source_doubles, PIXELS);
+  babl_process (babl_fish (source_double, result_double),
+                source_doubles, result_doubles, PIXELS);
+  babl_process (babl_fish (result_double, destination),
+                result_doubles, pixels, PIXELS);
+  babl_process (babl_fish (destination, result_float),
+                pixels, reference, PIXELS);
+
+  for (int i = 0; i < PIXELS * n_components && OK; i++)
+    {
+      if (fabs (result[i] - reference[i]) > TOLERANCE)
+        {
+          fprintf (stderr, "%s to %s (%s): pixel %i component %i is %f should be %f\n",
+                   babl_get_name (source), babl_get_name (destination),
+                   performance, i / n_components, i % n_components,
+                   result[i], reference[i]);
+          OK = 0;
+        }
+    }
+
+  return OK;
+}
+
+int
+main (void)
+{
+  const Babl *space;
+  int         OK = 1;
+
+  babl_init ();
+
+  space = cmyk_space ();
+  if (!space)
+    {
+      fprintf (stderr, "failed to create CMYK space\n");
+      return 1;
+    }
+
+  {
+    const char *cmyk_formats[] = { "CMYK u8", "CMYKA u8", "CMYK u16",
+                                   "CMYKA float", NULL };
+    const char *rgb_formats[]  = { "R'G'B'A u8", "RGBA float", NULL };
+    const char *performance[]  = { "default", "fast", "glitch", NULL };
+
+    for (int c = 0; cmyk_formats[c]; c++)
+      for (int r = 0; rgb_formats[r]; r++)
+        for (int p = 0; performance[p]; p++)
+          {
+            const Babl *cmyk = babl_format_with_space (cmyk_formats[c], space);
+            const Babl *rgb  = babl_format (rgb_formats[r]);
+
+            OK &= compare (cmyk, rgb, performance[p]);
+            OK &= compare (rgb, cmyk, performance[p]);
+          }
+  }
+
+  /* the K component of 4 byte CMYK pixels should not be taken for alpha,
+   * also not once enough pixels have been processed for a LUT to be made
+   */
+  {
+    const Babl          *cmyk_u8 = babl_format_with_space ("CMYK u8", space);
+    const Babl          *fish = babl_fast_fish (cmyk_u8,
+                                                babl_format ("R'G'B'A u8"),
+                                                "glitch");
+    static unsigned char cmyk[PIXELS * 4];
+    static unsigned char rgba[PIXELS * 4];
+
+    if (!fish)
+      fish = babl_fish (cmyk_u8, babl_format ("R'G'B'A u8"));
+
+    for (int i = 0; i < PIXELS; i++)
+      {
+        cmyk[i * 4 + 0] = cmyk[i * 4 + 1] = cmyk[i * 4 + 2] = 64;
+        cmyk[i * 4 + 3] = i % 2 ? 255 : 0;
+      }
+
+    for (int round = 0; round < 16 && OK; round++)
+      {
+        babl_process (fish, cmyk, rgba, PIXELS);
+        if (rgba[0] == rgba[4])
+          {
+            fprintf (stderr, "K ignored in CMYK u8 to R'G'B'A u8\n");
+            OK = 0;
+          }
+      }
+  }
+
+  babl_exit ();
+
+  return !OK;
+}
@@ -0,0 +1,144 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* the conversions calling the float and 16bit lcms transforms of a CMYK
+ * space with a profile should agree with the double reference path.
+ */
+
+#include "config.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "babl-internal.h"
+#include "helpers.h"
+
+#ifdef HAVE_LCMS
+
+#define PIXELS    1023
+#define TOLERANCE 0.001
+
+/* runs an lcms conversion of the space and a fish between doubles on the
+ * same pixels, comparing the results as doubles
+ */
+static int
+test_conversion (Babl *babl)
+{
+  const Babl    *source;
+  const Babl    *destination;
+  static double  source_doubles[PIXELS * 5];
+  static double  reference[PIXELS * 5];
+  static double  result[PIXELS * 5];
+  static char    source_pixels[PIXELS * 40];
+  static char    pixels[PIXELS * 40];
+  int            n_components;
+  int            OK = 1;
+
+  source       = babl->conversion.source;
+  destination  = babl->conversion.destination;
+  n_components = babl_format_get_n_components (destination);
+
+  for (int i = 0; i < PIXELS * 5; i++)
+    source_doubles[i] = (i * 7919 % 4099) / 4098.0;
+
+  babl_process (babl_fish (double_format (source), source),
+                source_doubles, source_pixels, PIXELS);
+  babl_process (babl_fish (source, double_format (source)),
+                source_pixels, source_doubles, PIXELS);
+
+  babl->conversion.function.linear (babl, source_pixels, pixels, PIXELS,
+                                    babl->conversion.data);
+  babl_process (babl_fish (destination, double_format (destination)),
+                pixels, result, PIXELS);
+
+  /* with no tolerance the fish between doubles only takes exact paths,
+   * not the conversion under test, or else is the reference fish
+   */
+  babl_process (babl_fish (double_format (source),
+                           double_format (destination)),
+                source_doubles, reference, PIXELS);
+  babl_process (babl_fish (double_format (destination), destination),
+                reference, pixels, PIXELS);
+  babl_process (babl_fish (destination, double_format (destination)),
+                pixels, reference, PIXELS);
+
+  for (int i = 0; i < PIXELS * n_components && OK; i++)
+    {
+      if (fabs (result[i] - reference[i]) > TOLERANCE)
+        {
+          fprintf (stderr, "%s: pixel %i component %i is %f should be %f\n",
+                   babl_get_name (babl), i / n_components, i % n_components,
+                   result[i], reference[i]);
+          OK = 0;
+        }
+    }
+
+  return OK;
+}
+
+int
+main (void)
+{
+  const char *cmyk_formats[] = { "CMYKA float", "CMYKA u16", NULL };
+  const Babl *space;
+  int         OK = 1;
+
+  /* no fish paths, only reference fishes, for the reference pixels */
+  putenv ("BABL_TOLERANCE" "=" "0.0");
+  babl_init ();
+
+  space = lcms_cmyk_space ();
+  if (!space)
+    {
+      fprintf (stderr, "failed to create CMYK space\n");
+      return 1;
+    }
+
+  /* the conversions of a CMYK space are added with its first fish */
+  babl_fish (babl_format_with_space ("CMYKA float", space),
+             babl_format ("RGBA float"));
+
+  /* the lcms conversions are the ones with the space itself as data */
+  for (int c = 0; cmyk_formats[c]; c++)
+    {
+      const Babl *cmyk = babl_format_with_space (cmyk_formats[c], space);
+      const Babl *rgba = babl_format ("RGBA float");
+      Babl       *to_rgba = find_conversion (cmyk, rgba, (void *) space);
+      Babl       *from_rgba = find_conversion (rgba, cmyk, (void *) space);
+
+      if (!to_rgba || !from_rgba)
+        OK = 0;
+      if (to_rgba)
+        OK &= test_conversion (to_rgba);
+      if (from_rgba)
+        OK &= test_conversion (from_rgba);
+    }
+
+  babl_exit ();
+
+  return !OK;
+}
+
+#else
+
+int
+main (void)
+{
+  return 0;
+}
+
+#endif
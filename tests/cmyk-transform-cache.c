@@ -0,0 +1,231 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* The cache of transforms between CMYK spaces, bounded well below the
+ * number of pairs of spaces converted between, should keep the conversions
+ * right while threads evict the transforms others are using, and run them
+ * with babl_reference_mutex released at the same time. Each bound is
+ * read once per process, each is tried in a child process of its own, the
+ * results are checked against transforms made with lcms for each pair.
+ */
+
+#include "config.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "babl-internal.h"
+#include "helpers.h"
+
+#ifdef HAVE_LCMS
+
+#define N_SPACES  6
+#define N_THREADS 4
+#define ROUNDS    3
+#define PIXELS    1021
+#define TOLERANCE 0.000001
+
+/* 30 pairs of spaces, against at most 3 transforms, or a megabyte which
+ * holds about ten transforms between the profiles made by
+ * lcms_cmyk_space_dot_gain(), their color lookup tables taking some 45
+ * kilobytes each
+ */
+static const char *limits[] = {
+  "BABL_CMYK_TRANSFORM_CACHE_SIZE=3",
+  "BABL_CMYK_TRANSFORM_CACHE_MEMORY=1",
+};
+#define N_LIMITS (sizeof (limits) / sizeof (limits[0]))
+
+static const Babl *spaces[N_SPACES];
+static double      source[PIXELS * 5];
+static double      reference[N_SPACES][N_SPACES][PIXELS * 5];
+
+/* converts the pixels between the profiles of two spaces with a transform
+ * of their own, CMYK double of lcms is ink from 0 to 100
+ */
+static int
+lcms_reference (const Babl *source_space,
+                const Babl *destination_space,
+                double     *result)
+{
+  static double   ink[PIXELS * 4];
+  int             source_length, destination_length;
+  const char     *source_icc = babl_space_get_icc (source_space,
+                                                   &source_length);
+  const char     *destination_icc = babl_space_get_icc (destination_space,
+                                                        &destination_length);
+  cmsHPROFILE     source_profile = cmsOpenProfileFromMem (source_icc,
+                                                          source_length);
+  cmsHPROFILE     destination_profile = cmsOpenProfileFromMem (destination_icc,
+                                                               destination_length);
+  cmsHTRANSFORM   transform;
+
+  transform = cmsCreateTransform (source_profile, TYPE_CMYK_DBL,
+                                  destination_profile, TYPE_CMYK_DBL,
+                                  INTENT_RELATIVE_COLORIMETRIC,
+                                  cmsFLAGS_BLACKPOINTCOMPENSATION);
+  cmsCloseProfile (source_profile);
+  cmsCloseProfile (destination_profile);
+  if (!transform)
+    return 0;
+
+  for (int i = 0; i < PIXELS; i++)
+    for (int c = 0; c < 4; c++)
+      ink[i * 4 + c] = source[i * 5 + c] * 100.0;
+  cmsDoTransform (transform, ink, ink, PIXELS);
+  cmsDeleteTransform (transform);
+
+  for (int i = 0; i < PIXELS; i++)
+    {
+      for (int c = 0; c < 4; c++)
+        result[i * 5 + c] = ink[i * 4 + c] / 100.0;
+      result[i * 5 + 4] = source[i * 5 + 4];
+    }
+  return 1;
+}
+
+/* each thread goes through all pairs, from a pair of its own on, converting
+ * in threads of their own the transforms that other threads evict
+ */
+static void *
+convert_pairs (void *data)
+{
+  int     thread = (intptr_t) data;
+  double *result = malloc (sizeof (double) * PIXELS * 5);
+  int     OK = 1;
+
+  for (int round = 0; round < ROUNDS; round++)
+    for (int p = 0; p < N_SPACES * N_SPACES; p++)
+      {
+        int         pair = (p * 7 + thread * 11 + round) % (N_SPACES * N_SPACES);
+        int         s = pair / N_SPACES;
+        int         d = pair % N_SPACES;
+        const Babl *fish;
+
+        if (s == d)
+          continue;
+
+        fish = babl_fish (babl_format_with_space ("CMYKA double", spaces[s]),
+                          babl_format_with_space ("CMYKA double", spaces[d]));
+        babl_process (fish, source, result, PIXELS);
+
+        for (int i = 0; i < PIXELS * 5 && OK; i++)
+          if (fabs (result[i] - reference[s][d][i]) > TOLERANCE)
+            {
+              fprintf (stderr, "space %i to %i: pixel %i component %i is %f "
+                       "should be %f\n", s, d, i / 5, i % 5,
+                       result[i], reference[s][d][i]);
+              OK = 0;
+            }
+      }
+
+  free (result);
+  return (void *) (intptr_t) OK;
+}
+
+static int
+test_limit (void)
+{
+  pthread_t threads[N_THREADS];
+  int       OK = 1;
+
+  for (int s = 0; s < N_SPACES; s++)
+    {
+      spaces[s] = lcms_cmyk_space_dot_gain (s * 0.1);
+      if (!spaces[s])
+        {
+          fprintf (stderr, "failed to create CMYK space %i\n", s);
+          return 0;
+        }
+    }
+
+  for (int i = 0; i < PIXELS; i++)
+    {
+      for (int c = 0; c < 4; c++)
+        source[i * 5 + c] = ((i * 4 + c) * 7919 % 4099) / 4098.0;
+      source[i * 5 + 4] = 1.0;
+    }
+
+  for (int s = 0; s < N_SPACES; s++)
+    for (int d = 0; d < N_SPACES; d++)
+      if (s != d && !lcms_reference (spaces[s], spaces[d], reference[s][d]))
+        {
+          fprintf (stderr, "no lcms transform from space %i to %i\n", s, d);
+          return 0;
+        }
+
+  for (int t = 0; t < N_THREADS; t++)
+    pthread_create (&threads[t], NULL, convert_pairs, (void *) (intptr_t) t);
+  for (int t = 0; t < N_THREADS; t++)
+    {
+      void *thread_OK;
+
+      pthread_join (threads[t], &thread_OK);
+      OK &= (intptr_t) thread_OK;
+    }
+
+  return OK;
+}
+
+int
+main (void)
+{
+  int OK = 1;
+
+  for (int l = 0; l < N_LIMITS; l++)
+    {
+      pid_t child = fork ();
+      int   status;
+
+      if (child < 0)
+        return 1;
+
+      if (child == 0)
+        {
+          putenv ((char *) limits[l]);
+          /* no fish paths, only reference fishes, which hold the cache */
+          putenv ("BABL_TOLERANCE" "=" "0.0");
+          babl_init ();
+          OK = test_limit ();
+          babl_exit ();
+          _exit (!OK);
+        }
+
+      if (waitpid (child, &status, 0) != child ||
+          !WIFEXITED (status) || WEXITSTATUS (status))
+        {
+          fprintf (stderr, "conversions with %s failed\n", limits[l]);
+          OK = 0;
+        }
+    }
+
+  return !OK;
+}
+
+#else
+
+int
+main (void)
+{
+  return 0;
+}
+
+#endif
@@ -95,6 +95,45 @@ test3 (void)
   return 0;
 }
 
+/* formats are cached by the address of their name, a buffer reused for
+ * another name should still give the right format, as should repeated
+ * lookups of an encoding in different spaces
+ */
+static int
+test4 (void)
+{
+  int OK = 1;
+  const Babl *apple = babl_space ("Apple");
+  const Babl *sRGB  = babl_space ("sRGB");
+  const char *names[] = { "R'G'B' u8", "RGBA float", "Y u16", "CIE Lab float" };
+  char        name[64];
+  int         i;
+
+  for (i = 0; i < 8; i++)
+  {
+    const Babl *fmt;
+
+    strcpy (name, names[i % 4]);
+    fmt = babl_format (name);
+    if (strcmp (babl_get_name (fmt), names[i % 4]))
+    {
+      babl_log ("looked up %s got %s", names[i % 4], babl_get_name (fmt));
+      OK = 0;
+    }
+    fmt = babl_format_with_space (name, i % 2 ? apple : sRGB);
+    if (babl_format_get_space (fmt) != (i % 2 ? apple : sRGB) ||
+        strcmp (babl_format_get_encoding (fmt), names[i % 4]))
+    {
+      babl_log ("looked up %s got %s", names[i % 4], babl_get_name (fmt));
+      OK = 0;
+    }
+  }
+
+  if (!OK)
+    return -1;
+  return 0;
+}
+
 int
 main (void)
 {
@@ -103,6 +142,8 @@ main (void)
     return -1;
   if (test3 ())
     return -1;
+  if (test4 ())
+    return -1;
   babl_exit ();
   return 0;
 }
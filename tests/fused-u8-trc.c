@@ -0,0 +1,195 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* The conversions between spaces encoding to u8 in a single step, with
+ * tables of the destination TRC, should give the same codes as converting
+ * to RGBA float in the destination space and applying the TRC to each value
+ * - for sRGB, gamma and sampled TRCs, and for values out of range.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include "babl-internal.h"
+#include "helpers.h"
+
+#define PIXELS 65536
+
+static void
+run (Babl       *babl,
+     const void *source,
+     void       *destination,
+     long        n)
+{
+  babl->conversion.function.linear (babl, source, destination, n,
+                                    babl->conversion.data);
+}
+
+static uint8_t
+reference_u8 (float value)
+{
+  if (value <= 0.0f)
+    return 0;
+  if (value >= 1.0f)
+    return 255;
+  return value * 255.0f + 0.5f;
+}
+
+/* encodes linear RGBA float pixels of a space to u8 by applying its TRC
+ * to each value, rounding like the conversions to u8 did before
+ */
+static void
+encode_u8 (const Babl  *space,
+           const float *linear,
+           float        scale,
+           uint8_t     *pixels)
+{
+  for (int i = 0; i < PIXELS * 4; i++)
+    {
+      float value = linear[i] * scale;
+
+      if (i % 4 != 3)
+        value = babl_trc_from_linear (space->space.trc[i % 4], value);
+      pixels[i] = reference_u8 (value);
+    }
+}
+
+static int
+compare_codes (const Babl    *babl,
+               const uint8_t *result,
+               const uint8_t *reference,
+               int            components)
+{
+  for (int i = 0; i < PIXELS * components; i++)
+    if (result[i] != reference[i])
+      {
+        fprintf (stderr, "%s: pixel %i component %i is %i should be %i\n",
+                 babl_get_name (babl), i / components, i % components,
+                 result[i], reference[i]);
+        return 0;
+      }
+  return 1;
+}
+
+static int
+compare (const Babl *source_space,
+         const Babl *destination_space)
+{
+  static uint8_t pixels[PIXELS * 4];
+  static uint8_t rgb[PIXELS * 3];
+  static uint8_t result[PIXELS * 4];
+  static uint8_t reference[PIXELS * 4];
+  static uint8_t lower[PIXELS * 4];
+  static uint8_t upper[PIXELS * 4];
+  static float   linear[PIXELS * 4];
+  const Babl    *u8_rgba = babl_format_with_space ("R'G'B'A u8", source_space);
+  const Babl    *u8_rgb = babl_format_with_space ("R'G'B' u8", source_space);
+  const Babl    *float_rgba = babl_format_with_space ("RGBA float", source_space);
+  const Babl    *u8_rgba_out = babl_format_with_space ("R'G'B'A u8",
+                                                       destination_space);
+  const Babl    *u8_rgb_out = babl_format_with_space ("R'G'B' u8",
+                                                      destination_space);
+  const Babl    *float_rgba_out = babl_format_with_space ("RGBA float",
+                                                          destination_space);
+  Babl          *fused;
+  Babl          *to_linear;
+  int            OK = 1;
+
+  /* the conversions between two spaces are added with their first fish */
+  babl_fish (u8_rgba, u8_rgba_out);
+
+  for (int i = 0; i < PIXELS; i++)
+    {
+      pixels[i * 4 + 0] = rgb[i * 3 + 0] = i;
+      pixels[i * 4 + 1] = rgb[i * 3 + 1] = i >> 8;
+      pixels[i * 4 + 2] = rgb[i * 3 + 2] = i * 7 + (i >> 8) * 13;
+      pixels[i * 4 + 3] = i * 3;
+    }
+
+  /* R'G'B'A u8 to R'G'B'A u8, and the reference through linear floats of
+   * the destination space
+   */
+  to_linear = find_conversion (u8_rgba, float_rgba_out, NULL);
+  fused = find_conversion (u8_rgba, u8_rgba_out, NULL);
+  if (!to_linear || !fused)
+    return 0;
+  run (to_linear, pixels, linear, PIXELS);
+  encode_u8 (destination_space, linear, 1.0f, reference);
+  run (fused, pixels, result, PIXELS);
+  OK &= compare_codes (fused, result, reference, 4);
+
+  /* R'G'B' u8 to R'G'B' u8, the same codes without alpha */
+  fused = find_conversion (u8_rgb, u8_rgb_out, NULL);
+  if (!fused)
+    return 0;
+  for (int i = 0; i < PIXELS; i++)
+    memmove (reference + i * 3, reference + i * 4, 3);
+  run (fused, rgb, result, PIXELS);
+  OK &= compare_codes (fused, result, reference, 3);
+
+  /* RGBA float to R'G'B'A u8, with values out of range */
+  for (int i = 0; i < PIXELS * 4; i++)
+    linear[i] = (i * 7919 % 65537) / 60000.0f - 0.05f;
+  fused = find_conversion (float_rgba, u8_rgba_out, NULL);
+  to_linear = find_conversion (float_rgba, float_rgba_out, NULL);
+  if (!fused || !to_linear)
+    return 0;
+  run (fused, linear, result, PIXELS);
+  run (to_linear, linear, linear, PIXELS);
+  encode_u8 (destination_space, linear, 1.0f, reference);
+  /* the matrix of the float conversion can be built with fused
+   * multiply-adds, values within rounding of a threshold can go either way
+   */
+  encode_u8 (destination_space, linear, 1.0f - 1e-6f, lower);
+  encode_u8 (destination_space, linear, 1.0f + 1e-6f, upper);
+  for (int i = 0; i < PIXELS * 4; i++)
+    if (result[i] == lower[i] || result[i] == upper[i])
+      reference[i] = result[i];
+  OK &= compare_codes (fused, result, reference, 4);
+
+  return OK;
+}
+
+int
+main (void)
+{
+  const Babl *spaces[4];
+  int         OK = 1;
+
+  babl_init ();
+
+  spaces[0] = babl_space ("sRGB");
+  spaces[1] = babl_space_with_trc (babl_space ("Rec2020"), babl_trc_gamma (2.2));
+  spaces[2] = sampled_space ();
+  spaces[3] = NULL;
+
+  if (!spaces[2] || spaces[2]->space.trc[0]->trc.type != BABL_TRC_LUT)
+    {
+      fprintf (stderr, "failed to create a space with a sampled TRC\n");
+      return 1;
+    }
+
+  for (int s = 0; spaces[s]; s++)
+    for (int d = 0; spaces[d]; d++)
+      if (s != d)
+        OK &= compare (spaces[s], spaces[d]);
+
+  babl_exit ();
+
+  return !OK;
+}
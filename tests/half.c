@@ -0,0 +1,281 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* Every half, denormals and infinities included, should convert exactly
+ * to float and back to the same half, whatever the number of components
+ * of the format. NaNs come back quieted, with their sign and payload.
+ * Floats halfway between two halfs round to the even one, and all of this
+ * holds for any length and alignment of the buffers, whether the SIMD
+ * conversions or the scalar tails handle the pixels.
+ */
+
+#include "config.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "babl-internal.h"
+#include "helpers.h"
+
+#define CODES 65536
+
+/* isnan () does not survive -ffast-math */
+static int
+half_is_nan (uint16_t h)
+{
+  return (h & 0x7fff) > 0x7c00;
+}
+
+static int
+float_is_nan (float f)
+{
+  uint32_t bits;
+
+  memcpy (&bits, &f, sizeof (bits));
+  return (bits & 0x7fffffff) > 0x7f800000;
+}
+
+static double
+half_value (uint16_t h)
+{
+  int    exponent = (h >> 10) & 0x1f;
+  int    mantissa = h & 0x3ff;
+  double value;
+
+  if (exponent == 0)
+    value = ldexp (mantissa, -24);
+  else if (exponent == 31)
+    value = INFINITY;
+  else
+    value = ldexp (mantissa + 1024, exponent - 25);
+
+  return h & 0x8000 ? -value : value;
+}
+
+static int
+check (const char *half_encoding,
+       const char *float_encoding)
+{
+  static uint16_t codes[CODES];
+  static uint16_t round_trip[CODES];
+  static float    floats[CODES];
+  const Babl     *half_format = babl_format (half_encoding);
+  const Babl     *float_format = babl_format (float_encoding);
+  int             components = babl_format_get_n_components (half_format);
+  long            pixels = CODES / components;
+  int             OK = 1;
+
+  for (int i = 0; i < CODES; i++)
+    codes[i] = i;
+
+  babl_process (babl_fish (half_format, float_format), codes, floats, pixels);
+  babl_process (babl_fish (float_format, half_format), floats, round_trip, pixels);
+
+  for (int i = 0; i < pixels * components && OK; i++)
+    {
+      double expected = half_value (i);
+
+      if (half_is_nan (i))
+        {
+          uint32_t bits;
+
+          memcpy (&bits, &floats[i], sizeof (bits));
+          if (!float_is_nan (floats[i]) ||
+              bits != ((i & 0x8000u) << 16 | 0x7fc00000u | (i & 0x3ffu) << 13))
+            {
+              fprintf (stderr, "%s: %04x is %08x should be a quiet nan\n",
+                       half_encoding, i, bits);
+              OK = 0;
+            }
+          else if (round_trip[i] != (i | 0x200))
+            {
+              fprintf (stderr, "%s: nan %04x comes back as %04x\n",
+                       half_encoding, i, round_trip[i]);
+              OK = 0;
+            }
+          continue;
+        }
+
+      if (floats[i] != expected)
+        {
+          fprintf (stderr, "%s: %04x is %a should be %a\n",
+                   half_encoding, i, floats[i], expected);
+          OK = 0;
+        }
+      else if (round_trip[i] != i)
+        {
+          fprintf (stderr, "%s: %04x comes back as %04x\n",
+                   half_encoding, i, round_trip[i]);
+          OK = 0;
+        }
+    }
+
+  return OK;
+}
+
+/* the float of a test case and the half it should convert to: every
+ * third case is a NaN, the others are halfway between two halfs
+ */
+static float
+rounding_case (int       i,
+               uint16_t *expected)
+{
+  uint32_t sign = i & 1 ? 0x80000000u : 0;
+  uint32_t bits;
+  float    value;
+
+  if (i % 3 == 0)
+    {
+      uint32_t payload = (i * 2654435761u) & 0x7fffffu;
+
+      bits = sign | 0x7f800000u | (payload ? payload : 1);
+      *expected = sign >> 16 | 0x7e00u | (bits & 0x7fffffu) >> 13;
+      memcpy (&value, &bits, sizeof (value));
+      return value;
+    }
+  else
+    {
+      uint16_t h    = (i * 40503u) % 0x7c00u;
+      double   high = h == 0x7bff ? 65536.0 : half_value (h + 1);
+
+      value = (half_value (h) + high) / 2.0;
+      *expected = (h & 1 ? h + 1 : h) | sign >> 16;
+      return sign ? -value : value;
+    }
+}
+
+static int
+check_rounding (const char *half_encoding,
+                const char *float_encoding)
+{
+  static float    floats[256 + 4];
+  static uint16_t halfs[256 + 4];
+  static uint16_t expected[256];
+  const Babl     *fish = babl_fish (babl_format (float_encoding),
+                                    babl_format (half_encoding));
+  int             components = babl_format_get_n_components (
+                                 babl_format (half_encoding));
+  int             OK = 1;
+
+  for (int offset = 0; offset < 4; offset++)
+    for (long pixels = 1; pixels * components <= 256 && OK; pixels += 3)
+      {
+        long samples = pixels * components;
+
+        for (int i = 0; i < samples; i++)
+          floats[offset + i] = rounding_case (i + offset * 7 + pixels,
+                                              &expected[i]);
+
+        babl_process (fish, floats + offset, halfs + offset, pixels);
+
+        for (int i = 0; i < samples && OK; i++)
+          if (halfs[offset + i] != expected[i])
+            {
+              fprintf (stderr, "%s: %a (%li pixels, offset %i, sample %i) "
+                       "is %04x should be %04x\n", half_encoding,
+                       floats[offset + i], pixels, offset, i,
+                       halfs[offset + i], expected[i]);
+              OK = 0;
+            }
+      }
+
+  return OK;
+}
+
+/* doubles round like floats, the bits beyond the precision of a float
+ * deciding ties - a tie nudged by less than a float can tell rounds away
+ * from it. Paths from doubles can go through floats within tolerance,
+ * so this runs the double to half conversion of the types itself.
+ */
+static int
+check_double_rounding (void)
+{
+  static double   doubles[256 * 3];
+  static uint16_t halfs[256 * 3];
+  static uint16_t expected[256 * 3];
+  Babl           *conversion = find_conversion (babl_type ("double"),
+                                                babl_type ("half"), NULL);
+  int             OK = 1;
+
+  if (!conversion)
+    return 0;
+
+  for (int i = 0; i < 256; i++)
+    {
+      uint16_t tie;
+      double   value = rounding_case (i, &tie);
+      uint16_t sign = tie & 0x8000;
+      uint16_t even = tie & 0x7fff;
+
+      doubles[i * 3]     = value;
+      doubles[i * 3 + 1] = value * (1.0 + ldexp (1.0, -40));
+      doubles[i * 3 + 2] = value * (1.0 - ldexp (1.0, -40));
+      expected[i * 3]    = tie;
+
+      if (i % 3 == 0)
+        expected[i * 3 + 1] = expected[i * 3 + 2] = tie;
+      else if (half_value (even) < fabs (value))
+        {
+          expected[i * 3 + 1] = (even + 1) | sign;
+          expected[i * 3 + 2] = tie;
+        }
+      else
+        {
+          expected[i * 3 + 1] = tie;
+          expected[i * 3 + 2] = (even - 1) | sign;
+        }
+    }
+
+  conversion->conversion.function.plane (&conversion->conversion,
+                                         (void *) doubles, (void *) halfs,
+                                         sizeof (double), sizeof (uint16_t),
+                                         256 * 3, NULL);
+
+  for (int i = 0; i < 256 * 3 && OK; i++)
+    if (halfs[i] != expected[i])
+      {
+        fprintf (stderr, "double to half: %a is %04x should be %04x\n",
+                 doubles[i], halfs[i], expected[i]);
+        OK = 0;
+      }
+
+  return OK;
+}
+
+int
+main (void)
+{
+  int OK = 1;
+
+  babl_init ();
+
+  OK &= check ("Y half", "Y float");
+  OK &= check ("YA half", "YA float");
+  OK &= check ("RGB half", "RGB float");
+  OK &= check ("CMYK half", "CMYK float");
+  OK &= check ("cmykA half", "cmykA float");
+
+  OK &= check_rounding ("Y half", "Y float");
+  OK &= check_rounding ("RGBA half", "RGBA float");
+
+  OK &= check_double_rounding ();
+
+  babl_exit ();
+
+  return !OK;
+}
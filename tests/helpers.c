@@ -0,0 +1,253 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "babl-internal.h"
+#include "helpers.h"
+
+const Babl *
+sampled_space (void)
+{
+  int            length;
+  const char    *icc = babl_space_get_icc (babl_space ("sRGB"), &length);
+  unsigned char *data = malloc (length);
+  const Babl    *space;
+  int            bent[3] = { 0, };
+  int            n_bent = 0;
+  int            tags;
+
+  memcpy (data, icc, length);
+  tags = data[128] << 24 | data[129] << 16 | data[130] << 8 | data[131];
+  for (int t = 0; t < tags; t++)
+    {
+      unsigned char *tag = data + 132 + t * 12;
+      int            offset = tag[4] << 24 | tag[5] << 16 | tag[6] << 8 | tag[7];
+      unsigned char *curve = data + offset;
+      int            shared = 0;
+      int            count;
+
+      if (memcmp (tag, "rTRC", 4) && memcmp (tag, "gTRC", 4) &&
+          memcmp (tag, "bTRC", 4))
+        continue;
+      /* the TRC tags can share their data */
+      for (int b = 0; b < n_bent; b++)
+        shared |= bent[b] == offset;
+      if (shared || memcmp (curve, "curv", 4))
+        continue;
+      bent[n_bent++] = offset;
+
+      count = curve[8] << 24 | curve[9] << 16 | curve[10] << 8 | curve[11];
+      for (int i = 1; i < count - 1; i++)
+        {
+          int value = curve[12 + i * 2] << 8 | curve[13 + i * 2];
+
+          value = value * (double) value / 65535.0;
+          curve[12 + i * 2] = value >> 8;
+          curve[13 + i * 2] = value & 0xff;
+        }
+    }
+
+  space = babl_space_from_icc ((char *) data, length,
+                               BABL_ICC_INTENT_RELATIVE_COLORIMETRIC, NULL);
+  free (data);
+  return space;
+}
+
+const Babl *
+cmyk_space (void)
+{
+  /* a bare profile header, enough for babl to make a CMYK space of it */
+  char icc[128] = {0,};
+
+  icc[3] = 128;
+  memcpy (icc + 12, "prtr", 4);
+  memcpy (icc + 16, "CMYK", 4);
+  return babl_space_from_icc (icc, sizeof (icc),
+                              BABL_ICC_INTENT_RELATIVE_COLORIMETRIC, NULL);
+}
+
+#ifdef HAVE_LCMS
+
+static cmsHTRANSFORM to_lab, from_lab;
+
+/* the coverage printed for an ink, and the ink printing a coverage */
+static double
+dot_gain_apply (double ink,
+                double dot_gain)
+{
+  return ink + dot_gain * ink * (1.0 - ink);
+}
+
+static double
+dot_gain_invert (double coverage,
+                 double dot_gain)
+{
+  if (dot_gain == 0.0)
+    return coverage;
+  return ((1.0 + dot_gain) -
+          sqrt ((1.0 + dot_gain) * (1.0 + dot_gain) - 4.0 * dot_gain * coverage)) /
+         (2.0 * dot_gain);
+}
+
+/* device links of a naive CMYK, sampled through lcms' sRGB and Lab, the
+ * dot gain is passed as data
+ */
+static cmsInt32Number
+sample_cmyk_to_lab (const cmsUInt16Number in[],
+                    cmsUInt16Number       out[],
+                    void                 *data)
+{
+  double          dot_gain = *(double *) data;
+  cmsUInt16Number rgb[3];
+  double          k = dot_gain_apply (in[3] / 65535.0, dot_gain);
+
+  for (int c = 0; c < 3; c++)
+    rgb[c] = (1.0 - dot_gain_apply (in[c] / 65535.0, dot_gain)) *
+             (1.0 - k) * 65535.0 + 0.5;
+  cmsDoTransform (to_lab, rgb, out, 1);
+  return 1;
+}
+
+static cmsInt32Number
+sample_lab_to_cmyk (const cmsUInt16Number in[],
+                    cmsUInt16Number       out[],
+                    void                 *data)
+{
+  double          dot_gain = *(double *) data;
+  cmsUInt16Number rgb[3];
+  double          max = 0.0;
+
+  cmsDoTransform (from_lab, in, rgb, 1);
+  for (int c = 0; c < 3; c++)
+    if (rgb[c] / 65535.0 > max)
+      max = rgb[c] / 65535.0;
+  for (int c = 0; c < 3; c++)
+    out[c] = max > 0.0 ? dot_gain_invert (1.0 - rgb[c] / 65535.0 / max,
+                                          dot_gain) * 65535.0 + 0.5 : 0;
+  out[3] = dot_gain_invert (1.0 - max, dot_gain) * 65535.0 + 0.5;
+  return 1;
+}
+
+const Babl *
+lcms_cmyk_space (void)
+{
+  return lcms_cmyk_space_dot_gain (0.0);
+}
+
+const Babl *
+lcms_cmyk_space_dot_gain (double dot_gain)
+{
+  cmsHPROFILE      lab     = cmsCreateLab4Profile (NULL);
+  cmsHPROFILE      srgb    = cmsCreate_sRGBProfile ();
+  cmsHPROFILE      profile = cmsCreateProfilePlaceholder (NULL);
+  cmsPipeline     *a2b     = cmsPipelineAlloc (NULL, 4, 3);
+  cmsPipeline     *b2a     = cmsPipelineAlloc (NULL, 3, 4);
+  cmsStage        *clut;
+  cmsUInt32Number  size    = 0;
+  char            *icc;
+  const Babl      *space;
+
+  to_lab   = cmsCreateTransform (srgb, TYPE_RGB_16, lab, TYPE_LabV2_16,
+                                 INTENT_RELATIVE_COLORIMETRIC, 0);
+  from_lab = cmsCreateTransform (lab, TYPE_LabV2_16, srgb, TYPE_RGB_16,
+                                 INTENT_RELATIVE_COLORIMETRIC, 0);
+
+  clut = cmsStageAllocCLut16bit (NULL, 9, 4, 3, NULL);
+  cmsStageSampleCLut16bit (clut, sample_cmyk_to_lab, &dot_gain, 0);
+  cmsPipelineInsertStage (a2b, cmsAT_END, clut);
+  clut = cmsStageAllocCLut16bit (NULL, 9, 3, 4, NULL);
+  cmsStageSampleCLut16bit (clut, sample_lab_to_cmyk, &dot_gain, 0);
+  cmsPipelineInsertStage (b2a, cmsAT_END, clut);
+
+  cmsSetProfileVersion (profile, 2.1);
+  cmsSetDeviceClass (profile, cmsSigOutputClass);
+  cmsSetColorSpace (profile, cmsSigCmykData);
+  cmsSetPCS (profile, cmsSigLabData);
+  cmsWriteTag (profile, cmsSigAToB0Tag, a2b);
+  cmsWriteTag (profile, cmsSigBToA0Tag, b2a);
+
+  cmsSaveProfileToMem (profile, NULL, &size);
+  icc = malloc (size);
+  cmsSaveProfileToMem (profile, icc, &size);
+  space = babl_space_from_icc (icc, size,
+                               BABL_ICC_INTENT_RELATIVE_COLORIMETRIC, NULL);
+
+  free (icc);
+  cmsPipelineFree (a2b);
+  cmsPipelineFree (b2a);
+  cmsDeleteTransform (to_lab);
+  cmsDeleteTransform (from_lab);
+  cmsCloseProfile (profile);
+  cmsCloseProfile (srgb);
+  cmsCloseProfile (lab);
+  return space;
+}
+
+#endif
+
+const Babl *
+double_format (const Babl *format)
+{
+  const char *model = babl_get_name (babl_format_get_model (format));
+
+  return babl_format_with_space (strstr (model, "CMYK") ?
+                                 "CMYKA double" : "RGBA double",
+                                 babl_format_get_space (format));
+}
+
+typedef struct
+{
+  const Babl *source;
+  const Babl *destination;
+  void       *data;
+  Babl       *conversion;
+} Lookup;
+
+static int
+match_conversion (Babl *babl,
+                  void *data)
+{
+  Lookup *lookup = data;
+
+  if (babl->conversion.source == lookup->source &&
+      babl->conversion.destination == lookup->destination &&
+      (!lookup->data || babl->conversion.data == lookup->data))
+    {
+      lookup->conversion = babl;
+      return 1;
+    }
+  return 0;
+}
+
+Babl *
+find_conversion (const Babl *source,
+                 const Babl *destination,
+                 void       *data)
+{
+  Lookup lookup = { source, destination, data, NULL };
+
+  babl_conversion_class_for_each (match_conversion, &lookup);
+  if (!lookup.conversion)
+    fprintf (stderr, "no conversion from %s to %s\n",
+             babl_get_name (source), babl_get_name (destination));
+  return lookup.conversion;
+}
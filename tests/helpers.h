@@ -0,0 +1,72 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BABL_TESTS_HELPERS_H
+#define _BABL_TESTS_HELPERS_H
+
+/* Fixtures shared by the tests, built into a small static library linked
+ * with each of them.
+ */
+
+/* sampled_space:
+ *
+ * Returns a space made of the sRGB profile with its TRC bent, which gives
+ * a space with a sampled TRC of its own.
+ */
+const Babl *sampled_space (void);
+
+/* cmyk_space:
+ *
+ * Returns a CMYK space made of a bare profile header, without color
+ * lookup tables for lcms to transform with.
+ */
+const Babl *cmyk_space (void);
+
+#ifdef HAVE_LCMS
+/* lcms_cmyk_space:
+ *
+ * Returns a CMYK space with a profile of a naive CMYK sampled through the
+ * sRGB and Lab profiles of lcms, which babl transforms with lcms.
+ */
+const Babl *lcms_cmyk_space (void);
+
+/* lcms_cmyk_space_dot_gain:
+ *
+ * Like lcms_cmyk_space(), with the inks spread by dot_gain at half
+ * coverage, which gives a distinct profile for each dot_gain.
+ */
+const Babl *lcms_cmyk_space_dot_gain (double dot_gain);
+#endif
+
+/* double_format:
+ *
+ * Returns the RGBA or CMYKA double format of the space of format, after
+ * the family of its model.
+ */
+const Babl *double_format (const Babl *format);
+
+/* find_conversion:
+ *
+ * Returns the conversion from source to destination, with data as its
+ * data unless data is NULL, or NULL when there is none.
+ */
+Babl *find_conversion (const Babl *source,
+                       const Babl *destination,
+                       void       *data);
+
+#endif
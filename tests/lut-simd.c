@@ -0,0 +1,177 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* The vector loops applying the LUTs of u8 fish paths should give the same
+ * bytes as the scalar ones, which a child process started with
+ * BABL_INHIBIT_LUT_SIMD set runs on the same pixels. Fish paths are picked
+ * by timing them, the child stores its paths in a fish cache of the test
+ * which the parent loads once the child is done, for both to use the same
+ * paths and thus the same LUTs.
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "babl-internal.h"
+
+/* not a multiple of the 8 pixels of the vector loops */
+#define PIXELS 100003
+
+static const char *formats[][2] = {
+  { "R'G'B'A u8",    "RGBA u8" },
+  { "R'aG'aB'aA u8", "RGBA u8" },
+  { "R'G'B' u8",     "RGBA u8" },
+  { "Y'A u8",        "RGBA u8" },
+  { "R'G'B'A u8",    "CIE Lab alpha float" },
+};
+#define N_FORMATS (sizeof (formats) / sizeof (formats[0]))
+
+/* converts the same random pixels with each pair of formats through the
+ * LUT of its fish, returning 0 when a fish does not have one - fishes of
+ * a single conversion call it directly, without a LUT
+ */
+static int
+convert (uint8_t *results[N_FORMATS])
+{
+  static uint8_t pixels[PIXELS * 4];
+  unsigned int   seed = 1;
+
+  for (int i = 0; i < PIXELS * 4; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      pixels[i] = seed >> 16;
+    }
+
+  for (int f = 0; f < N_FORMATS; f++)
+    {
+      Babl *fish = (Babl *) babl_fish (formats[f][0], formats[f][1]);
+
+      if (fish->class_type != BABL_FISH_PATH ||
+          babl_list_size (fish->fish_path.conversion_list) < 2)
+        {
+          fprintf (stderr, "%s to %s: not a fish path of several steps\n",
+                   formats[f][0], formats[f][1]);
+          return 0;
+        }
+      /* whether a LUT pays off depends on timings, use it regardless */
+      fish->fish_path.is_u8_color_conv = 1;
+
+      /* the LUT is made once enough pixels have been converted */
+      babl_process (fish, pixels, results[f], PIXELS);
+      babl_process (fish, pixels, results[f], PIXELS);
+      if (!fish->fish_path.u8_lut)
+        {
+          fprintf (stderr, "%s to %s: no LUT\n",
+                   formats[f][0], formats[f][1]);
+          return 0;
+        }
+    }
+  return 1;
+}
+
+static int
+result_size (int f)
+{
+  return PIXELS * babl_format_get_bytes_per_pixel (babl_format (formats[f][1]));
+}
+
+static void
+remove_cache (const char *cache)
+{
+  const char *files[] = { "babl/babl-fishes.bin", "babl/babl-fishes",
+                          "babl", "" };
+  char        path[256];
+
+  for (int i = 0; i < sizeof (files) / sizeof (files[0]); i++)
+    {
+      snprintf (path, sizeof (path), "%s/%s", cache, files[i]);
+      remove (path);
+    }
+}
+
+int
+main (void)
+{
+  uint8_t *vector[N_FORMATS];
+  uint8_t *scalar[N_FORMATS];
+  uint8_t *shared;
+  char     cache[] = "/tmp/babl-lut-simd-XXXXXX";
+  pid_t    child;
+  int      status;
+  int      OK = 1;
+
+  if (!mkdtemp (cache))
+    return 1;
+  setenv ("XDG_CACHE_HOME", cache, 1);
+  setenv ("BABL_INHIBIT_LUT_CACHE", "1", 1);
+
+  /* the child leaves its results here, at most 16 bytes a pixel */
+  shared = mmap (NULL, N_FORMATS * PIXELS * 16, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED)
+    return 1;
+  for (int f = 0; f < N_FORMATS; f++)
+    scalar[f] = shared + f * PIXELS * 16;
+
+  child = fork ();
+  if (child < 0)
+    return 1;
+
+  if (child == 0)
+    {
+      setenv ("BABL_INHIBIT_LUT_SIMD", "1", 1);
+      babl_init ();
+      OK = convert (scalar);
+      babl_exit ();
+      _exit (!OK);
+    }
+
+  if (waitpid (child, &status, 0) != child ||
+      !WIFEXITED (status) || WEXITSTATUS (status))
+    {
+      fprintf (stderr, "the scalar conversions failed\n");
+      OK = 0;
+    }
+
+  babl_init ();
+
+  for (int f = 0; f < N_FORMATS; f++)
+    vector[f] = malloc (result_size (f));
+  OK = OK && convert (vector);
+
+  for (int f = 0; OK && f < N_FORMATS; f++)
+    if (memcmp (vector[f], scalar[f], result_size (f)))
+      {
+        fprintf (stderr, "%s to %s: the vector LUT loop differs from the "
+                 "scalar one\n", formats[f][0], formats[f][1]);
+        OK = 0;
+      }
+
+  for (int f = 0; f < N_FORMATS; f++)
+    free (vector[f]);
+  munmap (shared, N_FORMATS * PIXELS * 16);
+  babl_exit ();
+  remove_cache (cache);
+
+  return !OK;
+}
@@ -25,12 +25,15 @@
 #include "babl.h"
 
 
-#define N_THREADS 10
-#define N_PIXELS  1000000 /* (per thread) */
+/* should be the same as HASH_SETS and CACHE_SHARDS in babl/babl-palette.c */
+#define BABL_PALETTE_HASH_TABLE_SIZE 1021
+#define BABL_PALETTE_CACHE_SHARDS    16
 
-
-/* should be the same as HASH_TABLE_SIZE in babl/babl-palette.c */
-#define BABL_PALETTE_HASH_TABLE_SIZE 1111
+/* threads are spread over the caches of a palette, with twice as many
+ * threads as caches they still update the same caches concurrently
+ */
+#define N_THREADS (2 * BABL_PALETTE_CACHE_SHARDS)
+#define N_PIXELS  250000 /* (per thread) */
 
 
 typedef struct
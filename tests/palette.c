@@ -153,7 +153,64 @@ main (void)
   }
 #endif
 
+  /* with small and large palettes, every pixel should map to its nearest
+   * color - the lowest index of the nearest ones on ties - also once cached
+   */
+  for (int count = 24; count <= 256; count += 232)
+  {
+    static unsigned char palette[256 * 4];
+    static unsigned char pixels[4096 * 4];
+    static unsigned char indices[4096];
+    const Babl *pal;
+    const Babl *fish;
+    unsigned int seed = 1;
 
+    babl_new_palette (NULL, &pal, NULL);
+    for (int i = 0; i < 256 * 4; i++)
+      {
+        seed = seed * 1103515245 + 12345;
+        palette[i] = (seed >> 16) & 0xf0;
+      }
+    babl_palette_set_palette (pal, babl_format ("R'G'B'A u8"), palette, count);
+
+    for (int i = 0; i < 4096 * 4; i++)
+      {
+        seed = seed * 1103515245 + 12345;
+        pixels[i] = (seed >> 16) & 0xff;
+      }
+    fish = babl_fish (babl_format ("R'G'B'A u8"), pal);
+
+    for (int round = 0; round < 2; round++)
+      {
+        babl_process (fish, pixels, indices, 4096);
+
+        for (int i = 0; i < 4096 && OK; i++)
+          {
+            int best = 0, best_diff2 = 1 << 30;
+
+            for (int j = 0; j < count; j++)
+              {
+                int diff2 = 0;
+
+                for (int c = 0; c < 3; c++)
+                  diff2 += (pixels[i * 4 + c] - palette[j * 4 + c]) *
+                           (pixels[i * 4 + c] - palette[j * 4 + c]);
+                if (diff2 < best_diff2)
+                  {
+                    best       = j;
+                    best_diff2 = diff2;
+                  }
+              }
+
+            if (indices[i] != best)
+              {
+                fprintf (stderr, "pixel %i maps to %i instead of %i\n",
+                         i, indices[i], best);
+                OK = 0;
+              }
+          }
+      }
+  }
 
   babl_exit ();
   return !OK;
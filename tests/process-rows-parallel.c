@@ -0,0 +1,103 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "babl.h"
+
+
+#define WIDTH  1000
+#define HEIGHT 300
+
+static int
+test_rows (const char *source_format,
+           const char *dest_format,
+           int         width,
+           int         height,
+           int         stride)
+{
+  const Babl *fish    = babl_fish (source_format, dest_format);
+  int      source_bpp = babl_format_get_bytes_per_pixel (babl_format (source_format));
+  int      dest_bpp   = babl_format_get_bytes_per_pixel (babl_format (dest_format));
+  float   *pattern    = malloc (stride * 4 * sizeof (float) * height);
+  uint8_t *source     = malloc (stride * source_bpp * height);
+  uint8_t *serial     = calloc (stride * dest_bpp, height);
+  uint8_t *parallel   = calloc (stride * dest_bpp, height);
+  int      OK = 1;
+
+  /* in range values, NaNs and infinities could convert differently
+   * depending on the SIMD code paths taken
+   */
+  for (long i = 0; i < (long) stride * height * 4; i++)
+    pattern[i] = ((i * 7 + i / 13) & 0xff) / 255.0f;
+  babl_process (babl_fish ("RGBA float", source_format),
+                pattern, source, (long) stride * height);
+
+  babl_process_rows (fish, source, stride * source_bpp,
+                     serial, stride * dest_bpp, width, height);
+  babl_process_rows_parallel (fish, source, stride * source_bpp,
+                              parallel, stride * dest_bpp, width, height);
+
+  if (memcmp (serial, parallel, stride * dest_bpp * height))
+    {
+      fprintf (stderr, "%s to %s: %ix%i differs from serial conversion\n",
+               source_format, dest_format, width, height);
+      OK = 0;
+    }
+
+  free (pattern);
+  free (source);
+  free (serial);
+  free (parallel);
+  return OK;
+}
+
+int
+main (void)
+{
+  const char *formats[][2] = {
+    { "R'G'B'A u8", "RGBA float" },
+    { "R'G'B' u8",  "Y'A u16" },
+    { "RGBA float", "R'G'B'A u8" },
+  };
+  int OK = 1;
+
+  /* use the worker threads even on single core machines */
+  setenv ("BABL_THREADS", "4", 1);
+
+  babl_init ();
+
+  for (size_t i = 0; i < sizeof (formats) / sizeof (formats[0]); i++)
+    {
+      const char *src = formats[i][0];
+      const char *dst = formats[i][1];
+
+      OK &= test_rows (src, dst, WIDTH, HEIGHT, WIDTH + 3);
+      /* fewer rows than threads, splitting the rows themselves */
+      OK &= test_rows (src, dst, WIDTH * HEIGHT, 1, WIDTH * HEIGHT);
+      OK &= test_rows (src, dst, WIDTH * 100, 3, WIDTH * 100 + 5);
+    }
+
+  babl_exit ();
+
+  return !OK;
+}
@@ -0,0 +1,268 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* The single precision reference fish of u8, u16 and float formats should
+ * agree with the double one, which a child process started with
+ * BABL_REFERENCE_NOFLOAT set runs on the same pixels.
+ */
+
+#include "config.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "babl-internal.h"
+
+/* counts around the 8 floats of the vector loops, and around the 4096
+ * pixels reference fishes process at a time
+ */
+static const long counts[] = { 1, 7, 9, 15, 1001, 4095, 4097, 12293 };
+#define N_COUNTS  (sizeof (counts) / sizeof (counts[0]))
+#define PIXELS    12293
+
+static const struct
+{
+  const char *source;
+  const char *source_space;
+  const char *destination;
+  const char *destination_space;
+} pairs[] = {
+  { "R'G'B'A u8",  "sRGB",    "RGBA u16",            "ProPhoto" },
+  { "R'G'B' u8",   "sRGB",    "RGBA float",          "Apple" },
+  { "RGBA u16",    "Apple",   "CIE Lab alpha float", "sRGB" },
+  { "Y'A u16",     "sRGB",    "R'G'B' u8",           "ProPhoto" },
+  { "RGBA float",  "Apple",   "R'aG'aB'aA u8",       "ProPhoto" },
+  { "R'G'B' float","ProPhoto","RaGaBaA u16",         "sRGB" },
+};
+#define N_PAIRS (sizeof (pairs) / sizeof (pairs[0]))
+
+static const Babl *
+pair_format (int         p,
+             int         destination)
+{
+  return babl_format_with_space (destination ? pairs[p].destination
+                                             : pairs[p].source,
+                                 babl_space (destination ?
+                                             pairs[p].destination_space :
+                                             pairs[p].source_space));
+}
+
+static long
+pair_size (int p,
+           int destination,
+           long n)
+{
+  return n * babl_format_get_bytes_per_pixel (pair_format (p, destination));
+}
+
+/* the same pixels for the source of each pair, floats in 0.0 - 1.0 */
+static void
+source_pixels (int   p,
+               char *pixels)
+{
+  const Babl   *format = pair_format (p, 0);
+  unsigned int  seed = 1;
+
+  if (babl_format_get_type (format, 0) == babl_type ("float"))
+    {
+      float *floats = (float *) pixels;
+
+      for (long i = 0; i < pair_size (p, 0, PIXELS) / 4; i++)
+        {
+          seed = seed * 1103515245 + 12345;
+          floats[i] = (seed >> 16) / 65535.0f;
+        }
+    }
+  else
+    {
+      for (long i = 0; i < pair_size (p, 0, PIXELS); i++)
+        {
+          seed = seed * 1103515245 + 12345;
+          pixels[i] = seed >> 16;
+        }
+    }
+}
+
+/* converts the pixels of a pair, n at a time, with the reference fish of
+ * the pair
+ */
+static int
+convert (int   p,
+         long  n,
+         char *result)
+{
+  const Babl *fish = babl_fish (pair_format (p, 0), pair_format (p, 1));
+  char       *pixels = malloc (pair_size (p, 0, PIXELS));
+
+  if (fish->class_type != BABL_FISH_REFERENCE)
+    {
+      fprintf (stderr, "%s to %s: not a reference fish\n",
+               babl_get_name (pair_format (p, 0)),
+               babl_get_name (pair_format (p, 1)));
+      free (pixels);
+      return 0;
+    }
+
+  source_pixels (p, pixels);
+  for (long done = 0; done < PIXELS; done += n)
+    babl_process (fish, pixels + pair_size (p, 0, done),
+                  result + pair_size (p, 1, done),
+                  PIXELS - done < n ? PIXELS - done : n);
+
+  free (pixels);
+  return 1;
+}
+
+/* integer components may round the other way, float ones are compared
+ * relative to their magnitude
+ */
+static int
+compare (int         p,
+         long        n,
+         const char *result,
+         const char *reference)
+{
+  const Babl *format = pair_format (p, 1);
+  const Babl *type = babl_format_get_type (format, 0);
+  int         components = babl_format_get_n_components (format);
+
+  for (long i = 0; i < PIXELS * components; i++)
+    {
+      double value, expected, tolerance;
+
+      if (type == babl_type ("u8"))
+        {
+          value     = ((const uint8_t *) result)[i];
+          expected  = ((const uint8_t *) reference)[i];
+          tolerance = 1.0;
+        }
+      else if (type == babl_type ("u16"))
+        {
+          value     = ((const uint16_t *) result)[i];
+          expected  = ((const uint16_t *) reference)[i];
+          tolerance = 1.0;
+        }
+      else
+        {
+          value     = ((const float *) result)[i];
+          expected  = ((const float *) reference)[i];
+          tolerance = 0.0001 * (1.0 + fabs (expected));
+        }
+
+      if (fabs (value - expected) > tolerance)
+        {
+          fprintf (stderr, "%s to %s, %li at a time: pixel %li component %li "
+                   "is %f should be %f\n",
+                   babl_get_name (pair_format (p, 0)), babl_get_name (format),
+                   n, i / components, i % components, value, expected);
+          return 0;
+        }
+    }
+  return 1;
+}
+
+int
+main (void)
+{
+  char  *results[N_PAIRS];
+  char  *references[N_PAIRS];
+  int    fds[2];
+  pid_t  child;
+  int    status;
+  int    OK = 1;
+
+  /* no fish paths, only reference fishes */
+  putenv ("BABL_TOLERANCE" "=" "0.0");
+
+  if (pipe (fds))
+    return 1;
+
+  child = fork ();
+  if (child < 0)
+    return 1;
+
+  if (child == 0)
+    {
+      close (fds[0]);
+      setenv ("BABL_REFERENCE_NOFLOAT", "1", 1);
+      babl_init ();
+
+      for (int p = 0; OK && p < N_PAIRS; p++)
+        {
+          references[p] = malloc (pair_size (p, 1, PIXELS));
+          OK = convert (p, PIXELS, references[p]);
+
+          for (long done = 0, n; OK && done < pair_size (p, 1, PIXELS); done += n)
+            {
+              n = write (fds[1], references[p] + done,
+                         pair_size (p, 1, PIXELS) - done);
+              if (n <= 0)
+                OK = 0;
+            }
+          free (references[p]);
+        }
+      close (fds[1]);
+
+      babl_exit ();
+      _exit (!OK);
+    }
+
+  close (fds[1]);
+  babl_init ();
+
+  for (int p = 0; p < N_PAIRS; p++)
+    {
+      results[p]    = malloc (pair_size (p, 1, PIXELS));
+      references[p] = calloc (1, pair_size (p, 1, PIXELS));
+
+      for (long done = 0, n; done < pair_size (p, 1, PIXELS); done += n)
+        {
+          n = read (fds[0], references[p] + done,
+                    pair_size (p, 1, PIXELS) - done);
+          if (n <= 0)
+            break;
+        }
+    }
+  close (fds[0]);
+
+  if (waitpid (child, &status, 0) != child ||
+      !WIFEXITED (status) || WEXITSTATUS (status))
+    {
+      fprintf (stderr, "the double reference conversions failed\n");
+      OK = 0;
+    }
+
+  for (int p = 0; OK && p < N_PAIRS; p++)
+    for (int c = 0; OK && c < N_COUNTS; c++)
+      {
+        OK = convert (p, counts[c], results[p]);
+        OK = OK && compare (p, counts[c], results[p], references[p]);
+      }
+
+  for (int p = 0; p < N_PAIRS; p++)
+    {
+      free (results[p]);
+      free (references[p]);
+    }
+  babl_exit ();
+
+  return !OK;
+}
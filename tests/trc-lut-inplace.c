@@ -0,0 +1,90 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* Applying a sampled TRC to a buffer in place, with three components to
+ * a pixel and pixel counts that do not fill whole vectors, should give the
+ * same values as applying it to each value.
+ */
+
+#include "config.h"
+#include <math.h>
+#include <stdio.h>
+#include "babl-internal.h"
+#include "helpers.h"
+
+#define MAX_COUNT 20
+#define TOLERANCE 0.000001
+
+static int
+compare (const Babl *trc,
+         int         from_linear,
+         int         count)
+{
+  float values[MAX_COUNT * 3];
+  int   OK = 1;
+
+  for (int i = 0; i < count * 3; i++)
+    values[i] = (i * 37 % 61) / 60.0f;
+
+  if (from_linear)
+    babl_trc_from_linear_buf (trc, values, values, 3, 3, 3, count);
+  else
+    babl_trc_to_linear_buf (trc, values, values, 3, 3, 3, count);
+
+  for (int i = 0; i < count * 3; i++)
+    {
+      float value = (i * 37 % 61) / 60.0f;
+      float reference = from_linear ? babl_trc_from_linear (trc, value)
+                                    : babl_trc_to_linear (trc, value);
+
+      if (fabs (values[i] - reference) > TOLERANCE)
+        {
+          fprintf (stderr, "%s of %i pixels: component %i is %f should be %f\n",
+                   from_linear ? "from linear" : "to linear",
+                   count, i, values[i], reference);
+          OK = 0;
+        }
+    }
+  return OK;
+}
+
+int
+main (void)
+{
+  const Babl *space;
+  int         OK = 1;
+
+  babl_init ();
+
+  space = sampled_space ();
+  if (!space || space->space.trc[0]->trc.type != BABL_TRC_LUT)
+    {
+      fprintf (stderr, "failed to create a space with a sampled TRC\n");
+      return 1;
+    }
+
+  for (int count = 1; count <= MAX_COUNT; count++)
+    {
+      OK &= compare (space->space.trc[0], 0, count);
+      OK &= compare (space->space.trc[0], 1, count);
+    }
+
+  babl_exit ();
+
+  return !OK;
+}
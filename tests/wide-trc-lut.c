@@ -0,0 +1,110 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* R'G'B'A u16 and half to RGBA float in another space, which can decode
+ * with tables of the linear values of every code, should agree with
+ * decoding to R'G'B'A float first.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <babl/babl.h>
+
+#define PIXELS    65536
+#define TOLERANCE 0.0001
+
+static int
+in_range (const float *pixel)
+{
+  for (int c = 0; c < 4; c++)
+    if (!(pixel[c] >= 0.0f && pixel[c] <= 1.0f))
+      return 0;
+  return 1;
+}
+
+static int
+compare (const char *source_encoding,
+         const Babl *source_space,
+         const Babl *destination_space)
+{
+  static uint16_t pixels[PIXELS * 4];
+  static float    nonlinear[PIXELS * 4];
+  static float    result[PIXELS * 4];
+  static float    reference[PIXELS * 4];
+  const Babl     *source = babl_format_with_space (source_encoding, source_space);
+  const Babl     *destination = babl_format_with_space ("RGBA float",
+                                                        destination_space);
+  int             OK = 1;
+
+  for (int i = 0; i < PIXELS; i++)
+    {
+      pixels[i * 4 + 0] = i;
+      pixels[i * 4 + 1] = (i * 7919L) % PIXELS;
+      pixels[i * 4 + 2] = PIXELS - 1 - i;
+      pixels[i * 4 + 3] = (i * 104729L) % PIXELS;
+    }
+
+  babl_process (babl_fish (source, destination), pixels, result, PIXELS);
+
+  babl_process (babl_fish (source,
+                           babl_format_with_space ("R'G'B'A float", source_space)),
+                pixels, nonlinear, PIXELS);
+  babl_process (babl_fish (babl_format_with_space ("R'G'B'A float", source_space),
+                           destination),
+                nonlinear, reference, PIXELS);
+
+  for (int i = 0; i < PIXELS * 4 && OK; i++)
+    {
+      /* half inputs include values, infinities and NaNs outside the range
+       * of the TRCs, which other paths extrapolate differently
+       */
+      if (!in_range (&nonlinear[i / 4 * 4]))
+        continue;
+
+      if (fabs (result[i] - reference[i]) > TOLERANCE)
+        {
+          fprintf (stderr, "%s to %s: pixel %i component %i is %f should be %f\n",
+                   babl_get_name (source), babl_get_name (destination),
+                   i / 4, i % 4, result[i], reference[i]);
+          OK = 0;
+        }
+    }
+
+  return OK;
+}
+
+int
+main (void)
+{
+  const char *spaces[] = { "sRGB", "ProPhoto", "Apple", NULL };
+  int         OK = 1;
+
+  babl_init ();
+
+  for (int s = 0; spaces[s]; s++)
+    for (int d = 0; spaces[d]; d++)
+      {
+        OK &= compare ("R'G'B'A u16", babl_space (spaces[s]), babl_space (spaces[d]));
+        OK &= compare ("R'G'B'A half", babl_space (spaces[s]), babl_space (spaces[d]));
+      }
+
+  babl_exit ();
+
+  return !OK;
+}
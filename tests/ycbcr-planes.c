@@ -0,0 +1,238 @@
+/* babl - dynamically extendable universal pixel conversion library.
+ * Copyright (C) 2005, Øyvind Kolås.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General
+ * Public License along with this library; if not, see
+ * <https://www.gnu.org/licenses/>.
+ */
+
+/* The u8 and u16 Y'CbCr formats should encode R'G'B' to the codes of
+ * their standard and range, and decode them back. Converting the planes
+ * of 4:2:0 and 4:2:2 frames with babl_process_planes should give the
+ * same pixels as converting their chroma repeated to 4:4:4.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <babl/babl.h>
+
+#define PIXELS 4096
+
+static const struct
+{
+  const char *model;
+  double      kr;
+  double      kb;
+} standards[] =
+{
+  { "Y'CbCr",     0.299,  0.114  },
+  { "Y'CbCr709",  0.2126, 0.0722 },
+  { "Y'CbCr2020", 0.2627, 0.0593 },
+};
+
+static const struct
+{
+  const char *name;
+  int         bits;
+  double      luma_min;
+  double      luma_max;
+  double      chroma_range;
+  double      chroma_center;
+} ranges[] =
+{
+  { "u8",        8,  16,   235,   224,   128 },
+  { "u8 full",   8,  0,    255,   255,   128 },
+  { "u16",       16, 4096, 60160, 57344, 32768 },
+  { "u16 full",  16, 0,    65535, 65535, 32768 },
+};
+
+#define N_STANDARDS (sizeof (standards) / sizeof (standards[0]))
+#define N_RANGES    (sizeof (ranges) / sizeof (ranges[0]))
+
+static int
+code_at (const void *codes,
+         int         bits,
+         long        i)
+{
+  return bits == 8 ? ((const uint8_t *) codes)[i] : ((const uint16_t *) codes)[i];
+}
+
+static int
+check_encoding (int s,
+                int r)
+{
+  static float    rgba[PIXELS * 4];
+  static float    decoded[PIXELS * 4];
+  static uint16_t codes[PIXELS * 3];
+  const Babl     *rgba_float = babl_format ("R'G'B'A float");
+  const Babl     *format;
+  char            name[64];
+  double          kr = standards[s].kr;
+  double          kb = standards[s].kb;
+  int             bits = ranges[r].bits;
+  int             OK = 1;
+
+  snprintf (name, sizeof (name), "%s 4:4:4 %s",
+            standards[s].model, ranges[r].name);
+  format = babl_format (name);
+
+  for (int i = 0; i < PIXELS * 4; i++)
+    rgba[i] = (i % 4 == 3) ? 1.0f : (rand () % 1001) / 1000.0f;
+
+  babl_process (babl_fish (rgba_float, format), rgba, codes, PIXELS);
+  babl_process (babl_fish (format, rgba_float), codes, decoded, PIXELS);
+
+  for (int i = 0; i < PIXELS && OK; i++)
+    {
+      const float *pixel = &rgba[i * 4];
+      double luminance = kr * pixel[0] + (1.0 - kr - kb) * pixel[1] + kb * pixel[2];
+      double expected[3] = {
+        ranges[r].luma_min + luminance * (ranges[r].luma_max - ranges[r].luma_min),
+        ranges[r].chroma_center + ranges[r].chroma_range *
+          (pixel[2] - luminance) / (2.0 * (1.0 - kb)),
+        ranges[r].chroma_center + ranges[r].chroma_range *
+          (pixel[0] - luminance) / (2.0 * (1.0 - kr))
+      };
+      double step = 1.0 / (ranges[r].luma_max - ranges[r].luma_min);
+
+      for (int c = 0; c < 3; c++)
+        {
+          double max = c ? ranges[r].chroma_center * 2 - 1 : ranges[r].luma_max;
+
+          if (expected[c] > max)
+            expected[c] = max;
+
+          if (fabs (code_at (codes, bits, i * 3 + c) - expected[c]) > 1.0)
+            {
+              fprintf (stderr, "%s: pixel %i component %i is %i should be %f\n",
+                       name, i, c, code_at (codes, bits, i * 3 + c), expected[c]);
+              OK = 0;
+            }
+        }
+
+      /* the round trip is off by the quantization of the chroma, which
+       * is amplified by up to 2 (1 - kr) when decoding
+       */
+      for (int c = 0; c < 4 && OK; c++)
+        if (fabs (decoded[i * 4 + c] - pixel[c]) > 4 * step)
+          {
+            fprintf (stderr, "%s: pixel %i component %i comes back as %f from %f\n",
+                     name, i, c, decoded[i * 4 + c], pixel[c]);
+            OK = 0;
+          }
+    }
+
+  return OK;
+}
+
+static int
+check_planes (int  s,
+              int  r,
+              const char *sampling,
+              int  horizontal,
+              int  vertical,
+              int  width,
+              int  height)
+{
+  const Babl *rgba_float = babl_format ("R'G'B'A float");
+  const Babl *planar;
+  const Babl *packed;
+  int         bytes = ranges[r].bits / 8;
+  int         chroma_width = (width + horizontal - 1) / horizontal;
+  int         chroma_height = (height + vertical - 1) / vertical;
+  char        name[64];
+  uint8_t    *planes[3];
+  int         strides[3];
+  uint8_t    *interleaved = malloc ((long) width * height * 3 * bytes);
+  float      *result = malloc ((long) width * height * 4 * sizeof (float));
+  float      *reference = malloc ((long) width * height * 4 * sizeof (float));
+  int         OK = 1;
+
+  snprintf (name, sizeof (name), "%s %s %s",
+            standards[s].model, sampling, ranges[r].name);
+  planar = babl_format (name);
+  snprintf (name, sizeof (name), "%s 4:4:4 %s",
+            standards[s].model, ranges[r].name);
+  packed = babl_format (name);
+
+  /* padded strides, to tell rows of planes apart */
+  strides[0] = (width + 3) * bytes;
+  strides[1] = strides[2] = (chroma_width + 5) * bytes;
+  planes[0] = malloc ((long) strides[0] * height);
+  planes[1] = malloc ((long) strides[1] * chroma_height);
+  planes[2] = malloc ((long) strides[2] * chroma_height);
+
+  for (int p = 0; p < 3; p++)
+    for (long i = 0; i < (long) strides[p] * (p ? chroma_height : height); i++)
+      planes[p][i] = rand ();
+
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      for (int p = 0; p < 3; p++)
+        {
+          int  px = p ? x / horizontal : x;
+          int  py = p ? y / vertical : y;
+          long i = ((long) y * width + x) * 3 + p;
+
+          for (int b = 0; b < bytes; b++)
+            interleaved[i * bytes + b] =
+              planes[p][(long) py * strides[p] + px * bytes + b];
+        }
+
+  babl_process_planes (babl_fish (planar, rgba_float),
+                       (const void **) planes, strides,
+                       result, width * 4 * sizeof (float), width, height);
+  babl_process (babl_fish (packed, rgba_float),
+                interleaved, reference, (long) width * height);
+
+  for (long i = 0; i < (long) width * height * 4 && OK; i++)
+    if (result[i] != reference[i])
+      {
+        fprintf (stderr, "%s: pixel %li component %li is %f should be %f\n",
+                 babl_get_name (planar), i / 4, i % 4, result[i], reference[i]);
+        OK = 0;
+      }
+
+  for (int p = 0; p < 3; p++)
+    free (planes[p]);
+  free (interleaved);
+  free (result);
+  free (reference);
+
+  return OK;
+}
+
+int
+main (void)
+{
+  int OK = 1;
+
+  babl_init ();
+
+  for (unsigned int s = 0; s < N_STANDARDS; s++)
+    for (unsigned int r = 0; r < N_RANGES; r++)
+      {
+        OK &= check_encoding (s, r);
+        OK &= check_planes (s, r, "4:2:0", 2, 2, 37, 21);
+        OK &= check_planes (s, r, "4:2:2", 2, 1, 37, 21);
+      }
+
+  /* large enough to be split over threads */
+  OK &= check_planes (1, 0, "4:2:0", 2, 2, 1023, 255);
+
+  babl_exit ();
+
+  return !OK;
+}